@@ -1,6 +1,7 @@
 #version 330 core
 const int MAX_BONES = 128;
 const int MAX_BONE_INFLUENCE = 4;
+const int NO_BONE = 255;  // MODEL_NO_BONE
 
 layout(location = 0) in vec3 v_position;
 layout(location = 1) in vec3 v_normal;
@@ -29,7 +30,7 @@ void main() {
   vec4 total_pos = vec4(0.0);
   int null_ids = 0;
   for (int i = 0; i < MAX_BONE_INFLUENCE; i++) {
-    if (v_bone_ids[i] == -1) {
+    if (v_bone_ids[i] == -1 || v_bone_ids[i] == NO_BONE) {
       null_ids++;
       continue;
     }
@@ -231,6 +231,7 @@ class GameEventJob : public SchedulerJob {
   }
 
   virtual double getFrameRate() { return 1.0 / input_rate.getFloat(); }
+  virtual Phase getPhase() { return InputPhase; }
 };
 
 class ConsoleLineInputJob : public SchedulerJob {
@@ -2,6 +2,7 @@
 #include <glm/glm.hpp>
 #include <map>
 #include <mutex>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -16,6 +17,8 @@ enum DataType {
   DtUnsignedInt,
   DtInt,
   DtFloat,
+  DtHalfFloat,      // only useful for vertex attributes
+  DtInt2101010Rev,  // packed signed 10:10:10:2, for vertex attributes
   DtMat2,
   DtMat3,
   DtMat4,
@@ -72,6 +75,7 @@ class BaseTexture : public BaseGfxEntity {
     IF_RGBA_S3TC_DXT1,
     IF_RGBA_S3TC_DXT3,
     IF_RGBA_S3TC_DXT5,
+    IF_RGBA_BPTC,
   };
 
   enum Format {
@@ -82,6 +86,7 @@ class BaseTexture : public BaseGfxEntity {
     RGBA_S3TC_DXT1,
     RGBA_S3TC_DXT3,
     RGBA_S3TC_DXT5,
+    RGBA_BPTC,  // BC7
   };
 
   enum Filtering {
@@ -102,6 +107,21 @@ class BaseTexture : public BaseGfxEntity {
   virtual void upload2d(int width, int height, DataType type, Format format,
                         void* data, int mipmapLevels = 0) = 0;
 
+  /**
+   * @brief Uploads a texture along with all of its mips, level 0 first.
+   *
+   * Block compressed formats are uploaded as is, uncompressed formats are
+   * DtUnsignedByte. Nothing is generated at runtime.
+   *
+   * Only the levels from baseLevel on are read and kept on the GPU, the
+   * texture samples as if that were its full size. Uploading the same
+   * texture again with a lower baseLevel only sends the new levels, a higher
+   * one frees the levels above it.
+   */
+  virtual void upload2dMips(int width, int height, Format format,
+                            std::vector<std::span<const unsigned char>> levels,
+                            int baseLevel = 0) = 0;
+
   virtual void setFiltering(Filtering min, Filtering max) = 0;
 
   // data[0] = GL_TEXTURE_CUBE_MAP_POSITIVE_X
@@ -269,6 +289,14 @@ class BaseProgram : public BaseGfxEntity {
 
   virtual void link() = 0;
   virtual void bind() = 0;
+  /**
+   * @brief Whether link has finished.
+   *
+   * Backends may finish linking in the background. Until then bind draws
+   * with a placeholder that renders nothing, and parameters are applied once
+   * the program is ready.
+   */
+  virtual bool isReady() { return true; }
 
   void addBinding(std::string bindingName, int bindingIndex) {
     bindings[bindingName] = bindingIndex;
@@ -296,12 +324,14 @@ class BaseArrayPointers : public BaseGfxEntity {
     int size;  // 1, 2, 3, or 4
     DataType type;
     bool normalized;
+    bool integer;  // read as ivec/uvec in the shader instead of converted
     size_t stride;
     void* offset;
     BaseBuffer* buffer;  // optional external buffer
 
     Attrib(DataType type, int id, int size, size_t stride, void* offset,
-           BaseBuffer* buffer = 0, bool normalized = false) {
+           BaseBuffer* buffer = 0, bool normalized = false,
+           bool integer = false) {
       this->type = type;
       this->layoutId = id;
       this->size = size;
@@ -309,6 +339,7 @@ class BaseArrayPointers : public BaseGfxEntity {
       this->offset = offset;
       this->buffer = buffer;
       this->normalized = normalized;
+      this->integer = integer;
     }
   };
 
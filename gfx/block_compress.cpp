@@ -0,0 +1,246 @@
+#include "block_compress.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace rdm::gfx {
+// endpoints along the principal axis of the block's colours. the axis comes
+// from a few rounds of power iteration on the covariance matrix
+template <int N>
+static void principalEndpoints(const unsigned char* src, float lo[N],
+                               float hi[N]) {
+  float mean[N] = {};
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < N; c++) mean[c] += src[i * 4 + c] / 16.f;
+
+  float cov[N][N] = {};
+  for (int i = 0; i < 16; i++) {
+    float d[N];
+    for (int c = 0; c < N; c++) d[c] = src[i * 4 + c] - mean[c];
+    for (int a = 0; a < N; a++)
+      for (int b = 0; b < N; b++) cov[a][b] += d[a] * d[b];
+  }
+
+  float axis[N];
+  for (int c = 0; c < N; c++) axis[c] = 1.f;
+  for (int iter = 0; iter < 8; iter++) {
+    float next[N] = {};
+    for (int a = 0; a < N; a++)
+      for (int b = 0; b < N; b++) next[a] += cov[a][b] * axis[b];
+    float len = 0.f;
+    for (int c = 0; c < N; c++) len = std::max(len, std::abs(next[c]));
+    if (len == 0.f) break;  // flat block
+    for (int c = 0; c < N; c++) axis[c] = next[c] / len;
+  }
+
+  float lenSq = 0.f;
+  for (int c = 0; c < N; c++) lenSq += axis[c] * axis[c];
+  float tMin = 0.f, tMax = 0.f;
+  for (int i = 0; i < 16; i++) {
+    float t = 0.f;
+    for (int c = 0; c < N; c++) t += (src[i * 4 + c] - mean[c]) * axis[c];
+    t /= lenSq;
+    tMin = std::min(tMin, t);
+    tMax = std::max(tMax, t);
+  }
+
+  for (int c = 0; c < N; c++) {
+    lo[c] = std::clamp(mean[c] + axis[c] * tMin, 0.f, 255.f);
+    hi[c] = std::clamp(mean[c] + axis[c] * tMax, 0.f, 255.f);
+  }
+}
+
+template <int N>
+static int nearestIndex(const unsigned char* texel, const int palette[][4],
+                        int count) {
+  int best = 0;
+  int bestError = INT32_MAX;
+  for (int i = 0; i < count; i++) {
+    int error = 0;
+    for (int c = 0; c < N; c++) {
+      int d = texel[c] - palette[i][c];
+      error += d * d;
+    }
+    if (error < bestError) {
+      bestError = error;
+      best = i;
+    }
+  }
+  return best;
+}
+
+static uint16_t packRGB565(const float c[3]) {
+  int r = std::lround(c[0] * 31.f / 255.f);
+  int g = std::lround(c[1] * 63.f / 255.f);
+  int b = std::lround(c[2] * 31.f / 255.f);
+  return (r << 11) | (g << 5) | b;
+}
+
+static void unpackRGB565(uint16_t v, int out[4]) {
+  int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+  out[0] = (r << 3) | (r >> 2);
+  out[1] = (g << 2) | (g >> 4);
+  out[2] = (b << 3) | (b >> 2);
+  out[3] = 255;
+}
+
+static void writeLE(unsigned char* dst, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) dst[i] = (v >> (i * 8)) & 0xff;
+}
+
+void compressBlockBC1(const unsigned char* src, unsigned char* dst) {
+  float lo[3], hi[3];
+  principalEndpoints<3>(src, lo, hi);
+  uint16_t c0 = packRGB565(hi);
+  uint16_t c1 = packRGB565(lo);
+  // c0 > c1 selects the four colour mode, which BC3 also assumes
+  if (c0 < c1) std::swap(c0, c1);
+
+  uint32_t indices = 0;
+  if (c0 != c1) {
+    int palette[4][4];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    for (int i = 0; i < 16; i++)
+      indices |= nearestIndex<3>(src + i * 4, palette, 4) << (i * 2);
+  }
+
+  writeLE(dst, c0, 2);
+  writeLE(dst + 2, c1, 2);
+  writeLE(dst + 4, indices, 4);
+}
+
+void compressBlockBC3(const unsigned char* src, unsigned char* dst) {
+  int a0 = 0, a1 = 255;
+  for (int i = 0; i < 16; i++) {
+    a0 = std::max(a0, (int)src[i * 4 + 3]);
+    a1 = std::min(a1, (int)src[i * 4 + 3]);
+  }
+
+  // a0 > a1 selects the eight value mode
+  uint64_t indices = 0;
+  if (a0 != a1) {
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    for (int i = 1; i < 7; i++)
+      palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    for (int i = 0; i < 16; i++) {
+      int alpha = src[i * 4 + 3];
+      int best = 0;
+      for (int j = 1; j < 8; j++)
+        if (std::abs(alpha - palette[j]) < std::abs(alpha - palette[best]))
+          best = j;
+      indices |= (uint64_t)best << (i * 3);
+    }
+  }
+
+  dst[0] = a0;
+  dst[1] = a1;
+  writeLE(dst + 2, indices, 6);
+  compressBlockBC1(src, dst + 8);
+}
+
+// little endian bit writer for BC7 blocks
+struct BlockBits {
+  unsigned char* dst;
+  int bit;
+
+  void write(uint32_t value, int count) {
+    for (int i = 0; i < count; i++, bit++)
+      if (value & (1u << i)) dst[bit / 8] |= 1 << (bit % 8);
+  }
+};
+
+static const int bc7Weights4[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                    34, 38, 43, 47, 51, 55, 60, 64};
+
+// 7 bit endpoint plus a p-bit, picking whichever p-bit lands closer
+static void quantizeBC7Endpoint(const float e[4], int q[4], int& p) {
+  float bestError = INFINITY;
+  for (int pbit = 0; pbit < 2; pbit++) {
+    int candidate[4];
+    float error = 0.f;
+    for (int c = 0; c < 4; c++) {
+      candidate[c] = std::clamp((int)std::lround((e[c] - pbit) / 2.f), 0, 127);
+      float d = ((candidate[c] << 1) | pbit) - e[c];
+      error += d * d;
+    }
+    if (error < bestError) {
+      bestError = error;
+      p = pbit;
+      memcpy(q, candidate, sizeof(candidate));
+    }
+  }
+}
+
+void compressBlockBC7(const unsigned char* src, unsigned char* dst) {
+  float lo[4], hi[4];
+  principalEndpoints<4>(src, lo, hi);
+
+  int q[2][4], p[2];
+  quantizeBC7Endpoint(lo, q[0], p[0]);
+  quantizeBC7Endpoint(hi, q[1], p[1]);
+
+  int palette[16][4];
+  for (int c = 0; c < 4; c++) {
+    int e0 = (q[0][c] << 1) | p[0];
+    int e1 = (q[1][c] << 1) | p[1];
+    for (int i = 0; i < 16; i++)
+      palette[i][c] =
+          ((64 - bc7Weights4[i]) * e0 + bc7Weights4[i] * e1 + 32) >> 6;
+  }
+
+  int indices[16];
+  for (int i = 0; i < 16; i++)
+    indices[i] = nearestIndex<4>(src + i * 4, palette, 16);
+
+  // the first index is stored with its top bit implied zero
+  if (indices[0] & 8) {
+    std::swap(q[0], q[1]);
+    std::swap(p[0], p[1]);
+    for (int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+  }
+
+  memset(dst, 0, 16);
+  BlockBits bits = {dst, 0};
+  bits.write(1 << 6, 7);  // mode 6
+  for (int c = 0; c < 4; c++) {
+    bits.write(q[0][c], 7);
+    bits.write(q[1][c], 7);
+  }
+  bits.write(p[0], 1);
+  bits.write(p[1], 1);
+  bits.write(indices[0], 3);
+  for (int i = 1; i < 16; i++) bits.write(indices[i], 4);
+}
+
+size_t compressImage(BlockCompressor compressor, size_t blockSize,
+                     const unsigned char* src, int width, int height,
+                     unsigned char* dst) {
+  unsigned char* out = dst;
+  unsigned char block[64];
+  for (int by = 0; by < height; by += 4) {
+    for (int bx = 0; bx < width; bx += 4) {
+      for (int y = 0; y < 4; y++) {
+        int sy = std::min(by + y, height - 1);
+        for (int x = 0; x < 4; x++) {
+          int sx = std::min(bx + x, width - 1);
+          memcpy(block + (y * 4 + x) * 4, src + ((size_t)sy * width + sx) * 4,
+                 4);
+        }
+      }
+      compressor(block, out);
+      out += blockSize;
+    }
+  }
+  return out - dst;
+}
+}  // namespace rdm::gfx
@@ -0,0 +1,32 @@
+#pragma once
+#include <stddef.h>
+
+namespace rdm::gfx {
+/**
+ * @brief Block compressors used by texture_baker.
+ *
+ * Each takes one 4x4 block of RGBA8 texels (row major, 64 bytes) and writes
+ * the compressed block. They favour being simple and deterministic over
+ * squeezing out the last bit of quality, since this only runs offline.
+ */
+
+// 8 bytes, alpha is ignored
+void compressBlockBC1(const unsigned char* src, unsigned char* dst);
+// 16 bytes
+void compressBlockBC3(const unsigned char* src, unsigned char* dst);
+// 16 bytes, always mode 6 (one subset, RGBA endpoints, 4 bit indices)
+void compressBlockBC7(const unsigned char* src, unsigned char* dst);
+
+typedef void (*BlockCompressor)(const unsigned char* src, unsigned char* dst);
+
+/**
+ * @brief Compresses a whole RGBA8 image, row major.
+ *
+ * Edge blocks of images that aren't a multiple of 4 repeat the last row and
+ * column. Returns the number of bytes written to dst, which must hold
+ * ((width + 3) / 4) * ((height + 3) / 4) blocks.
+ */
+size_t compressImage(BlockCompressor compressor, size_t blockSize,
+                     const unsigned char* src, int width, int height,
+                     unsigned char* dst);
+}  // namespace rdm::gfx
@@ -15,6 +15,7 @@
 #include "logging.hpp"
 #include "postprocessing.hpp"
 #include "renderpass.hpp"
+#include "resource.hpp"
 #include "scheduler.hpp"
 #include "settings.hpp"
 #include "video.hpp"
@@ -43,69 +44,63 @@ GFX_API_INSTANTIATOR(Vulkan, vk::VKContext, vk::VKDevice);
 
 static CVar r_disablepost("r_disablepost", "0", CVARF_GLOBAL | CVARF_SAVE);
 
-TextureCache::TextureCache(BaseDevice* device) {
+TextureCache::TextureCache(BaseDevice* device,
+                           ResourceManager* resourceManager) {
   this->device = device;
+  this->resourceManager = resourceManager;
   this->invalidTexture = device->createTexture();
 }
 
+std::pair<TextureCache::Info, BaseTexture*> TextureCache::getFile(
+    File& file, bool keepData) {
+  if (keepData) {
+    resourceManager->finishLoading(file.texture);
+    if (!file.content) {
+      file.content = file.texture->getContent();
+      file.content->addReference();
+    }
+    resourceManager->finishLoading(file.content);
+  }
+
+  Info info = file.texture->getInfo();
+  info.data = keepData ? file.texture->getPixels() : NULL;
+  BaseTexture* texture = file.texture->getTexture();
+  return std::pair<TextureCache::Info, BaseTexture*>(
+      info, texture ? texture : invalidTexture.get());
+}
+
 std::optional<std::pair<TextureCache::Info, BaseTexture*>>
 TextureCache::getOrLoad2d(const char* path, bool keepData) {
   auto it = textures.find(path);
-  if (it == textures.end()) {
-    TextureCache::Info i;
-    common::OptionalData data = common::FileSystem::singleton()->readFile(path);
-    if (data) {
-      stbi_set_flip_vertically_on_load(true);
-      stbi_uc* uc = stbi_load_from_memory(data->data(), data->size(), &i.width,
-                                          &i.height, &i.channels, 0);
-      if (uc) {
-        switch (i.channels) {
-          case 3:
-            i.format = BaseTexture::RGB;
-            i.internalFormat = BaseTexture::RGB8;
-            break;
-          case 4:
-            i.format = BaseTexture::RGBA;
-            i.internalFormat = BaseTexture::RGBA8;
-            break;
-        }
-
-        std::unique_ptr<BaseTexture> tx = device->createTexture();
-        tx->upload2d(i.width, i.height, DtUnsignedByte, i.format, uc, 4);
-        textures[path] =
-            std::pair<TextureCache::Info, std::unique_ptr<BaseTexture>>(
-                i, std::move(tx));
-
-        if (keepData) {
-          i.data = uc;
-        } else {
-          i.data = 0;
-          stbi_image_free(uc);
-        }
-
-        return std::pair<TextureCache::Info, BaseTexture*>(
-            i, textures[path].second.get());
-      } else {
-        throw std::runtime_error("stbi_load_from_memory");
-      }
-    } else {
-      return {};
-    }
-  } else {
+  if (it != textures.end())
     return std::pair<TextureCache::Info, BaseTexture*>(it->second.first,
                                                        it->second.second.get());
+
+  auto fit = files.find(path);
+  if (fit == files.end()) {
+    if (!resourceManager->getResource(RID(path)) &&
+        !resourceManager->getResourceAvailable(path))
+      return {};
+
+    // decoded on the workers, and shared with everything else using the file
+    resource::Texture* texture =
+        resourceManager->load<resource::Texture>(path);
+    texture->addReference();
+    fit = files.emplace(path, File{texture, NULL}).first;
   }
+  return getFile(fit->second, keepData);
 }
 
 std::optional<std::pair<TextureCache::Info, BaseTexture*>> TextureCache::get(
     const char* path) {
   auto it = textures.find(path);
-  if (it == textures.end()) {
-    return {};
-  } else {
+  if (it != textures.end())
     return std::pair<TextureCache::Info, BaseTexture*>(it->second.first,
                                                        it->second.second.get());
-  }
+
+  auto fit = files.find(path);
+  if (fit == files.end()) return {};
+  return getFile(fit->second, false);
 }
 
 BaseTexture* TextureCache::cacheExistingTexture(
@@ -137,7 +132,15 @@ BaseTexture* TextureCache::createCacheTexture(const char* path, Info info) {
   }
 }
 
-void TextureCache::deleteTexture(const char* path) { textures.erase(path); }
+void TextureCache::deleteTexture(const char* path) {
+  textures.erase(path);
+
+  auto it = files.find(path);
+  if (it == files.end()) return;
+  it->second.texture->rmReference();
+  if (it->second.content) it->second.content->rmReference();
+  files.erase(it);
+}
 
 static CVar r_rate("r_rate", "60.0", CVARF_SAVE | CVARF_GLOBAL);
 static CVar r_scale("r_scale", "1.0", CVARF_SAVE | CVARF_GLOBAL);
@@ -268,7 +271,8 @@ Engine::Engine(World* world, AbstractionWindow* hwnd) {
   device.reset(regs.createDevice(context.get()));
 
   device->engine = this;
-  textureCache.reset(new TextureCache(device.get()));
+  textureCache.reset(new TextureCache(
+      device.get(), world->getGame()->getResourceManager()));
   materialCache.reset(new MaterialCache(device.get()));
   meshCache.reset(new MeshCache(this));
   videoRenderer.reset(new VideoRenderer(this));
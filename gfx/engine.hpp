@@ -23,12 +23,26 @@
 
 namespace rdm {
 class World;
+class ResourceManager;
+namespace resource {
+class Texture;
+}  // namespace resource
 }  // namespace rdm
 
 namespace rdm::gfx {
+/**
+ * @brief Path based access to textures.
+ *
+ * Files go through the ResourceManager as resource::Texture, so they're
+ * decoded on the workers and share one GPU copy with everything else that
+ * loads the same file, or a file with the same contents. Textures the engine
+ * creates itself live here directly.
+ */
 class TextureCache {
+  // handed out while even the missing texture isn't uploaded yet
   std::unique_ptr<BaseTexture> invalidTexture;
   BaseDevice* device;
+  ResourceManager* resourceManager;
 
  public:
   struct Info {
@@ -41,17 +55,41 @@ class TextureCache {
     unsigned char* data;
   };
 
-  TextureCache(BaseDevice* device);
+  TextureCache(BaseDevice* device, ResourceManager* resourceManager);
+
+  /**
+   * @brief Gets a texture, starting a background load the first time.
+   *
+   * Until the load is done the missing texture is returned and info is
+   * empty, and the texture may change as finer levels stream in, so look it
+   * up again every frame instead of keeping the pointer. With keepData the
+   * load is waited for and data is set to the pixels of the top level (NULL
+   * for compressed files), which stay valid until deleteTexture.
+   *
+   * Returns nothing if there is no such file.
+   */
   std::optional<std::pair<Info, BaseTexture*>> getOrLoad2d(
       const char* path, bool keepData = false);
+  // like getOrLoad2d, but only for textures that are already cached
   std::optional<std::pair<Info, BaseTexture*>> get(const char* path);
   BaseTexture* cacheExistingTexture(const char* path,
                                     std::unique_ptr<BaseTexture>& texture,
                                     Info info);
   BaseTexture* createCacheTexture(const char* path, Info info);
+  // drops the cache's reference, so the ResourceManager may evict the file
   void deleteTexture(const char* path);
 
  private:
+  struct File {
+    resource::Texture* texture;
+    // the texture holding the pixels, pinned once keepData was asked for.
+    // differs from texture when another file had the same contents
+    resource::Texture* content;
+  };
+  std::pair<Info, BaseTexture*> getFile(File& file, bool keepData);
+
+  // each holds a reference, so they aren't evicted while cached
+  std::map<std::string, File> files;
   std::map<std::string, std::pair<Info, std::unique_ptr<BaseTexture>>> textures;
 };
 
@@ -1,13 +1,18 @@
 #include "gl_types.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <format>
 #include <glm/gtc/type_ptr.hpp>
 #include <stdexcept>
 #include <vector>
 
+#include "fun.hpp"
 #include "gfx/base_types.hpp"
 #include "glad/gl.h"
 #include "logging.hpp"
+#include "settings.hpp"
 
 namespace rdm::gfx::gl {
 GLenum fromDataType(DataType t) {
@@ -26,6 +31,10 @@ GLenum fromDataType(DataType t) {
       return GL_INT;
     case DtFloat:
       return GL_FLOAT;
+    case DtHalfFloat:
+      return GL_HALF_FLOAT;
+    case DtInt2101010Rev:
+      return GL_INT_2_10_10_10_REV;
     default:
       throw std::runtime_error("Invalid type");
   }
@@ -35,6 +44,7 @@ GLTexture::GLTexture() {
   glGenTextures(1, &texture);
   isRenderBuffer = false;
   multisampled = false;
+  mipLevels = 0;
 }
 
 GLTexture::~GLTexture() { glDeleteTextures(1, &texture); }
@@ -78,6 +88,16 @@ GLenum GLTexture::texInternalFormat(InternalFormat format) {
       return GL_RGBA32F;
     case D24S8:
       return GL_DEPTH24_STENCIL8;
+    case IF_RGB_S3TC_DXT1:
+      return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case IF_RGBA_S3TC_DXT1:
+      return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case IF_RGBA_S3TC_DXT3:
+      return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+    case IF_RGBA_S3TC_DXT5:
+      return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case IF_RGBA_BPTC:
+      return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
     default:
       throw std::runtime_error("Invalid type");
   }
@@ -87,6 +107,7 @@ void GLTexture::reserve2d(int width, int height, InternalFormat format,
                           int mipmapLevels, bool renderbuffer) {
   textureType = Texture2D;
   textureFormat = format;
+  mipLevels = 0;
 
   if (renderbuffer) {
     glGenRenderbuffers(1, &this->renderbuffer);
@@ -159,6 +180,7 @@ void GLTexture::upload2d(int width, int height, DataType type,
                          BaseTexture::Format format, void* data,
                          int mipmapLevels) {
   textureType = Texture2D;
+  mipLevels = 0;
 
   switch (format) {
     case RGB:
@@ -200,6 +222,80 @@ void GLTexture::upload2d(int width, int height, DataType type,
   glBindTexture(target, 0);
 }
 
+void GLTexture::upload2dMips(
+    int width, int height, BaseTexture::Format format,
+    std::vector<std::span<const unsigned char>> levels, int baseLevel) {
+  bool compressed = true;
+  switch (format) {
+    case RGB:
+      textureFormat = RGB8;
+      compressed = false;
+      break;
+    case RGBA:
+      textureFormat = RGBA8;
+      compressed = false;
+      break;
+    case RGB_S3TC_DXT1:
+      textureFormat = IF_RGB_S3TC_DXT1;
+      break;
+    case RGBA_S3TC_DXT1:
+      textureFormat = IF_RGBA_S3TC_DXT1;
+      break;
+    case RGBA_S3TC_DXT3:
+      textureFormat = IF_RGBA_S3TC_DXT3;
+      break;
+    case RGBA_S3TC_DXT5:
+      textureFormat = IF_RGBA_S3TC_DXT5;
+      break;
+    case RGBA_BPTC:
+      textureFormat = IF_RGBA_BPTC;
+      break;
+    default:
+      throw std::runtime_error("Invalid type");
+  }
+
+  // streaming finer levels into what's already there only sends the new
+  // ones. anything else starts over, so levels above baseLevel are freed
+  bool extend = mipLevels && textureType == Texture2D && mipFormat == format &&
+                mipWidth == width && mipHeight == height &&
+                mipLevels == levels.size() && baseLevel <= mipBase;
+  if (mipLevels && !extend) destroyAndCreate();
+  int lastLevel = extend ? mipBase : levels.size();
+
+  textureType = Texture2D;
+  mipFormat = format;
+  mipWidth = width;
+  mipHeight = height;
+  mipLevels = levels.size();
+  mipBase = baseLevel;
+
+  GLenum target = texType(textureType);
+  GLenum internalFormat = texInternalFormat(textureFormat);
+
+  glBindTexture(target, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+  glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+  for (int level = baseLevel; level < lastLevel; level++) {
+    int w = std::max(width >> level, 1);
+    int h = std::max(height >> level, 1);
+    if (compressed)
+      glCompressedTexImage2D(target, level, internalFormat, w, h, 0,
+                             levels[level].size(), levels[level].data());
+    else
+      glTexImage2D(target, level, internalFormat, w, h, 0, texFormat(format),
+                   GL_UNSIGNED_BYTE, levels[level].data());
+  }
+  glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, baseLevel);
+  glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, levels.size() > 1
+                                                     ? GL_LINEAR_MIPMAP_LINEAR
+                                                     : GL_LINEAR);
+  glBindTexture(target, 0);
+}
+
 void GLTexture::uploadCubeMap(int width, int height, std::vector<void*> data) {
   textureType = CubeMap;
   GLenum target = texType(textureType);
@@ -241,6 +337,7 @@ void GLTexture::setFiltering(Filtering min, Filtering max) {
 void GLTexture::destroyAndCreate() {
   glDeleteTextures(1, &texture);
   glGenTextures(1, &texture);
+  mipLevels = 0;
   if (isRenderBuffer) {
     glDeleteRenderbuffers(1, &renderbuffer);
     isRenderBuffer = false;
@@ -252,7 +349,149 @@ void GLTexture::bind() {
   glBindTexture(target, texture);
 }
 
-GLProgram::GLProgram() { program = glCreateProgram(); }
+static CVar r_glprogramcache("r_glprogramcache", "1",
+                              CVARF_SAVE | CVARF_GLOBAL);
+
+#define PROGRAM_BINARY_MAGIC "rdmProgB"
+#define PROGRAM_BINARY_VERSION 2
+
+// followed by the sources (see programBinaryKey), then the binary
+struct ProgramBinaryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t format;
+  // hash of the vendor, renderer and version strings, binaries only load on
+  // the driver that wrote them
+  uint64_t driver;
+  // the file name is only a hash of the sources, so they're kept in full and
+  // compared on load in case two programs collide
+  uint64_t sourceSize;
+  uint64_t size;
+};
+
+static uint64_t programBinaryDriver() {
+  static uint64_t driver = 0;
+  if (!driver)
+    driver = std::hash<std::string>{}(std::format(
+        "{}\n{}\n{}", (const char*)glGetString(GL_VENDOR),
+        (const char*)glGetString(GL_RENDERER),
+        (const char*)glGetString(GL_VERSION)));
+  return driver;
+}
+
+// everything a program is built from, the binary is only reused for the
+// exact same key
+static std::string programBinaryKey(
+    const std::map<BaseProgram::Shader, ShaderFile>& shaders) {
+  std::string key;
+  for (const auto& [type, shader] : shaders) {
+    key += std::format("{}:{}:", (int)type, (int)shader.type);
+    key += shader.code;
+    key += '\0';
+  }
+  return key;
+}
+
+// created the first time it's asked for, empty if it couldn't be
+static const std::string& programBinaryDirectory() {
+  static const std::string dir = [] {
+    std::string dir = Fun::getLocalDataDirectory() + "programs/";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    return ec ? std::string() : dir;
+  }();
+  return dir;
+}
+
+// where the binary for key lives, empty if binaries can't be cached
+static std::string programBinaryPath(const std::string& key) {
+  if (!r_glprogramcache.getBool() || !GLAD_GL_ARB_get_program_binary)
+    return "";
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  if (!formats) return "";
+
+  const std::string& dir = programBinaryDirectory();
+  if (dir.empty()) return "";
+  return std::format("{}{:016x}.bin", dir, std::hash<std::string>{}(key));
+}
+
+static bool loadProgramBinary(GLuint program, const std::string& path,
+                              const std::string& key) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+
+  ProgramBinaryHeader header;
+  std::vector<unsigned char> binary;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+            !memcmp(header.magic, PROGRAM_BINARY_MAGIC, 8) &&
+            header.version == PROGRAM_BINARY_VERSION &&
+            header.driver == programBinaryDriver() &&
+            header.sourceSize == key.size() && header.size &&
+            header.size < (64 << 20);
+  if (ok) {
+    std::string source(key.size(), '\0');
+    ok = fread(source.data(), 1, source.size(), file) == source.size() &&
+         source == key;
+  }
+  if (ok) {
+    binary.resize(header.size);
+    ok = fread(binary.data(), 1, binary.size(), file) == binary.size();
+  }
+  fclose(file);
+  if (!ok) {
+    Log::printf(LOG_DEBUG, "Program binary %s is stale", path.c_str());
+    return false;
+  }
+
+  // drivers can still refuse a binary, e.g. after an update that didn't
+  // change the version string
+  glProgramBinary(program, header.format, binary.data(), binary.size());
+  GLint success = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (success == GL_FALSE)
+    Log::printf(LOG_DEBUG, "Driver rejected program binary %s", path.c_str());
+  return success == GL_TRUE;
+}
+
+static void saveProgramBinary(GLuint program, const std::string& path,
+                              const std::string& key) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) return;
+
+  ProgramBinaryHeader header;
+  memcpy(header.magic, PROGRAM_BINARY_MAGIC, 8);
+  header.version = PROGRAM_BINARY_VERSION;
+  header.driver = programBinaryDriver();
+  header.sourceSize = key.size();
+  std::vector<unsigned char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+  header.format = format;
+  header.size = length;
+
+  // written to the side and renamed so a crash never leaves half a binary
+  std::string temp = path + ".tmp";
+  FILE* file = fopen(temp.c_str(), "wb");
+  if (!file) {
+    Log::printf(LOG_WARN, "Could not write program binary %s", path.c_str());
+    return;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(key.data(), 1, key.size(), file) == key.size() &&
+            fwrite(binary.data(), 1, header.size, file) == header.size;
+  ok = fclose(file) == 0 && ok;
+
+  std::error_code ec;
+  if (ok) std::filesystem::rename(temp, path, ec);
+  if (!ok || ec) std::filesystem::remove(temp, ec);
+}
+
+GLProgram::GLProgram() {
+  program = glCreateProgram();
+  linkState = Unlinked;
+}
 
 GLProgram::~GLProgram() { glDeleteProgram(program); }
 
@@ -269,16 +508,98 @@ GLenum GLProgram::shaderType(Shader type) {
   }
 }
 
+static CVar r_glasynccompile("r_glasynccompile", "1",
+                              CVARF_SAVE | CVARF_GLOBAL);
+
+// whether links can be left to finish on the driver's threads
+static bool parallelCompile() {
+  static bool threadsSet = false;
+  if (!r_glasynccompile.getBool()) return false;
+  if (GLAD_GL_KHR_parallel_shader_compile) {
+    if (!threadsSet) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+  } else if (GLAD_GL_ARB_parallel_shader_compile) {
+    if (!threadsSet) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+  } else {
+    return false;
+  }
+  threadsSet = true;
+  return true;
+}
+
+// bound instead of programs that are still compiling, draws nothing
+static GLuint placeholderProgram() {
+  static GLuint placeholder = 0;
+  if (placeholder) return placeholder;
+
+  const GLchar* vs =
+      "#version 330 core\n"
+      "void main() { gl_Position = vec4(0.0, 0.0, 2.0, 1.0); }\n";
+  const GLchar* fs =
+      "#version 330 core\n"
+      "void main() { discard; }\n";
+  GLuint vsShader = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(vsShader, 1, &vs, NULL);
+  glCompileShader(vsShader);
+  GLuint fsShader = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(fsShader, 1, &fs, NULL);
+  glCompileShader(fsShader);
+
+  placeholder = glCreateProgram();
+  glAttachShader(placeholder, vsShader);
+  glAttachShader(placeholder, fsShader);
+  glLinkProgram(placeholder);
+  glDeleteShader(vsShader);
+  glDeleteShader(fsShader);
+  return placeholder;
+}
+
+static void checkShader(GLuint _shader, const ShaderFile& shader) {
+  GLint success = 0;
+  glGetShaderiv(_shader, GL_COMPILE_STATUS, &success);
+  if (success == GL_FALSE) {
+    GLint logSize = 0;
+    glGetShaderiv(_shader, GL_INFO_LOG_LENGTH, &logSize);
+    char* infoLog = (char*)malloc(logSize);
+    glGetShaderInfoLog(_shader, logSize, NULL, infoLog);
+    Log::printf(LOG_ERROR, "Shader compile %s error\n%s", shader.name.c_str(),
+                infoLog);
+#ifndef NDEBUG
+    Log::printf(LOG_DEBUG, "Shader code:\n%s", shader.code.c_str());
+#endif
+    free(infoLog);
+
+    throw std::runtime_error("Shader compile error");
+  } else {
+    Log::printf(LOG_DEBUG, "Successfully compiled shader %s",
+                shader.name.c_str());
+  }
+}
+
 void GLProgram::link() {
-  std::vector<GLuint> _shaders;
   std::string programName;
+  for (auto& [type, shader] : shaders) programName += shader.name + " ";
+  glObjectLabel(GL_PROGRAM, program, programName.size(), programName.data());
+
+  // linked programs are kept on disk, so only new or changed sources, or a
+  // new driver, pay for compiling
+  std::string key = programBinaryKey(shaders);
+  binaryPath = programBinaryPath(key);
+  if (!binaryPath.empty() && loadProgramBinary(program, binaryPath, key)) {
+    Log::printf(LOG_DEBUG, "Loaded program binary for %s",
+                programName.c_str());
+    linkState = Linked;
+    return;
+  }
+
+  // with parallel compiles nothing is checked until the driver is done, see
+  // isReady
+  bool parallel = parallelCompile();
   for (auto [type, shader] : shaders) {
     Log::printf(LOG_DEBUG, "Compiling shader %s", shader.name.c_str());
 
     GLuint _shader = glCreateShader(shaderType(type));
     glObjectLabel(GL_SHADER, _shader, shader.name.size(), shader.name.data());
 
-    programName += shader.name + " ";
     GLchar* code = (GLchar*)shader.code.c_str();
     int codeLength[] = {(int)shader.code.size()};
     switch (shader.type) {
@@ -297,36 +618,35 @@ void GLProgram::link() {
         break;
     }
 
-    GLint success = 0;
-    glGetShaderiv(_shader, GL_COMPILE_STATUS, &success);
-    if (success == GL_FALSE) {
-      GLint logSize = 0;
-      glGetShaderiv(_shader, GL_INFO_LOG_LENGTH, &logSize);
-      char* infoLog = (char*)malloc(logSize);
-      glGetShaderInfoLog(_shader, logSize, NULL, infoLog);
-      Log::printf(LOG_ERROR, "Shader compile %s error\n%s", shader.name.c_str(),
-                  infoLog);
-#ifndef NDEBUG
-      Log::printf(LOG_DEBUG, "Shader code:\n%s", shader.code.c_str());
-#endif
-      free(infoLog);
-
-      throw std::runtime_error("Shader compile error");
-    } else {
-      Log::printf(LOG_DEBUG, "Successfully compiled shader %s",
-                  shader.name.c_str());
-    }
+    if (!parallel) checkShader(_shader, shader);
 
     glAttachShader(program, _shader);
-    _shaders.push_back(_shader);
+    linkShaders.push_back({_shader, type});
   }
 
-  glObjectLabel(GL_PROGRAM, program, programName.size(), programName.data());
+  if (!binaryPath.empty())
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   glLinkProgram(program);
+  linkState = Linking;
+
+  if (!parallel) finishLink();
+}
 
+void GLProgram::finishLink() {
   GLint success = 0;
   glGetProgramiv(program, GL_LINK_STATUS, &success);
+  std::vector<std::pair<GLuint, Shader>> _shaders;
+  _shaders.swap(linkShaders);
   if (success == GL_FALSE) {
+    linkState = Failed;
+    try {
+      // parallel compiles haven't reported which shader was broken yet
+      for (auto [_shader, type] : _shaders) checkShader(_shader, shaders[type]);
+    } catch (std::runtime_error& e) {
+      for (auto [_shader, type] : _shaders) glDeleteShader(_shader);
+      throw;
+    }
+
     GLint logSize = 0;
     glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logSize);
     char* infoLog = (char*)malloc(logSize);
@@ -339,12 +659,31 @@ void GLProgram::link() {
 #endif
     free(infoLog);
 
+    for (auto [_shader, type] : _shaders) glDeleteShader(_shader);
     throw std::runtime_error("Program link error");
   }
 
-  for (auto shader : _shaders) {
-    glDeleteShader(shader);
+  for (auto [_shader, type] : _shaders) {
+    glDeleteShader(_shader);
   }
+  linkState = Linked;
+
+  if (!binaryPath.empty())
+    saveProgramBinary(program, binaryPath, programBinaryKey(shaders));
+}
+
+bool GLProgram::isReady() {
+  if (linkState == Linking) {
+    GLint done = GL_FALSE;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+    if (done == GL_FALSE) return false;
+    try {
+      finishLink();
+    } catch (std::runtime_error& e) {
+      // already logged, the placeholder stays bound from now on
+    }
+  }
+  return linkState == Linked;
 }
 
 void GLProgram::bindParameters() {
@@ -443,6 +782,11 @@ void GLProgram::bindParameters() {
 }
 
 void GLProgram::bind() {
+  // parameters stay dirty until the real program can take them
+  if (!isReady()) {
+    glUseProgram(placeholderProgram());
+    return;
+  }
   glUseProgram(program);
   bindParameters();
 }
@@ -544,7 +888,7 @@ void GLArrayPointers::upload() {
     glEnableVertexAttribArray(attrib.layoutId);
 
     // HACKHACKHACK: HACK
-    if (attrib.type == DtInt || attrib.type == DtUnsignedInt)
+    if (attrib.integer || attrib.type == DtInt || attrib.type == DtUnsignedInt)
       glVertexAttribIPointer(attrib.layoutId, attrib.size,
                              fromDataType(attrib.type), attrib.stride,
                              attrib.offset);
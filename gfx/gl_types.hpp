@@ -12,6 +12,14 @@ class GLTexture : public BaseTexture {
   bool multisampled;
   bool isRenderBuffer;
 
+  // what upload2dMips last left on the GPU, mipLevels is 0 if the texture
+  // came from anything else
+  Format mipFormat;
+  int mipWidth;
+  int mipHeight;
+  int mipLevels;
+  int mipBase;
+
  public:
   GLTexture();
   virtual ~GLTexture();
@@ -34,6 +42,9 @@ class GLTexture : public BaseTexture {
                                      bool renderbuffer);
   virtual void upload2d(int width, int height, DataType type, Format format,
                         void* data, int mipmapLevels);
+  virtual void upload2dMips(int width, int height, Format format,
+                            std::vector<std::span<const unsigned char>> levels,
+                            int baseLevel);
   virtual void uploadCubeMap(int width, int height, std::vector<void*> data);
   virtual void destroyAndCreate();
   virtual void bind();
@@ -46,6 +57,15 @@ class GLTexture : public BaseTexture {
 class GLProgram : public BaseProgram {
   GLuint program;
 
+  enum LinkState { Unlinked, Linking, Linked, Failed };
+  LinkState linkState;
+  // shaders attached to a link that hasn't finished
+  std::vector<std::pair<GLuint, Shader>> linkShaders;
+  std::string binaryPath;
+
+  // checks the link, throws if it failed
+  void finishLink();
+
  public:
   GLProgram();
   virtual ~GLProgram();
@@ -58,6 +78,7 @@ class GLProgram : public BaseProgram {
 
   virtual void bind();
   virtual void link();
+  virtual bool isReady();
 };
 
 class GLBuffer : public BaseBuffer {
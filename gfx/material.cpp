@@ -101,6 +101,12 @@ void Material::addTechnique(std::shared_ptr<Technique> qu) {
   techniques.push_back(qu);
 }
 
+bool Material::isReady() {
+  for (auto& technique : techniques)
+    if (!technique->isReady()) return false;
+  return true;
+}
+
 BaseProgram* Material::prepareDevice(BaseDevice* device, int techniqueId) {
   if (techniques.size() <= techniqueId) return NULL;
   Engine* engine = device->getEngine();
@@ -77,6 +77,7 @@ class Technique {
 
   void bindProgram();
   BaseProgram* getProgram() { return program.get(); }
+  bool isReady() { return program->isReady(); }
 };
 
 /**
@@ -104,6 +105,8 @@ class Material {
   void addTechnique(std::shared_ptr<Technique> qu);
 
   int numTechniques() { return techniques.size(); }
+  // false while any technique is still compiling, see BaseProgram::isReady
+  bool isReady();
   BaseProgram* prepareDevice(BaseDevice* device, int techniqueId);
 };
 
@@ -129,6 +132,10 @@ class MaterialCache {
    * @brief Loads and caches a material, or just returns an already cached
    * material.
    *
+   * Returns without waiting for the driver to compile the shaders when it
+   * can compile in the background. The material draws nothing until then,
+   * see Material::isReady.
+   *
    * @param materialName The name of the material as defined in
    * dat1/materials.json
    * @return std::optional<std::shared_ptr<Material>> The loaded material
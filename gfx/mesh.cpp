@@ -3,6 +3,8 @@
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+#include <algorithm>
+
 #include "engine.hpp"
 #include "filesystem.hpp"
 #include "gfx/base_types.hpp"
@@ -30,10 +32,17 @@ Model::~Model() {
   }
 }
 
-void Mesh::render(BaseDevice* device) {
+void Mesh::render(BaseDevice* device, int lod) {
   arrayPointers->bind();
-  device->draw(element.get(), DtUnsignedInt, BaseDevice::Triangles,
-               indices.size());
+  if (lods.empty()) {
+    device->draw(element.get(), indexType, BaseDevice::Triangles, numIndices);
+    return;
+  }
+  const Lod& level = lods[std::clamp(lod, 0, (int)lods.size() - 1)];
+  size_t indexSize =
+      indexType == DtUnsignedShort ? sizeof(uint16_t) : sizeof(uint32_t);
+  device->draw(element.get(), indexType, BaseDevice::Triangles,
+               level.numIndices, (void*)(level.firstIndex * indexSize));
 }
 
 void Model::render(BaseDevice* device) {
@@ -69,10 +78,11 @@ Mesh Model::processMesh(aiMesh* mesh) {
   if (mesh->HasBones()) {
     m.skinned = true;
   }
+  std::vector<unsigned int> indices;
   for (int i = 0; i < mesh->mNumFaces; i++) {
     aiFace face = mesh->mFaces[i];
     for (int i = 0; i < face.mNumIndices; i++) {
-      m.indices.push_back(face.mIndices[i]);
+      indices.push_back(face.mIndices[i]);
     }
   }
   if (mesh->mMaterialIndex >= 0) {
@@ -81,7 +91,9 @@ Mesh Model::processMesh(aiMesh* mesh) {
   m.element = engine->getDevice()->createBuffer();
 
   m.element->upload(BaseBuffer::Element, BaseBuffer::StaticDraw,
-                    m.indices.size() * sizeof(unsigned int), m.indices.data());
+                    indices.size() * sizeof(unsigned int), indices.data());
+  m.numIndices = indices.size();
+  m.indexType = DtUnsignedInt;
 
   m.arrayPointers = engine->getDevice()->createArrayPointers();
   if (m.skinned) {
@@ -168,7 +180,7 @@ Mesh Model::processMesh(aiMesh* mesh) {
     Log::printf(
         LOG_DEBUG,
         "created skinned mesh with %i vertices, %i bones and %i elements",
-        vertices.size(), m.bones.size(), m.indices.size());
+        vertices.size(), m.bones.size(), m.numIndices);
   } else {
     std::vector<MeshVertex> vertices;
     for (int i = 0; i < mesh->mNumVertices; i++) {
@@ -197,7 +209,7 @@ Mesh Model::processMesh(aiMesh* mesh) {
 
     Log::printf(LOG_DEBUG,
                 "created unskinned mesh with %i vertices and %i elements",
-                vertices.size(), m.indices.size());
+                vertices.size(), m.numIndices);
   }
   m.arrayPointers->upload();
 
@@ -41,7 +41,17 @@ struct Mesh {
   bool skinned;
 
   std::map<std::string, BoneInfo> bones;
-  std::vector<unsigned int> indices;
+  // indices only live in element, nothing is kept on the CPU after upload
+  size_t numIndices;
+  DataType indexType;  // DtUnsignedShort or DtUnsignedInt
+
+  // index ranges into element for each level of detail, finest first. empty
+  // if the mesh only has the one level
+  struct Lod {
+    size_t firstIndex;
+    size_t numIndices;
+  };
+  std::vector<Lod> lods;
 
   std::unique_ptr<BaseBuffer> vertex;
   std::unique_ptr<BaseBuffer> element;
@@ -49,7 +59,8 @@ struct Mesh {
 
   std::string material;
 
-  void render(BaseDevice* device);
+  // lod is clamped to the levels there are
+  void render(BaseDevice* device, int lod = 0);
 };
 
 struct Model {
@@ -0,0 +1,250 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "block_compress.hpp"
+#include "ktx2.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// bakes an image into a KTX2 container with every mip precomputed, which
+// resource::Texture uploads without decoding anything. images are flipped
+// like resource::Texture flips the ones it decodes with stbi, so the rows
+// are stored bottom up (KTXorientation "ru")
+
+using namespace rdm::gfx;
+
+// data format descriptor constants from the Khronos data format spec
+#define KHR_DF_MODEL_RGBSDA 1
+#define KHR_DF_MODEL_BC1A 128
+#define KHR_DF_MODEL_BC3 130
+#define KHR_DF_MODEL_BC7 134
+#define KHR_DF_PRIMARIES_BT709 1
+#define KHR_DF_TRANSFER_LINEAR 1
+#define KHR_DF_CHANNEL_COLOR 0
+#define KHR_DF_CHANNEL_ALPHA 15
+
+struct Sample {
+  uint16_t bitOffset;
+  uint8_t bitLength;
+  uint8_t channel;
+  uint32_t upper;
+};
+
+static void put32(std::vector<unsigned char>& out, uint32_t v) {
+  for (int i = 0; i < 4; i++) out.push_back((v >> (i * 8)) & 0xff);
+}
+
+static std::vector<unsigned char> basicDfd(uint32_t vkFormat) {
+  uint8_t model;
+  uint8_t blockDimension;
+  uint8_t bytesPlane;
+  std::vector<Sample> samples;
+  switch (vkFormat) {
+    case ktx2::VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+      model = KHR_DF_MODEL_BC1A;
+      blockDimension = 3;
+      bytesPlane = 8;
+      samples = {{0, 63, KHR_DF_CHANNEL_COLOR, UINT32_MAX}};
+      break;
+    case ktx2::VK_FORMAT_BC3_UNORM_BLOCK:
+      model = KHR_DF_MODEL_BC3;
+      blockDimension = 3;
+      bytesPlane = 16;
+      samples = {{0, 63, KHR_DF_CHANNEL_ALPHA, UINT32_MAX},
+                 {64, 63, KHR_DF_CHANNEL_COLOR, UINT32_MAX}};
+      break;
+    case ktx2::VK_FORMAT_BC7_UNORM_BLOCK:
+      model = KHR_DF_MODEL_BC7;
+      blockDimension = 3;
+      bytesPlane = 16;
+      samples = {{0, 127, KHR_DF_CHANNEL_COLOR, UINT32_MAX}};
+      break;
+    default:
+      model = KHR_DF_MODEL_RGBSDA;
+      blockDimension = 0;
+      bytesPlane = 4;
+      samples = {{0, 7, 0, 255},
+                 {8, 7, 1, 255},
+                 {16, 7, 2, 255},
+                 {24, 7, KHR_DF_CHANNEL_ALPHA, 255}};
+      break;
+  }
+
+  uint32_t blockSize = 24 + 16 * samples.size();
+  std::vector<unsigned char> out;
+  put32(out, 4 + blockSize);  // dfdTotalSize
+  put32(out, 0);              // vendorId, descriptorType
+  put32(out, 2 | (blockSize << 16));  // versionNumber, descriptorBlockSize
+  out.push_back(model);
+  out.push_back(KHR_DF_PRIMARIES_BT709);
+  out.push_back(KHR_DF_TRANSFER_LINEAR);
+  out.push_back(0);  // flags, straight alpha
+  for (int i = 0; i < 4; i++) out.push_back(i < 2 ? blockDimension : 0);
+  for (int i = 0; i < 8; i++) out.push_back(i == 0 ? bytesPlane : 0);
+  for (const Sample& sample : samples) {
+    put32(out, sample.bitOffset | (sample.bitLength << 16) |
+                   (sample.channel << 24));
+    put32(out, 0);  // sample position
+    put32(out, 0);  // lower
+    put32(out, sample.upper);
+  }
+  return out;
+}
+
+static std::vector<unsigned char> keyValueData() {
+  std::string key = "KTXorientation";
+  std::string value = "ru";
+  std::vector<unsigned char> out;
+  put32(out, key.size() + value.size() + 2);
+  out.insert(out.end(), key.begin(), key.end());
+  out.push_back(0);
+  out.insert(out.end(), value.begin(), value.end());
+  out.push_back(0);
+  while (out.size() % 4) out.push_back(0);
+  return out;
+}
+
+// 2x2 box filter, odd edges reuse the last row/column
+static std::vector<unsigned char> downsample(
+    const std::vector<unsigned char>& src, int width, int height) {
+  int w = std::max(width >> 1, 1);
+  int h = std::max(height >> 1, 1);
+  std::vector<unsigned char> dst((size_t)w * h * 4);
+  for (int y = 0; y < h; y++) {
+    int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+    for (int x = 0; x < w; x++) {
+      int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+      for (int c = 0; c < 4; c++) {
+        int sum = src[((size_t)y0 * width + x0) * 4 + c] +
+                  src[((size_t)y0 * width + x1) * 4 + c] +
+                  src[((size_t)y1 * width + x0) * 4 + c] +
+                  src[((size_t)y1 * width + x1) * 4 + c];
+        dst[((size_t)y * w + x) * 4 + c] = (sum + 2) / 4;
+      }
+    }
+  }
+  return dst;
+}
+
+static size_t align(size_t v, size_t alignment) {
+  return (v + alignment - 1) / alignment * alignment;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3 && argc != 4) {
+    fprintf(stderr,
+            "texture_baker <input image> <output.ktx2> [bc1|bc3|bc7|rgba]\n");
+    fprintf(stderr,
+            "the format defaults to bc1, or bc3 if the image has any alpha\n");
+    return 1;
+  }
+
+  stbi_set_flip_vertically_on_load(true);
+  int width, height, channels;
+  stbi_uc* uc = stbi_load(argv[1], &width, &height, &channels, 4);
+  if (!uc) {
+    fprintf(stderr, "Could not load %s (%s)\n", argv[1],
+            stbi_failure_reason());
+    return 1;
+  }
+  std::vector<unsigned char> image(uc, uc + (size_t)width * height * 4);
+  stbi_image_free(uc);
+
+  bool hasAlpha = false;
+  for (size_t i = 3; i < image.size(); i += 4)
+    if (image[i] != 255) hasAlpha = true;
+
+  std::string format = argc == 4 ? argv[3] : (hasAlpha ? "bc3" : "bc1");
+  uint32_t vkFormat;
+  BlockCompressor compressor = NULL;
+  if (format == "bc1") {
+    vkFormat = ktx2::VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    compressor = compressBlockBC1;
+  } else if (format == "bc3") {
+    vkFormat = ktx2::VK_FORMAT_BC3_UNORM_BLOCK;
+    compressor = compressBlockBC3;
+  } else if (format == "bc7") {
+    vkFormat = ktx2::VK_FORMAT_BC7_UNORM_BLOCK;
+    compressor = compressBlockBC7;
+  } else if (format == "rgba") {
+    vkFormat = ktx2::VK_FORMAT_R8G8B8A8_UNORM;
+  } else {
+    fprintf(stderr, "Unknown format %s\n", format.c_str());
+    return 1;
+  }
+  size_t blockSize = ktx2::formatBlockSize(vkFormat);
+
+  std::vector<std::vector<unsigned char>> levels;
+  int w = width, h = height;
+  while (true) {
+    std::vector<unsigned char> level(ktx2::levelSize(vkFormat, w, h));
+    if (compressor)
+      compressImage(compressor, blockSize, image.data(), w, h, level.data());
+    else
+      memcpy(level.data(), image.data(), level.size());
+    levels.push_back(std::move(level));
+    if (w == 1 && h == 1) break;
+    image = downsample(image, w, h);
+    w = std::max(w >> 1, 1);
+    h = std::max(h >> 1, 1);
+  }
+
+  std::vector<unsigned char> dfd = basicDfd(vkFormat);
+  std::vector<unsigned char> kvd = keyValueData();
+
+  ktx2::Ktx2Header header = {};
+  memcpy(header.identifier, ktx2::KTX2_IDENTIFIER, sizeof(header.identifier));
+  header.vkFormat = vkFormat;
+  header.typeSize = 1;
+  header.pixelWidth = width;
+  header.pixelHeight = height;
+  header.faceCount = 1;
+  header.levelCount = levels.size();
+  header.supercompressionScheme = KTX2_SUPERCOMPRESSION_NONE;
+  header.dfdByteOffset =
+      sizeof(ktx2::Ktx2Header) + levels.size() * sizeof(ktx2::Ktx2Level);
+  header.dfdByteLength = dfd.size();
+  header.kvdByteOffset = header.dfdByteOffset + dfd.size();
+  header.kvdByteLength = kvd.size();
+
+  // the spec stores the smallest level first, each aligned to the block size
+  std::vector<ktx2::Ktx2Level> index(levels.size());
+  size_t offset = header.kvdByteOffset + kvd.size();
+  for (int i = levels.size() - 1; i >= 0; i--) {
+    offset = align(offset, std::max(blockSize, (size_t)4));
+    index[i].byteOffset = offset;
+    index[i].byteLength = levels[i].size();
+    index[i].uncompressedByteLength = levels[i].size();
+    offset += levels[i].size();
+  }
+
+  std::vector<unsigned char> out(offset, 0);
+  memcpy(out.data(), &header, sizeof(header));
+  memcpy(out.data() + sizeof(header), index.data(),
+         index.size() * sizeof(ktx2::Ktx2Level));
+  memcpy(out.data() + header.dfdByteOffset, dfd.data(), dfd.size());
+  memcpy(out.data() + header.kvdByteOffset, kvd.data(), kvd.size());
+  for (int i = 0; i < levels.size(); i++)
+    memcpy(out.data() + index[i].byteOffset, levels[i].data(),
+           levels[i].size());
+
+  FILE* output = fopen(argv[2], "wb");
+  if (!output) {
+    fprintf(stderr, "Could not open %s\n", argv[2]);
+    return 1;
+  }
+  fwrite(out.data(), 1, out.size(), output);
+  fclose(output);
+
+  size_t raw = (size_t)width * height * 4 * 4 / 3;
+  printf("%s: %ix%i %s, %zu levels, %zu bytes (%.1fx smaller than RGBA8)\n",
+         argv[2], width, height, format.c_str(), levels.size(), out.size(),
+         (double)raw / out.size());
+  return 0;
+}
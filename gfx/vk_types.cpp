@@ -19,6 +19,10 @@ void VKTexture::reserve2dMultisampled(int width, int height,
 void VKTexture::upload2d(int width, int height, DataType type, Format format,
                          void* data, int mipmapLevels) {}
 
+void VKTexture::upload2dMips(
+    int width, int height, Format format,
+    std::vector<std::span<const unsigned char>> levels, int baseLevel) {}
+
 void VKTexture::uploadCubeMap(int width, int height, std::vector<void*> data) {}
 
 void VKTexture::destroyAndCreate() {}
@@ -18,6 +18,9 @@ class VKTexture : public BaseTexture {
                                      bool renderbuffer);
   virtual void upload2d(int width, int height, DataType type, Format format,
                         void* data, int mipmapLevels);
+  virtual void upload2dMips(int width, int height, Format format,
+                            std::vector<std::span<const unsigned char>> levels,
+                            int baseLevel);
   virtual void uploadCubeMap(int width, int height, std::vector<void*> data);
   virtual void destroyAndCreate();
   virtual void bind();
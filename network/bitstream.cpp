@@ -15,11 +15,17 @@ BitStream::BitStream() {
   data = 0;
   c = 0;
   size = 0;
+  ctxt = Generic;
+  statistics = NULL;
+  statisticsDirection = NetworkStatistics::Outgoing;
 }
 BitStream::BitStream(BitStream& stream) {
   data = (char*)malloc(stream.size);
   c = 0;
   size = stream.size;
+  ctxt = stream.ctxt;
+  statistics = NULL;
+  statisticsDirection = NetworkStatistics::Outgoing;
   memcpy(data, stream.data, size);
 }
 BitStream::BitStream(void* data, size_t size) {
@@ -27,6 +33,8 @@ BitStream::BitStream(void* data, size_t size) {
   this->c = 0;
   this->size = size;
   this->ctxt = Generic;
+  this->statistics = NULL;
+  this->statisticsDirection = NetworkStatistics::Incoming;
   memcpy(this->data, data, size);
 }
 
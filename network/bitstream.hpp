@@ -10,6 +10,7 @@
 #include <vector>
 
 #include "security.hpp"
+#include "statistics.hpp"
 namespace rdm::network {
 class BitStreamException : public std::runtime_error {
   friend class BitStream;
@@ -95,7 +96,20 @@ class BitStream {
   Context getContext() { return ctxt; }
   void setContext(Context ctxt) { this->ctxt = ctxt; }
 
+  // when set, ReplicateProperty records the bytes it reads/writes here
+  NetworkStatistics* getStatistics() { return statistics; }
+  NetworkStatistics::Direction getStatisticsDirection() {
+    return statisticsDirection;
+  }
+  void setStatistics(NetworkStatistics* statistics,
+                     NetworkStatistics::Direction direction) {
+    this->statistics = statistics;
+    this->statisticsDirection = direction;
+  }
+
  private:
   Context ctxt;
+  NetworkStatistics* statistics;
+  NetworkStatistics::Direction statisticsDirection;
 };  // namespace rdm::network
 }  // namespace rdm::network
@@ -15,22 +15,30 @@ RDM_REFLECTION_END_DESCRIBED()
 
 template <>
 void ReplicateProperty<std::string>::serialize(BitStream& stream) {
+  size_t begin = stream.getSize();
   stream.writeString(value);
+  account(stream, begin);
 }
 
 template <>
 void ReplicateProperty<std::string>::deserialize(BitStream& stream) {
+  size_t begin = stream.getSize();
   setRemote(stream.readString());
+  account(stream, begin);
 }
 
 template <>
 void ReplicateProperty<int>::serialize(BitStream& stream) {
+  size_t begin = stream.getSize();
   stream.write(value);
+  account(stream, begin);
 }
 
 template <>
 void ReplicateProperty<int>::deserialize(BitStream& stream) {
+  size_t begin = stream.getSize();
   setRemote(stream.read<int>());
+  account(stream, begin);
 }
 
 Entity::Entity(NetworkManager* manager, EntityId id) {
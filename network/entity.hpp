@@ -33,9 +33,17 @@ template <typename T>
 class ReplicateProperty {
   friend class NetworkManager;
   const char* type = typeid(T).name();
+  const char* name = NULL;
   T value;
   bool dirty;
 
+  void account(BitStream& stream, size_t begin) {
+    if (NetworkStatistics* statistics = stream.getStatistics())
+      statistics->record(NetworkStatistics::PropertyCategory,
+                         stream.getStatisticsDirection(), name ? name : type,
+                         stream.getSize() - begin);
+  }
+
   void setRemote(T v) {
     changingRemotely.fire(value, v);
     changing.fire(value, v);
@@ -65,6 +73,10 @@ class ReplicateProperty {
   void deserialize(BitStream& stream);
 
   const char* getType() { return type; }
+
+  // used as the key for network statistics, defaults to the type name
+  void setName(const char* name) { this->name = name; }
+  const char* getName() { return name ? name : type; }
 };
 
 class NetworkManager;
@@ -30,10 +30,14 @@ static CVar net_service("net_service", "1", CVARF_SAVE | CVARF_GLOBAL);
 #ifdef NDEBUG
 static CVar rcon_password("rcon_password", "", CVARF_SAVE | CVARF_GLOBAL);
 static CVar net_graph("net_graph", "0", CVARF_SAVE | CVARF_GLOBAL);
+static CVar net_stats_enable("net_stats_enable", "0",
+                             CVARF_SAVE | CVARF_GLOBAL);
 #else
 static CVar rcon_password("rcon_password", "RCON_DEBUG",
                           CVARF_SAVE | CVARF_GLOBAL);
 static CVar net_graph("net_graph", "1", CVARF_SAVE | CVARF_GLOBAL);
+static CVar net_stats_enable("net_stats_enable", "1",
+                             CVARF_SAVE | CVARF_GLOBAL);
 #endif
 
 class NetworkGraphGui : public gfx::gui::NGui {
@@ -102,29 +106,11 @@ class NetworkGraphGui : public gfx::gui::NGui {
     }
 
     for (auto [id, count] : packetCounts) {
-      std::map<NetworkManager::PacketId, const char*> packetNames = {
-          {NetworkManager::DeltaIdPacket, "DeltaIdPacket"},
-          {NetworkManager::NewIdPacket, "NewIdPacket"},
-          {NetworkManager::DistributedTimePacket, "DistributedTimePacket"},
-          {NetworkManager::NewPeerPacket, "NewPeerPacket"},
-          {NetworkManager::DelIdPacket, "DelIdPacket"},
-          {NetworkManager::PeerInfoPacket, "PeerInfoPacket"},
-          {NetworkManager::CvarPacket, "CvarPacket"},
-          {NetworkManager::DelPeerPacket, "DelPeerPacket"},
-          {NetworkManager::AuthenticatePacket, "AuthenticatePacket"},
-          {NetworkManager::WelcomePacket, "WelcomePacket"},
-          {NetworkManager::EventPacket, "EventPacket"},
-          {NetworkManager::SignalPacket, "SignalPacket"},
-          {NetworkManager::RconPacket, "RconPacket"},
-      };
       renderer->setColor(
           glm::vec3((id % 2) / 2.f, (id % 4) / 4.f, (id % 6) / 6.f));
-      const char* packetName = "Unknown";
-      if (packetNames.find(id) != packetNames.end())
-        packetName = packetNames[id];
       yoff -= renderer
                   ->text(glm::ivec2(-xbase, yoff), font, 0, "%s: %ib/f",
-                         packetName, count)
+                         NetworkManager::getPacketName(id), count)
                   .second;
     }
   }
@@ -220,12 +206,14 @@ static ConsoleCommand entities(
 
 class NetworkJob : public SchedulerJob {
   NetworkManager* netmanager;
+  bool split;
 
  public:
-  NetworkJob(NetworkManager* netmanager)
-      : SchedulerJob("Network"), netmanager(netmanager) {}
+  NetworkJob(NetworkManager* netmanager, bool split)
+      : SchedulerJob("Network"), netmanager(netmanager), split(split) {}
 
   virtual double getFrameRate() { return 1.0 / net_rate.getFloat(); }
+  virtual Phase getPhase() { return NetworkReceivePhase; }
 
   virtual Result step() {
     if (netmanager->backend) {
@@ -233,15 +221,40 @@ class NetworkJob : public SchedulerJob {
     } else {
       netmanager->distributedTime += getStats().totalDeltaTime;
     }
-    netmanager->service();
+    if (split)
+      netmanager->serviceReceive();
+    else
+      netmanager->service();
+    return Stepped;
+  }
+};
+
+// only used in FrameGraphMode, sends the updates made during the tick
+class NetworkSendJob : public SchedulerJob {
+  NetworkManager* netmanager;
+
+ public:
+  NetworkSendJob(NetworkManager* netmanager)
+      : SchedulerJob("NetworkSend"), netmanager(netmanager) {}
+
+  virtual double getFrameRate() { return 1.0 / net_rate.getFloat(); }
+  virtual Phase getPhase() { return NetworkSendPhase; }
+
+  virtual Result step() {
+    netmanager->serviceSend();
     return Stepped;
   }
 };
 
 NetworkManager::NetworkManager(World* world) {
   host = NULL;
+  backend = false;
+  accounting = net_stats_enable.getBool();
   this->world = world;
-  world->getScheduler()->addJob(new NetworkJob(this));
+  bool split =
+      world->getScheduler()->getMode() == Scheduler::FrameGraphMode;
+  world->getScheduler()->addJob(new NetworkJob(this, split));
+  if (split) world->getScheduler()->addJob(new NetworkSendJob(this));
 
   localPeer.type = Peer::Unconnected;
   localPeer.peerId = -2;
@@ -287,8 +300,7 @@ void NetworkManager::requestDisconnect() {
   BitStream disconnectMessage;
   disconnectMessage.write<PacketId>(DisconnectPacket);
   disconnectMessage.write<int>(0);
-  enet_peer_send(localPeer.peer, 0,
-                 disconnectMessage.createPacket(ENET_PACKET_FLAG_RELIABLE));
+  sendPacket(&localPeer, disconnectMessage, NETWORK_STREAM_META);
 }
 
 NetworkManager::~NetworkManager() {
@@ -343,7 +355,28 @@ void NetworkManager::service() {
 
   std::scoped_lock l(crazyThingsMutex);
 
+  receivePackets();
+  if (!host) return;  // disconnected while receiving
+  sendPackets();
+}
+
+void NetworkManager::serviceReceive() {
+  if (!host) return;
+
+  std::scoped_lock l(crazyThingsMutex);
+  receivePackets();
+}
+
+void NetworkManager::serviceSend() {
+  if (!host) return;
+
+  std::scoped_lock l(crazyThingsMutex);
+  sendPackets();
+}
+
+void NetworkManager::receivePackets() {
   std::map<PacketId, int> packetFrameHistory;
+  accounting = net_stats_enable.getBool();
 
   ENetEvent event;
 
@@ -355,6 +388,11 @@ void NetworkManager::service() {
           Peer* remotePeer = (Peer*)event.peer->data;
           BitStream stream(event.packet->data, event.packet->dataLength);
           PacketId packetId = stream.read<PacketId>();
+          if (accounting) {
+            accountPacket(NetworkStatistics::Incoming, remotePeer, stream,
+                          event.packet->dataLength);
+            stream.setStatistics(&statistics, NetworkStatistics::Incoming);
+          }
           try {
             switch (packetId) {
               case WelcomePacket:
@@ -437,9 +475,8 @@ void NetworkManager::service() {
                     authenticationProvider->sendPeerInfo(&localPeer,
                                                          authenticateStream);
                   } else {
-                    enet_peer_send(localPeer.peer, NETWORK_STREAM_META,
-                                   authenticateStream.createPacket(
-                                       ENET_PACKET_FLAG_RELIABLE));
+                    sendPacket(&localPeer, authenticateStream,
+                               NETWORK_STREAM_META);
                   }
                 }
                 break;
@@ -488,9 +525,7 @@ void NetworkManager::service() {
                   newPeerPacket.write<int>(remotePeer->peerId);
                   newPeerPacket.write<EntityId>(
                       remotePeer->playerEntity->getEntityId());
-                  enet_host_broadcast(
-                      host, NETWORK_STREAM_META,
-                      newPeerPacket.createPacket(ENET_PACKET_FLAG_RELIABLE));
+                  broadcastPacket(newPeerPacket, NETWORK_STREAM_META);
 
                   for (auto& e : entities)
                     remotePeer->pendingNewIds.push_back(e.first);
@@ -578,6 +613,7 @@ void NetworkManager::service() {
                     }
                     stream.setContext(context);
 
+                    size_t begin = stream.getSize();
                     if (event.packet->flags & ENET_PACKET_FLAG_RELIABLE) {
                       ent->deserialize(stream);
                       if (backend) addPendingUpdate(id);
@@ -585,6 +621,8 @@ void NetworkManager::service() {
                       ent->deserializeUnreliable(stream);
                       if (backend) addPendingUpdateUnreliable(id);
                     }
+                    accountEntity(NetworkStatistics::Incoming, ent,
+                                  stream.getSize() - begin);
                   }
                 } catch (std::exception& e) {
                   if (!ent) {
@@ -779,9 +817,7 @@ void NetworkManager::service() {
                 if (!_peer.second.playerEntity ||
                     peer->peerId == _peer.second.peerId)
                   continue;
-                enet_peer_send(
-                    _peer.second.peer, NETWORK_STREAM_META,
-                    peerRemoving.createPacket(ENET_PACKET_FLAG_RELIABLE));
+                sendPacket(&_peer.second, peerRemoving, NETWORK_STREAM_META);
               }
             }
 
@@ -827,9 +863,8 @@ void NetworkManager::service() {
           welcomePacketStream.writeSignedMessage(
               getGame()->getSecurityManager()->sign((char*)test.data(), 4));
 
-          enet_peer_send(
-              event.peer, NETWORK_STREAM_META,
-              welcomePacketStream.createPacket(ENET_PACKET_FLAG_RELIABLE));
+          sendPacket(&peers[np.peerId], welcomePacketStream,
+                     NETWORK_STREAM_META);
         } else {
           localPeer.peer = event.peer;
           localPeer.type = Peer::ConnectedPlayer;
@@ -845,7 +880,9 @@ void NetworkManager::service() {
     if (packetHistory.size() >= 100) packetHistory.pop_front();
     packetHistory.push_back(packetFrameHistory);
   }
+}
 
+void NetworkManager::sendPackets() {
   for (auto& entity : entities) {
     try {
       entity.second->tick();
@@ -870,8 +907,7 @@ void NetworkManager::service() {
           pendingUpdates.push_back(id);
           // ent->serialize(newIdStream);
         }
-        enet_peer_send(peer.second.peer, NETWORK_STREAM_ENTITY,
-                       newIdStream.createPacket(ENET_PACKET_FLAG_RELIABLE));
+        sendPacket(&peer.second, newIdStream, NETWORK_STREAM_ENTITY);
         peer.second.pendingNewIds.clear();
       }
 
@@ -882,13 +918,14 @@ void NetworkManager::service() {
         for (auto id : peer.second.pendingDelIds) {
           delIdStream.write<EntityId>(id);
         }
-        enet_peer_send(peer.second.peer, NETWORK_STREAM_ENTITY,
-                       delIdStream.createPacket(ENET_PACKET_FLAG_RELIABLE));
+        sendPacket(&peer.second, delIdStream, NETWORK_STREAM_ENTITY);
         peer.second.pendingDelIds.clear();
       }
 
       if (int _pendingUpdates = pendingUpdates.size()) {
         BitStream deltaIdStream, deltaIdStreamUnreliable;
+        if (accounting)
+          deltaIdStream.setStatistics(&statistics, NetworkStatistics::Outgoing);
         deltaIdStream.write<PacketId>(DeltaIdPacket);
         deltaIdStreamUnreliable.write<PacketId>(DeltaIdPacket);
         deltaIdStream.write<int>(_pendingUpdates);
@@ -904,15 +941,14 @@ void NetworkManager::service() {
           deltaIdStream.setContext(ctxt);
           deltaIdStreamUnreliable.setContext(ctxt);
 
+          size_t begin = deltaIdStream.getSize();
           ent->serialize(deltaIdStream);
+          accountEntity(NetworkStatistics::Outgoing, ent,
+                        deltaIdStream.getSize() - begin);
           ent->serializeUnreliable(deltaIdStreamUnreliable);
         }
-        ENetPacket* packet =
-            deltaIdStream.createPacket(ENET_PACKET_FLAG_RELIABLE);
-        ENetPacket* packetUnreliable = deltaIdStream.createPacket(0);
-        enet_peer_send(peer.second.peer, NETWORK_STREAM_ENTITY, packet);
-        enet_peer_send(peer.second.peer, NETWORK_STREAM_ENTITY,
-                       packetUnreliable);
+        sendPacket(&peer.second, deltaIdStream, NETWORK_STREAM_ENTITY);
+        sendPacket(&peer.second, deltaIdStream, NETWORK_STREAM_ENTITY, 0);
         // need not be cleared because std::vector will clean itself up
       }
 
@@ -923,9 +959,7 @@ void NetworkManager::service() {
           eventPacket.write<CustomEventID>(peer.second.queuedEvents[i].first);
           eventPacket.writeStream(*peer.second.queuedEvents[i].second);
           delete peer.second.queuedEvents[i].second;
-          ENetPacket* packet =
-              eventPacket.createPacket(ENET_PACKET_FLAG_RELIABLE);
-          enet_peer_send(peer.second.peer, NETWORK_STREAM_EVENT, packet);
+          sendPacket(&peer.second, eventPacket, NETWORK_STREAM_EVENT);
         }
         peer.second.queuedEvents.clear();
       }
@@ -943,8 +977,7 @@ void NetworkManager::service() {
             cvarsPacket.writeString(cvar->getValue());
           }
 
-          enet_peer_send(peer.second.peer, NETWORK_STREAM_META,
-                         cvarsPacket.createPacket(ENET_PACKET_FLAG_RELIABLE));
+          sendPacket(&peer.second, cvarsPacket, NETWORK_STREAM_META);
         }
 
         for (auto& _peer : peers) {
@@ -954,14 +987,13 @@ void NetworkManager::service() {
           newPeerPacket.write<int>(_peer.first);
           newPeerPacket.write<EntityId>(
               _peer.second.playerEntity->getEntityId());
-          enet_peer_send(
-              peer.second.peer,
-              NETWORK_STREAM_ENTITY,  // even though this is technically a
-                                      // meta packet it needs to be in the
-                                      // entity stream so the other entities
-                                      // can be read by the remote peer in
-                                      // time
-              newPeerPacket.createPacket(ENET_PACKET_FLAG_RELIABLE));
+          sendPacket(&peer.second, newPeerPacket,
+                     NETWORK_STREAM_ENTITY);  // even though this is
+                                              // technically a meta packet it
+                                              // needs to be in the entity
+                                              // stream so the other entities
+                                              // can be read by the remote
+                                              // peer in time
         }
         peer.second.noob = false;
       }
@@ -989,6 +1021,8 @@ void NetworkManager::service() {
       for (auto& peer : peers) {
         if (peer.second.type != Peer::ConnectedPlayer) continue;
         BitStream deltaIdStream;
+        if (accounting)
+          deltaIdStream.setStatistics(&statistics, NetworkStatistics::Outgoing);
         deltaIdStream.write<PacketId>(DeltaIdPacket);
         deltaIdStream.write<int>(_pendingUpdates);
         for (auto id : pendingUpdates) {
@@ -997,11 +1031,12 @@ void NetworkManager::service() {
           BitStream::Context ctxt = BitStream::ToClient;
           if (ent->getOwnership(&peer.second)) ctxt = BitStream::ToClientLocal;
           deltaIdStream.setContext(ctxt);
+          size_t begin = deltaIdStream.getSize();
           ent->serialize(deltaIdStream);
+          accountEntity(NetworkStatistics::Outgoing, ent,
+                        deltaIdStream.getSize() - begin);
         }
-        ENetPacket* packet =
-            deltaIdStream.createPacket(ENET_PACKET_FLAG_RELIABLE);
-        enet_peer_send(peer.second.peer, NETWORK_STREAM_ENTITY, packet);
+        sendPacket(&peer.second, deltaIdStream, NETWORK_STREAM_ENTITY);
       }
       pendingUpdates.clear();
     }
@@ -1010,6 +1045,8 @@ void NetworkManager::service() {
       for (auto& peer : peers) {
         if (peer.second.type != Peer::ConnectedPlayer) continue;
         BitStream deltaIdStream;
+        if (accounting)
+          deltaIdStream.setStatistics(&statistics, NetworkStatistics::Outgoing);
         deltaIdStream.write<PacketId>(DeltaIdPacket);
         deltaIdStream.write<int>(_pendingUpdatesUnreliable);
         for (auto id : pendingUpdatesUnreliable) {
@@ -1018,10 +1055,12 @@ void NetworkManager::service() {
           BitStream::Context ctxt = BitStream::ToClient;
           if (ent->getOwnership(&peer.second)) ctxt = BitStream::ToClientLocal;
           deltaIdStream.setContext(ctxt);
+          size_t begin = deltaIdStream.getSize();
           ent->serializeUnreliable(deltaIdStream);
+          accountEntity(NetworkStatistics::Outgoing, ent,
+                        deltaIdStream.getSize() - begin);
         }
-        ENetPacket* packet = deltaIdStream.createPacket(0);
-        enet_peer_send(peer.second.peer, NETWORK_STREAM_ENTITY, packet);
+        sendPacket(&peer.second, deltaIdStream, NETWORK_STREAM_ENTITY, 0);
       }
       pendingUpdatesUnreliable.clear();
     }
@@ -1039,8 +1078,7 @@ void NetworkManager::service() {
         timeStream.write<int>(peer.second.peer->roundTripTime);
         timeStream.write<int>(peer.second.peer->packetLoss);
       }
-      enet_host_broadcast(host, NETWORK_STREAM_META,
-                          timeStream.createPacket(0));
+      broadcastPacket(timeStream, NETWORK_STREAM_META, 0);
     }
   } else {
     if (localPeer.playerEntity) {
@@ -1083,6 +1121,8 @@ void NetworkManager::service() {
 
     if (int _pendingUpdates = pendingUpdates.size()) {
       BitStream deltaIdStream;
+      if (accounting)
+        deltaIdStream.setStatistics(&statistics, NetworkStatistics::Outgoing);
       deltaIdStream.write<PacketId>(DeltaIdPacket);
       deltaIdStream.write<int>(_pendingUpdates);
       for (auto id : pendingUpdates) {
@@ -1091,16 +1131,19 @@ void NetworkManager::service() {
         BitStream::Context ctxt = BitStream::ToServer;
         if (ent->getOwnership(&localPeer)) ctxt = BitStream::ToServerLocal;
         deltaIdStream.setContext(ctxt);
+        size_t begin = deltaIdStream.getSize();
         ent->serialize(deltaIdStream);
+        accountEntity(NetworkStatistics::Outgoing, ent,
+                      deltaIdStream.getSize() - begin);
       }
-      ENetPacket* packet =
-          deltaIdStream.createPacket(ENET_PACKET_FLAG_RELIABLE);
-      enet_peer_send(localPeer.peer, 0, packet);
+      sendPacket(&localPeer, deltaIdStream, 0);
       pendingUpdates.clear();
     }
 
     if (int _pendingUpdatesUnreliable = pendingUpdatesUnreliable.size()) {
       BitStream deltaIdStream;
+      if (accounting)
+        deltaIdStream.setStatistics(&statistics, NetworkStatistics::Outgoing);
       deltaIdStream.write<PacketId>(DeltaIdPacket);
       deltaIdStream.write<int>(_pendingUpdatesUnreliable);
       for (auto id : pendingUpdatesUnreliable) {
@@ -1109,10 +1152,12 @@ void NetworkManager::service() {
         BitStream::Context ctxt = BitStream::ToServer;
         if (ent->getOwnership(&localPeer)) ctxt = BitStream::ToServerLocal;
         deltaIdStream.setContext(ctxt);
+        size_t begin = deltaIdStream.getSize();
         ent->serializeUnreliable(deltaIdStream);
+        accountEntity(NetworkStatistics::Outgoing, ent,
+                      deltaIdStream.getSize() - begin);
       }
-      ENetPacket* packet = deltaIdStream.createPacket(0);
-      enet_peer_send(localPeer.peer, 0, packet);
+      sendPacket(&localPeer, deltaIdStream, 0, 0);
       pendingUpdatesUnreliable.clear();
     }
 
@@ -1126,13 +1171,14 @@ void NetworkManager::service() {
             std::vector<char>(command.second.begin(), command.second.end()));
 
         rconStream.writeSignedMessage(msg);
-        enet_peer_send(localPeer.peer, 0,
-                       rconStream.createPacket(ENET_PACKET_FLAG_RELIABLE));
+        sendPacket(&localPeer, rconStream, 0);
       }
       pendingRconCommands.clear();
     }
   }
 
+  if (accounting) statistics.frame();
+
   ticks++;
 }
 
@@ -1305,9 +1351,86 @@ void NetworkManager::sendCustomEvent(int peerId, CustomEventID id,
 
 void NetworkManager::sendPacket(Peer* peer, BitStream& stream, int streamId,
                                 int flags) {
+  if (accounting)
+    accountPacket(NetworkStatistics::Outgoing, peer, stream, stream.getSize());
   enet_peer_send(peer->peer, streamId, stream.createPacket(flags));
 }
 
+void NetworkManager::broadcastPacket(BitStream& stream, int streamId,
+                                     int flags) {
+  if (accounting) {
+    for (auto& peer : peers) {
+      if (!peer.second.peer) continue;
+      accountPacket(NetworkStatistics::Outgoing, &peer.second, stream,
+                    stream.getSize());
+    }
+  }
+  enet_host_broadcast(host, streamId, stream.createPacket(flags));
+}
+
+const char* NetworkManager::getPacketName(PacketId id) {
+  switch (id) {
+    case DisconnectPacket:
+      return "DisconnectPacket";
+    case NewIdPacket:
+      return "NewIdPacket";
+    case DelIdPacket:
+      return "DelIdPacket";
+    case NewPeerPacket:
+      return "NewPeerPacket";
+    case DelPeerPacket:
+      return "DelPeerPacket";
+    case PeerInfoPacket:
+      return "PeerInfoPacket";
+    case DeltaIdPacket:
+      return "DeltaIdPacket";
+    case SignalPacket:
+      return "SignalPacket";
+    case DistributedTimePacket:
+      return "DistributedTimePacket";
+    case RconPacket:
+      return "RconPacket";
+    case CvarPacket:
+      return "CvarPacket";
+    case EventPacket:
+      return "EventPacket";
+    case WelcomePacket:
+      return "WelcomePacket";
+    case AuthenticatePacket:
+      return "AuthenticatePacket";
+    default:
+      return "Unknown";
+  }
+}
+
+std::string NetworkManager::getStatisticsPeerKey(Peer* peer) {
+  if (!backend) return "server";
+  if (!peer) return "unknown";
+  if (peer->playerEntity)
+    return std::format("{} ({})", peer->peerId,
+                       peer->playerEntity->displayName.get());
+  return std::to_string(peer->peerId);
+}
+
+void NetworkManager::accountPacket(NetworkStatistics::Direction direction,
+                                   Peer* peer, BitStream& stream,
+                                   size_t size) {
+  if (size < sizeof(PacketId)) return;
+  PacketId packetId;
+  memcpy(&packetId, stream.getData(), sizeof(PacketId));
+  statistics.record(NetworkStatistics::PacketCategory, direction,
+                    getPacketName(packetId), size);
+  statistics.record(NetworkStatistics::PeerCategory, direction,
+                    getStatisticsPeerKey(peer), size);
+}
+
+void NetworkManager::accountEntity(NetworkStatistics::Direction direction,
+                                   Entity* ent, size_t size) {
+  if (!accounting) return;
+  statistics.record(NetworkStatistics::EntityCategory, direction,
+                    ent->getTypeName(), size);
+}
+
 void NetworkManager::initialize() { enet_initialize(); }
 
 void NetworkManager::deinitialize() { enet_deinitialize(); }
@@ -16,6 +16,7 @@
 #include "network_defs.hpp"
 #include "player.hpp"
 #include "signal.hpp"
+#include "statistics.hpp"
 
 namespace rdm {
 class World;
@@ -111,6 +112,9 @@ class NetworkManager {
   };
 
   void service();
+  // service split in two, used when the scheduler runs a frame graph
+  void serviceReceive();
+  void serviceSend();
 
   void start(int port = 7938);
 
@@ -169,8 +173,26 @@ class NetworkManager {
   void sendPacket(Peer* peer, BitStream& stream,
                   int streamId = NETWORK_STREAM_META,
                   int flags = ENET_PACKET_FLAG_RELIABLE);
+  // server only, send to all connected peers
+  void broadcastPacket(BitStream& stream, int streamId = NETWORK_STREAM_META,
+                       int flags = ENET_PACKET_FLAG_RELIABLE);
+
+  static const char* getPacketName(PacketId id);
+  NetworkStatistics& getStatistics() { return statistics; }
 
  private:
+  bool accounting;
+  NetworkStatistics statistics;
+
+  void receivePackets();
+  void sendPackets();
+
+  std::string getStatisticsPeerKey(Peer* peer);
+  void accountPacket(NetworkStatistics::Direction direction, Peer* peer,
+                     BitStream& stream, size_t size);
+  void accountEntity(NetworkStatistics::Direction direction, Entity* ent,
+                     size_t size);
+
   std::mutex packetHistoryMutex;
   std::list<std::map<PacketId, int>> packetHistory;
   std::unordered_map<CustomEventID, CustomEventSignal> customSignals;
@@ -7,6 +7,8 @@
 #include "network.hpp"
 namespace rdm::network {
 Player::Player(NetworkManager* manager, EntityId id) : Entity(manager, id) {
+  remotePeerId.setName("Player.remotePeerId");
+  displayName.setName("Player.displayName");
   remotePeerId.set(-1);
 }
 
@@ -0,0 +1,267 @@
+#include "statistics.hpp"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+#include "console.hpp"
+#include "fun.hpp"
+#include "game.hpp"
+#include "json.hpp"
+#include "logging.hpp"
+#include "network.hpp"
+#include "world.hpp"
+
+using json = nlohmann::json;
+
+namespace rdm::network {
+NetworkStatistics::Histogram::Histogram() {
+  bytes.fill(0);
+  count.fill(0);
+  totalBytes = 0;
+  totalCount = 0;
+}
+
+size_t NetworkStatistics::Histogram::windowBytes() const {
+  size_t v = 0;
+  for (auto b : bytes) v += b;
+  return v;
+}
+
+size_t NetworkStatistics::Histogram::windowCount() const {
+  size_t v = 0;
+  for (auto c : count) v += c;
+  return v;
+}
+
+size_t NetworkStatistics::Histogram::peakBytes() const {
+  return *std::max_element(bytes.begin(), bytes.end());
+}
+
+NetworkStatistics::NetworkStatistics() {
+  head = 0;
+  frames = 0;
+}
+
+const char* NetworkStatistics::getCategoryName(Category category) {
+  switch (category) {
+    case PacketCategory:
+      return "packet";
+    case EntityCategory:
+      return "entity";
+    case PeerCategory:
+      return "peer";
+    case PropertyCategory:
+      return "property";
+    default:
+      return "unknown";
+  }
+}
+
+const char* NetworkStatistics::getDirectionName(Direction direction) {
+  switch (direction) {
+    case Incoming:
+      return "in";
+    case Outgoing:
+      return "out";
+    default:
+      return "unknown";
+  }
+}
+
+void NetworkStatistics::record(Category category, Direction direction,
+                               const std::string& key, size_t bytes) {
+  std::scoped_lock l(mutex);
+  Histogram& histogram = histograms[category][direction][key];
+  histogram.bytes[head] += bytes;
+  histogram.count[head]++;
+  histogram.totalBytes += bytes;
+  histogram.totalCount++;
+}
+
+void NetworkStatistics::frame() {
+  std::scoped_lock l(mutex);
+  head = (head + 1) % NETWORK_STATISTICS_FRAMES;
+  frames++;
+  for (int c = 0; c < __MaxCategory; c++) {
+    for (int d = 0; d < __MaxDirection; d++) {
+      for (auto& [key, histogram] : histograms[c][d]) {
+        histogram.bytes[head] = 0;
+        histogram.count[head] = 0;
+      }
+    }
+  }
+}
+
+void NetworkStatistics::reset() {
+  std::scoped_lock l(mutex);
+  for (int c = 0; c < __MaxCategory; c++)
+    for (int d = 0; d < __MaxDirection; d++) histograms[c][d].clear();
+  head = 0;
+  frames = 0;
+}
+
+NetworkStatistics::HistogramMap NetworkStatistics::getHistograms(
+    Category category, Direction direction) {
+  std::scoped_lock l(mutex);
+  return histograms[category][direction];
+}
+
+size_t NetworkStatistics::frameIndex(size_t n) const {
+  return (head + 1 + n) % NETWORK_STATISTICS_FRAMES;
+}
+
+std::string NetworkStatistics::toCsv() {
+  std::scoped_lock l(mutex);
+  std::string csv =
+      "category,direction,key,total_bytes,total_count,window_bytes,"
+      "window_count,peak_bytes";
+  for (int i = 0; i < NETWORK_STATISTICS_FRAMES; i++)
+    csv += std::format(",frame_{}", i);
+  csv += "\n";
+
+  for (int c = 0; c < __MaxCategory; c++) {
+    for (int d = 0; d < __MaxDirection; d++) {
+      for (auto& [key, histogram] : histograms[c][d]) {
+        csv += std::format("{},{},\"{}\",{},{},{},{},{}",
+                           getCategoryName((Category)c),
+                           getDirectionName((Direction)d), key,
+                           histogram.totalBytes, histogram.totalCount,
+                           histogram.windowBytes(), histogram.windowCount(),
+                           histogram.peakBytes());
+        for (size_t i = 0; i < NETWORK_STATISTICS_FRAMES; i++)
+          csv += std::format(",{}", histogram.bytes[frameIndex(i)]);
+        csv += "\n";
+      }
+    }
+  }
+  return csv;
+}
+
+std::string NetworkStatistics::toJson() {
+  std::scoped_lock l(mutex);
+  json j;
+  j["frames"] = frames;
+  j["window"] = NETWORK_STATISTICS_FRAMES;
+  for (int c = 0; c < __MaxCategory; c++) {
+    json category = json::object();
+    for (int d = 0; d < __MaxDirection; d++) {
+      json direction = json::object();
+      for (auto& [key, histogram] : histograms[c][d]) {
+        json entry;
+        entry["total_bytes"] = histogram.totalBytes;
+        entry["total_count"] = histogram.totalCount;
+        entry["window_bytes"] = histogram.windowBytes();
+        entry["window_count"] = histogram.windowCount();
+        entry["peak_bytes"] = histogram.peakBytes();
+        json frameBytes = json::array();
+        for (size_t i = 0; i < NETWORK_STATISTICS_FRAMES; i++)
+          frameBytes.push_back(histogram.bytes[frameIndex(i)]);
+        entry["frames"] = frameBytes;
+        direction[key] = entry;
+      }
+      category[getDirectionName((Direction)d)] = direction;
+    }
+    j[getCategoryName((Category)c)] = category;
+  }
+  return j.dump(2);
+}
+
+static NetworkManager* getStatisticsTarget(Game* game, std::string target) {
+  if (!game->getWorldConstructorSettings().network)
+    throw std::runtime_error("network disabled");
+
+  World* world;
+  if (target == "client")
+    world = game->getWorld();
+  else if (target == "server")
+    world = game->getServerWorld();
+  else
+    throw std::runtime_error("argument #1 must be client or server");
+
+  if (!world || !world->getNetworkManager())
+    throw std::runtime_error("target has no network manager");
+  return world->getNetworkManager();
+}
+
+static ConsoleCommand net_stats(
+    "net_stats", "net_stats [client/server] [packet/entity/peer/property]",
+    "prints bandwidth used over the last network frames, requires "
+    "net_stats_enable",
+    [](Game* game, ConsoleArgReader reader) {
+      NetworkManager* manager = getStatisticsTarget(game, reader.next());
+      std::string categoryName = reader.next();
+
+      for (int c = 0; c < NetworkStatistics::__MaxCategory; c++) {
+        NetworkStatistics::Category category = (NetworkStatistics::Category)c;
+        if (!categoryName.empty() &&
+            categoryName != NetworkStatistics::getCategoryName(category))
+          continue;
+
+        for (int d = 0; d < NetworkStatistics::__MaxDirection; d++) {
+          NetworkStatistics::Direction direction =
+              (NetworkStatistics::Direction)d;
+          NetworkStatistics::HistogramMap histograms =
+              manager->getStatistics().getHistograms(category, direction);
+          if (histograms.empty()) continue;
+
+          std::vector<std::pair<std::string, NetworkStatistics::Histogram*>>
+              sorted;
+          for (auto& [key, histogram] : histograms)
+            sorted.push_back({key, &histogram});
+          std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) {
+            return a.second->windowBytes() > b.second->windowBytes();
+          });
+
+          Log::printf(LOG_INFO, "%s (%s):",
+                      NetworkStatistics::getCategoryName(category),
+                      NetworkStatistics::getDirectionName(direction));
+          for (auto& [key, histogram] : sorted) {
+            Log::printf(LOG_INFO,
+                        "  %s - %zu b/window (%zu packets, peak %zu b/f), "
+                        "%zu b total",
+                        key.c_str(), histogram->windowBytes(),
+                        histogram->windowCount(), histogram->peakBytes(),
+                        histogram->totalBytes);
+          }
+        }
+      }
+    });
+
+static ConsoleCommand net_stats_dump(
+    "net_stats_dump", "net_stats_dump [client/server] [csv/json] [path]",
+    "writes bandwidth histograms to file, defaults to the local data directory",
+    [](Game* game, ConsoleArgReader reader) {
+      std::string target = reader.next();
+      NetworkManager* manager = getStatisticsTarget(game, target);
+      std::string format = reader.next();
+      std::string path = reader.next();
+
+      std::string data;
+      if (format == "csv")
+        data = manager->getStatistics().toCsv();
+      else if (format == "json")
+        data = manager->getStatistics().toJson();
+      else
+        throw std::runtime_error("argument #2 must be csv or json");
+
+      if (path.empty())
+        path = std::format("{}net_stats_{}.{}", Fun::getLocalDataDirectory(),
+                           target, format);
+
+      FILE* out = fopen(path.c_str(), "w");
+      if (!out) throw std::runtime_error("fopen == NULL");
+      fwrite(data.data(), 1, data.size(), out);
+      fclose(out);
+      Log::printf(LOG_INFO, "Wrote network statistics to %s", path.c_str());
+    });
+
+static ConsoleCommand net_stats_reset(
+    "net_stats_reset", "net_stats_reset [client/server]",
+    "clears bandwidth histograms", [](Game* game, ConsoleArgReader reader) {
+      getStatisticsTarget(game, reader.next())->getStatistics().reset();
+    });
+}  // namespace rdm::network
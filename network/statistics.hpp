@@ -0,0 +1,80 @@
+#pragma once
+#include <stddef.h>
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <string>
+
+#define NETWORK_STATISTICS_FRAMES 100
+
+namespace rdm::network {
+/**
+ * @brief Byte accounting for a NetworkManager.
+ *
+ * Every recorded sample is bucketed by category (packet type, entity type,
+ * peer, replicated property) and direction, and kept as a rolling histogram
+ * of the last NETWORK_STATISTICS_FRAMES network frames alongside lifetime
+ * totals.
+ */
+class NetworkStatistics {
+ public:
+  enum Category {
+    PacketCategory,
+    EntityCategory,
+    PeerCategory,
+    PropertyCategory,
+
+    __MaxCategory,
+  };
+
+  enum Direction {
+    Incoming,
+    Outgoing,
+
+    __MaxDirection,
+  };
+
+  struct Histogram {
+    std::array<size_t, NETWORK_STATISTICS_FRAMES> bytes;
+    std::array<size_t, NETWORK_STATISTICS_FRAMES> count;
+    size_t totalBytes;
+    size_t totalCount;
+
+    Histogram();
+
+    size_t windowBytes() const;
+    size_t windowCount() const;
+    size_t peakBytes() const;
+  };
+
+  typedef std::map<std::string, Histogram> HistogramMap;
+
+  NetworkStatistics();
+
+  static const char* getCategoryName(Category category);
+  static const char* getDirectionName(Direction direction);
+
+  void record(Category category, Direction direction, const std::string& key,
+              size_t bytes);
+
+  // advances the rolling window, called once per NetworkManager::service
+  void frame();
+  void reset();
+
+  // copy of the histograms for a category/direction pair
+  HistogramMap getHistograms(Category category, Direction direction);
+
+  std::string toCsv();
+  std::string toJson();
+
+ private:
+  std::mutex mutex;
+  size_t head;
+  size_t frames;
+  HistogramMap histograms[__MaxCategory][__MaxDirection];
+
+  // index of the n-th oldest frame in the window
+  size_t frameIndex(size_t n) const;
+};
+}  // namespace rdm::network
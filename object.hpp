@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <map>
 #include <set>
 #include <string>
@@ -77,7 +78,7 @@ class Constructable : public Object {
   RDM_OBJECT;
   RDM_OBJECT_DEF(Constructable, Object);
 
-  int references;
+  std::atomic<int> references;
 
  public:
   Constructable() { references = 0; }
@@ -19,6 +19,7 @@ class PhysicsJob : public SchedulerJob {
 
  public:
   virtual double getFrameRate() { return PHYSICS_FRAMERATE; }
+  virtual Phase getPhase() { return PhysicsPhase; }
 
   PhysicsJob(PhysicsWorld* _world) : SchedulerJob("Physics"), world(_world) {}
 
@@ -12,7 +12,9 @@
 #include <lua.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <stdexcept>
+#include <thread>
 
 #include "filesystem.hpp"
 #include "game.hpp"
@@ -60,8 +62,16 @@ RDM_REFLECTION_BEGIN_DESCRIBED(BaseGfxResource);
 }
 
 ResourceManager::ResourceManager() {
+  frame = 0;
+  loading = 0;
+  cpuBytes = 0;
+  gpuBytes = 0;
+
   missingTexture = load<resource::Texture>(RESOURCE_MISSING_TEXTURE);
   missingModel = load<resource::Model>(RESOURCE_MISSING_MODEL);
+  // fallbacks have to stay around
+  missingTexture->addReference();
+  missingModel->addReference();
 
   resource::Texture::TextureSettings ts;
   ts.minFiltering = gfx::BaseTexture::Nearest;
@@ -73,12 +83,22 @@ ResourceManager::ResourceManager() {
 void BaseResource::loadData() {
   if (broken) return;
 
-  common::OptionalData data =
-      common::FileSystem::singleton()->readFile(getName().c_str());
+  loadData(common::FileSystem::singleton()->readFile(getName().c_str()));
+}
+
+void BaseResource::loadData(common::OptionalData data) {
+  if (broken) return;
+
   if (data) {
-    onLoadData(data);
-    isDataReady = true;
-    Log::printf(LOG_DEBUG, "Loaded resource data %s", name.c_str());
+    try {
+      onLoadData(data);
+      isDataReady = true;
+      Log::printf(LOG_DEBUG, "Loaded resource data %s", name.c_str());
+    } catch (std::exception& e) {
+      Log::printf(LOG_ERROR, "Could not load resource %s (%s)", name.c_str(),
+                  e.what());
+      broken = true;
+    }
   } else {
     Log::printf(LOG_ERROR, "Could not load resource path %s", name.c_str());
     broken = true;
@@ -86,47 +106,285 @@ void BaseResource::loadData() {
   needsData = false;
 }
 
+void BaseResource::touch() {
+  lastUsed = resourceManager->getFrame();
+  if (evicted.exchange(false)) {
+    if (!isDataReady) {
+      needsData = true;
+      resourceManager->queueLoad(this);
+    } else {
+      resourceManager->queueUpload(this);
+    }
+  }
+}
+
+void BaseResource::reportPriority(float priority) {
+  uint64_t frame = resourceManager->getFrame();
+  if (priorityFrame.exchange(frame) != frame) {
+    this->priority = priority;
+    return;
+  }
+  float current = this->priority;
+  while (priority > current &&
+         !this->priority.compare_exchange_weak(current, priority)) {
+  }
+}
+
+void BaseResource::setCpuBytes(size_t bytes) {
+  // unsigned wraparound makes this work when shrinking too
+  resourceManager->cpuBytes += bytes - cpuBytes.exchange(bytes);
+}
+
+void BaseResource::setGpuBytes(size_t bytes) {
+  resourceManager->gpuBytes += bytes - gpuBytes.exchange(bytes);
+}
+
 static CVar rsc_load_quota("rsc_load_quota", "5", CVARF_SAVE | CVARF_GLOBAL);
+static CVar rsc_budget("rsc_budget", "0", CVARF_SAVE | CVARF_GLOBAL);
+static CVar rsc_evict_frames("rsc_evict_frames", "120",
+                             CVARF_SAVE | CVARF_GLOBAL);
 
-void ResourceManager::startTaskForResource(BaseResource* br) {
-  br->setNeedsData(false);
-  WorkerManager::singleton()->run([br] { br->loadData(); });
+void ResourceManager::queueLoad(BaseResource* br) {
+  std::scoped_lock l(loadMutex);
+  loadQueue.push_back(br);
+}
+
+void ResourceManager::queueUpload(BaseResource* br) {
+  if (resource::BaseGfxResource* rscg =
+          dynamic_cast<resource::BaseGfxResource*>(br)) {
+    std::scoped_lock l(uploadMutex);
+    uploadQueue.push_back(rscg);
+  }
+}
+
+void ResourceManager::startTaskForResource(
+    BaseResource* br, std::future<common::OptionalBuffer> read) {
+  loading++;
+  // the worker only waits for the read, it's already in flight
+  auto pending =
+      std::make_shared<std::future<common::OptionalBuffer>>(std::move(read));
+  WorkerManager::singleton()->run([this, br, pending] {
+    common::OptionalBuffer buffer = pending->get();
+    br->loadData(buffer ? common::OptionalData(buffer->take())
+                        : common::OptionalData());
+    loading--;
+    if (br->getDataReady()) queueUpload(br);
+  });
+}
+
+static bool higherPriority(BaseResource* a, BaseResource* b) {
+  return a->getPriority() > b->getPriority();
 }
 
 void ResourceManager::tick() {
-  int quota_amt = 0;
-  for (auto& [rscId, rsc] : resources) {
-    if (rsc->getNeedsData()) {
-      quota_amt++;
+  int quota = rsc_load_quota.getInt() - loading;
+  if (quota <= 0) return;
 
-      if (quota_amt > rsc_load_quota.getInt()) break;
-    }
+  std::vector<BaseResource*> starting;
+  {
+    std::scoped_lock l(loadMutex);
+    if (loadQueue.empty()) return;
+
+    // only the first quota entries have to be in order
+    size_t count = std::min(loadQueue.size(), (size_t)quota);
+    std::partial_sort(loadQueue.begin(), loadQueue.begin() + count,
+                      loadQueue.end(), higherPriority);
+    starting.assign(loadQueue.begin(), loadQueue.begin() + count);
+    loadQueue.erase(loadQueue.begin(), loadQueue.begin() + count);
+  }
+
+  std::erase_if(starting, [](BaseResource* br) { return !br->claimLoad(); });
+  if (starting.empty()) return;
+
+  // one batch, so real files go to io_uring in a single submission
+  std::vector<std::string> names;
+  for (BaseResource* br : starting) names.push_back(br->getName());
+  std::vector<std::future<common::OptionalBuffer>> reads =
+      common::FileSystem::singleton()->readFilesAsync(names);
+  for (size_t i = 0; i < starting.size(); i++)
+    startTaskForResource(starting[i], std::move(reads[i]));
+}
+
+void ResourceManager::finishLoading(BaseResource* br) {
+  br->touch();
+  if (br->claimLoad()) {
+    br->loadData();
+    if (br->getDataReady()) queueUpload(br);
+  } else {
+    while (!br->getDataReady() && !br->getBroken()) std::this_thread::yield();
   }
 }
 
 static CVar r_upload_quota("r_upload_quota", "100", CVARF_SAVE | CVARF_GLOBAL);
 
 void ResourceManager::tickGfx(gfx::Engine* engine) {
-  int quota_amt = 0;
-  for (auto& [rscId, rsc] : resources) {
-    if (resource::BaseGfxResource* rscg =
-            dynamic_cast<resource::BaseGfxResource*>(rsc.get())) {
-      if (!rscg->getReady() && rscg->getDataReady()) {
-        Log::printf(LOG_DEBUG, "Loaded gfx resource for %s",
-                    rscg->getName().c_str());
-        rscg->gfxUpload(engine);
-        quota_amt++;
-
-        if (quota_amt > r_upload_quota.getInt()) {
-          break;
-        }
-      }
+  frame++;
+
+  std::vector<resource::BaseGfxResource*> pending;
+  {
+    std::scoped_lock l(uploadMutex);
+    pending.swap(uploadQueue);
+  }
+
+  // drop anything that was evicted or uploaded since it was queued
+  std::erase_if(pending, [](resource::BaseGfxResource* rscg) {
+    return rscg->getReady() || !rscg->getDataReady() || rscg->getEvicted();
+  });
+
+  size_t count = std::min(pending.size(), (size_t)r_upload_quota.getInt());
+  std::partial_sort(pending.begin(), pending.begin() + count, pending.end(),
+                    higherPriority);
+  for (size_t i = 0; i < count; i++) {
+    Log::printf(LOG_DEBUG, "Loaded gfx resource for %s",
+                pending[i]->getName().c_str());
+    pending[i]->gfxUpload(engine);
+  }
+
+  // over quota, try again next frame
+  if (count < pending.size()) {
+    std::scoped_lock l(uploadMutex);
+    uploadQueue.insert(uploadQueue.end(), pending.begin() + count,
+                       pending.end());
+  }
+
+  streamTextures();
+  if (rsc_budget.getInt() > 0) enforceBudget();
+}
+
+static CVar rsc_texture_budget("rsc_texture_budget", "0",
+                               CVARF_SAVE | CVARF_GLOBAL);
+static CVar rsc_stream_rate("rsc_stream_rate", "4096",
+                            CVARF_SAVE | CVARF_GLOBAL);
+
+void ResourceManager::addStreamedTexture(resource::Texture* texture) {
+  std::scoped_lock l(streamMutex);
+  streamedTextures.push_back(texture);
+}
+
+resource::Texture* ResourceManager::findTextureContent(
+    uint64_t hash, resource::Texture* texture) {
+  std::scoped_lock l(contentMutex);
+  auto [it, inserted] = textureContents.try_emplace(hash, texture);
+  return it->second;
+}
+
+void ResourceManager::streamTextures() {
+  std::vector<resource::Texture*> textures;
+  {
+    std::scoped_lock l(streamMutex);
+    textures = streamedTextures;
+  }
+  // evicted textures start over from their mip tail in gfxUpload
+  std::erase_if(textures, [](resource::Texture* texture) {
+    return !texture->getReady();
+  });
+
+  size_t budget = (size_t)rsc_texture_budget.getInt() * 1024 * 1024;
+  uint64_t threshold = frame - std::min((uint64_t)rsc_evict_frames.getInt(),
+                                        (uint64_t)frame);
+  size_t used = 0;
+  for (resource::Texture* texture : textures) {
+    texture->latchRequestedLevel();
+    used += texture->getGpuBytes();
+  }
+
+  // over budget, drop levels that are finer than they're drawn at, or that
+  // belong to textures that haven't been drawn in a while, down to the tail
+  if (budget && used > budget) {
+    std::vector<resource::Texture*> candidates;
+    for (resource::Texture* texture : textures)
+      if (texture->getResidentLevel() < texture->getTailLevel() &&
+          (texture->getLastUsed() < threshold ||
+           texture->getResidentLevel() < texture->getWantedLevel()))
+        candidates.push_back(texture);
+    std::sort(candidates.begin(), candidates.end(),
+              [](resource::Texture* a, resource::Texture* b) {
+                if (a->getLastUsed() != b->getLastUsed())
+                  return a->getLastUsed() < b->getLastUsed();
+                return a->getPriority() < b->getPriority();
+              });
+    for (resource::Texture* texture : candidates) {
+      if (used <= budget) break;
+      int level = texture->getTailLevel();
+      if (texture->getLastUsed() >= threshold)
+        level = std::min(level, texture->getWantedLevel());
+      size_t before = texture->getGpuBytes();
+      texture->setResidentLevel(level);
+      used -= before - texture->getGpuBytes();
     }
   }
+
+  // stream in one level at a time for the textures being drawn, most
+  // important first
+  std::vector<resource::Texture*> wanting;
+  for (resource::Texture* texture : textures)
+    if (texture->getWantedLevel() < texture->getResidentLevel() &&
+        texture->getLastUsed() >= threshold)
+      wanting.push_back(texture);
+  std::sort(wanting.begin(), wanting.end(),
+            [](resource::Texture* a, resource::Texture* b) {
+              if (a->getPriority() != b->getPriority())
+                return a->getPriority() > b->getPriority();
+              return a->getLastUsed() > b->getLastUsed();
+            });
+  size_t quota = (size_t)rsc_stream_rate.getInt() * 1024;
+  size_t streamed = 0;
+  for (resource::Texture* texture : wanting) {
+    int level = texture->getResidentLevel() - 1;
+    size_t bytes = texture->getLevelBytes(level);
+    if (budget && used + bytes > budget) continue;
+    // at least one level goes up every frame, however big it is
+    if (streamed && streamed + bytes > quota) break;
+    texture->setResidentLevel(level);
+    used += bytes;
+    streamed += bytes;
+  }
+}
+
+void ResourceManager::evict(BaseResource* resource) {
+  if (resource->getEvicted() || resource->getBroken()) return;
+  resource->setEvicted(true);
+  resource->evict();
+  // a touch before the data was freed saw it still ready and only queued an
+  // upload, which tickGfx drops now, so it has to be read again
+  if (!resource->getEvicted() && !resource->getDataReady()) {
+    resource->setNeedsData(true);
+    queueLoad(resource);
+  }
+  Log::printf(LOG_DEBUG, "Evicted resource %s", resource->getName().c_str());
+}
+
+void ResourceManager::enforceBudget() {
+  size_t budget = (size_t)rsc_budget.getInt() * 1024 * 1024;
+  if (cpuBytes + gpuBytes <= budget) return;
+
+  uint64_t threshold = frame - std::min((uint64_t)rsc_evict_frames.getInt(),
+                                        (uint64_t)frame);
+
+  std::vector<BaseResource*> candidates;
+  forEachResource([&](ResourceId id, BaseResource* rsc) {
+    // anything referenced, or used too recently, has to stay
+    if (rsc->getCpuBytes() + rsc->getGpuBytes() && !rsc->getEvicted() &&
+        rsc->getReferences() == 0 && rsc->getLastUsed() < threshold)
+      candidates.push_back(rsc);
+  });
+
+  // least recently used first, lowest priority first within a frame
+  std::sort(candidates.begin(), candidates.end(),
+            [](BaseResource* a, BaseResource* b) {
+              if (a->getLastUsed() != b->getLastUsed())
+                return a->getLastUsed() < b->getLastUsed();
+              return a->getPriority() < b->getPriority();
+            });
+  for (BaseResource* rsc : candidates) {
+    if (cpuBytes + gpuBytes <= budget) break;
+    evict(rsc);
+  }
 }
 
 static BaseResource* selectedResource = NULL;
 static resource::Model::Animator* animator = NULL;
+static resource::Model::LodState previewLod;
 
 void ResourceManager::imgui(gfx::Engine* engine) {
   const glm::ivec2 imgSize(256, 256);
@@ -170,19 +428,24 @@ void ResourceManager::imgui(gfx::Engine* engine) {
       void* _ = engine->setViewport(previewViewport);
       engine->getDevice()->clear(0.f, 0.f, 0.f, 0.f);
       engine->getDevice()->clearDepth();
-      model->render(engine->getDevice(), animator);
+      model->render(engine->getDevice(), animator, NULL, {}, &previewLod);
       engine->finishViewport(_);
     }
   }
 
   ImGui::Begin("ResourceManager");
 
+  ImGui::Text("CPU: %zu KB, GPU: %zu KB, Budget: %i MB", getCpuBytes() / 1024,
+              getGpuBytes() / 1024, rsc_budget.getInt());
+  ImGui::Text("Loading: %i", (int)loading);
+  ImGui::Separator();
+
   int c = 0;
-  for (auto& [id, resource] : resources) {
+  forEachResource([&](ResourceId id, BaseResource* resource) {
     char p[64];
     snprintf(p, 64, "%016lx", id);
     if (ImGui::Button(p)) {
-      selectedResource = resource.get();
+      selectedResource = resource;
     }
     c++;
     if (c == 4) {
@@ -190,12 +453,19 @@ void ResourceManager::imgui(gfx::Engine* engine) {
       c = 0;
     } else
       ImGui::SameLine();
-  }
+  });
   ImGui::Separator();
   if (selectedResource) {
     ImGui::Text("Type %i, DR: %s", selectedResource->getType(),
                 selectedResource->getDataReady() ? "true" : "false");
     ImGui::Text("%s", selectedResource->getName().c_str());
+    ImGui::Text("Priority: %f, Refs: %i, Evicted: %s",
+                selectedResource->getPriority(),
+                selectedResource->getReferences(),
+                selectedResource->getEvicted() ? "true" : "false");
+    ImGui::Text("CPU: %zu KB, GPU: %zu KB",
+                selectedResource->getCpuBytes() / 1024,
+                selectedResource->getGpuBytes() / 1024);
     if (resource::BaseGfxResource* gfxr =
             dynamic_cast<resource::BaseGfxResource*>(selectedResource)) {
       ImGui::Text("R: %s", gfxr->getReady() ? "true" : "false");
@@ -217,12 +487,12 @@ void ResourceManager::imgui(gfx::Engine* engine) {
 }
 
 void ResourceManager::deleteGfxResources() {
-  for (auto& [rscId, rsc] : resources) {
+  forEachResource([](ResourceId id, BaseResource* rsc) {
     if (resource::BaseGfxResource* rscg =
-            dynamic_cast<resource::BaseGfxResource*>(rsc.get())) {
+            dynamic_cast<resource::BaseGfxResource*>(rsc)) {
       rscg->gfxDelete();
     }
-  }
+  });
 }
 
 resource::BaseGfxResource::BaseGfxResource(ResourceManager* manager,
@@ -230,4 +500,9 @@ resource::BaseGfxResource::BaseGfxResource(ResourceManager* manager,
     : BaseResource(manager, name) {
   isReady = false;
 }
+
+void resource::BaseGfxResource::evict() {
+  gfxDelete();
+  setReady(false);
+}
 };  // namespace rdm
@@ -1,11 +1,14 @@
 #pragma once
 #include <assimp/scene.h>
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <glm/ext/vector_float4.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <memory>
 #include <mutex>
+#include <span>
 #include <stdexcept>
 #include <unordered_map>
 
@@ -17,6 +20,9 @@
 #include "gfx/mesh.hpp"
 #include "gfx/rendercommand.hpp"
 #include "gfx/viewport.hpp"
+#include "ktx2.hpp"
+#include "mesh_optimize.hpp"
+#include "model_file.hpp"
 #include "object.hpp"
 namespace rdm {
 namespace gfx {
@@ -31,24 +37,48 @@ class Model;
 
 #define RESOURCE_MISSING_TEXTURE "engine/assets/missingtexture.png"
 #define RESOURCE_MISSING_MODEL "engine/assets/error.glb"
-
-class BaseResource : public reflection::Object {
+// textures upload every level this size and smaller straight away
+#define RESOURCE_MIP_TAIL 64
+
+/**
+ * @brief A streamed resource.
+ *
+ * Resources are never deleted while the ResourceManager is alive, so pointers
+ * returned by ResourceManager::load stay valid. When the manager is over its
+ * memory budget it evicts the least recently used resources that have no
+ * references, which frees their data until the next time they are touched.
+ */
+class BaseResource : public reflection::Constructable {
   RDM_OBJECT;
-  RDM_OBJECT_DEF(BaseResource, reflection::Object);
+  RDM_OBJECT_DEF(BaseResource, reflection::Constructable);
 
   std::string name;
-  bool isDataReady;
-  bool needsData;
-  bool broken;
+  std::atomic<bool> isDataReady;
+  std::atomic<bool> needsData;
+  std::atomic<bool> evicted;
+  std::atomic<bool> broken;
   ResourceManager* resourceManager;
 
+  std::atomic<float> priority;
+  // frame reportPriority last started over in
+  std::atomic<uint64_t> priorityFrame;
+  std::atomic<uint64_t> lastUsed;
+  std::atomic<size_t> cpuBytes;
+  std::atomic<size_t> gpuBytes;
+
  public:
   BaseResource(ResourceManager* manager, std::string name) {
     this->name = name;
     needsData = true;
     isDataReady = false;
+    evicted = false;
     resourceManager = manager;
     broken = false;
+    priority = 0.f;
+    priorityFrame = 0;
+    lastUsed = 0;
+    cpuBytes = 0;
+    gpuBytes = 0;
   }
   virtual ~BaseResource() = default;
 
@@ -63,71 +93,232 @@ class BaseResource : public reflection::Object {
   virtual void onLoadData(common::OptionalData data) = 0;
 
   bool getDataReady() { return isDataReady; }
-  void setDataReady() { isDataReady = true; }
+  void setDataReady(bool v = true) { isDataReady = v; }
   bool getNeedsData() { return needsData; }
   void setNeedsData(bool v = true) { needsData = v; }
+  // takes a pending load, false if there is none or someone else took it
+  bool claimLoad() { return needsData.exchange(false); }
+  bool getBroken() { return broken; }
+  bool getEvicted() { return evicted; }
 
+  // reads the file on the calling thread
   void loadData();
+  // for data that was already read, e.g. in a batch by ResourceManager::tick
+  void loadData(common::OptionalData data);
+
+  /**
+   * @brief Marks the resource as used this frame.
+   *
+   * Renderers should call this whenever they draw with the resource. An
+   * evicted resource is queued to load again.
+   */
+  void touch();
+  uint64_t getLastUsed() { return lastUsed; }
+
+  /**
+   * @brief Sets how much the resource matters right now.
+   *
+   * Higher priorities are loaded and uploaded first, and evicted last.
+   * Renderers should derive it from visibility and distance to the camera.
+   */
+  void setPriority(float priority) { this->priority = priority; }
+  /**
+   * @brief Reports the priority of one use of the resource this frame.
+   *
+   * The first report in a frame replaces the priority, later ones only raise
+   * it, so a resource drawn many times gets the priority of its most
+   * important use. Model::render reports the share of the viewport it covers.
+   */
+  void reportPriority(float priority);
+  float getPriority() { return priority; }
+
+  size_t getCpuBytes() { return cpuBytes; }
+  size_t getGpuBytes() { return gpuBytes; }
+
+  /**
+   * @brief Frees whatever the resource can load again later.
+   *
+   * Called by the ResourceManager on the render thread. Don't call this
+   * directly, use ResourceManager::evict.
+   */
+  virtual void evict() {}
 
   ResourceManager* getResourceManager() { return resourceManager; };
 
   virtual void imguiDebug() {};
 
   std::mutex m;
+
+ protected:
+  // these also update the manager's totals
+  void setCpuBytes(size_t bytes);
+  void setGpuBytes(size_t bytes);
+
+ private:
+  friend class ResourceManager;
+  void setEvicted(bool v) { evicted = v; }
 };
 
 typedef uint64_t ResourceId;
 
+// number of independently locked buckets in the resource registry
+#define RESOURCE_SHARDS 16
+
 class ResourceManager : public reflection::Object {
   RDM_OBJECT;
   RDM_OBJECT_DEF(ResourceManager, reflection::Object);
 
-  std::unordered_map<ResourceId, std::unique_ptr<BaseResource>> resources;
+  friend class BaseResource;
+
+  // the registry is split by id so loads from workers, the render thread and
+  // Lua rarely wait on each other
+  struct Shard {
+    std::mutex m;
+    std::unordered_map<ResourceId, std::unique_ptr<BaseResource>> resources;
+  };
+  Shard shards[RESOURCE_SHARDS];
+
+  Shard& getShard(ResourceId id) {
+    return shards[(id ^ (id >> 32)) % RESOURCE_SHARDS];
+  }
+
   resource::Texture* missingTexture;
   resource::Model* missingModel;
   gfx::Viewport* previewViewport;
 
-  void startTaskForResource(BaseResource* br);
+  // resources waiting for loadData, picked by priority in tick
+  std::mutex loadMutex;
+  std::vector<BaseResource*> loadQueue;
+  // resources with data waiting for gfxUpload, picked by priority in tickGfx
+  std::mutex uploadMutex;
+  std::vector<resource::BaseGfxResource*> uploadQueue;
+
+  // incremented every tickGfx, used as the clock for LRU eviction
+  std::atomic<uint64_t> frame;
+  // number of loads handed to the workers that haven't finished
+  std::atomic<int> loading;
+  std::atomic<size_t> cpuBytes;
+  std::atomic<size_t> gpuBytes;
+
+  // textures with levels past their mip tail, never removed
+  std::mutex streamMutex;
+  std::vector<resource::Texture*> streamedTextures;
+
+  // first texture loaded with each file content hash, never removed
+  std::mutex contentMutex;
+  std::unordered_map<uint64_t, resource::Texture*> textureContents;
+
+  void queueLoad(BaseResource* br);
+  void queueUpload(BaseResource* br);
+  void startTaskForResource(BaseResource* br,
+                            std::future<common::OptionalBuffer> read);
+  void enforceBudget();
+  void streamTextures();
 
  public:
+  // calls f on every resource, locking one shard at a time
+  template <typename F>
+  void forEachResource(F f) {
+    for (auto& shard : shards) {
+      std::scoped_lock l(shard.m);
+      for (auto& [id, rsc] : shard.resources) f(id, rsc.get());
+    }
+  }
+
   ResourceManager();
   resource::Texture* getMissingTexture() { return missingTexture; };
 
   BaseResource* getResource(ResourceId id) {
-    if (resources.find(id) != resources.end())
-      return resources[id].get();
+    Shard& shard = getShard(id);
+    std::scoped_lock l(shard.m);
+    auto it = shard.resources.find(id);
+    if (it != shard.resources.end())
+      return it->second.get();
     else
       return NULL;
   }
 
+  /**
+   * @brief Gets a resource, creating it if it doesn't exist yet.
+   *
+   * New resources are loaded in the background by tick, in priority order.
+   * Safe to call from any thread.
+   *
+   * @param priority The initial priority of a new resource, see
+   * BaseResource::setPriority.
+   */
   template <typename T>
-  T* load(const char* resourceName) {
+  T* load(const char* resourceName, float priority = 0.f) {
     ResourceId id = hash(resourceName);
-
-    if (BaseResource* rsc = getResource(id)) {
-      if (T* crsc = dynamic_cast<T*>(rsc)) {
-        return crsc;
-      } else {
-        throw std::runtime_error("ResourceManager::load, invalid type");
+    Shard& shard = getShard(id);
+    T* rsc;
+    {
+      std::scoped_lock l(shard.m);
+      auto it = shard.resources.find(id);
+      if (it != shard.resources.end()) {
+        if (T* crsc = dynamic_cast<T*>(it->second.get())) {
+          return crsc;
+        } else {
+          throw std::runtime_error("ResourceManager::load, invalid type");
+        }
       }
-    }
 
-    T* rsc = new T(this, resourceName);
-    resources[id].reset(rsc);
-    startTaskForResource(rsc);
+      rsc = new T(this, resourceName);
+      rsc->setPriority(priority);
+      rsc->touch();
+      shard.resources[id].reset(rsc);
+    }
+    queueLoad(rsc);
     return rsc;
   }
 
+  /**
+   * @brief Loads a resource's data on the calling thread.
+   *
+   * If a worker is already loading it, waits for the worker instead. The
+   * upload still happens in tickGfx.
+   */
+  void finishLoading(BaseResource* br);
+
   bool getResourceAvailable(const char* resourceName) {
     return (common::FileSystem::singleton()
                 ->getFileIO(resourceName, "r")
                 .has_value());
   }
 
+  /**
+   * @brief Starts loading the highest priority resources that need data.
+   *
+   * At most rsc_load_quota loads are in flight at once. The files of every
+   * load started in one tick are read as a single batch.
+   */
   void tick();
+  /**
+   * @brief Uploads loaded resources in priority order, streams texture mips,
+   * then evicts least recently used resources until the manager is inside
+   * rsc_budget.
+   */
   void tickGfx(gfx::Engine* engine);
   void imgui(gfx::Engine* engine);
 
+  /**
+   * @brief Frees a resource's data until it is touched again.
+   *
+   * Must be called on the render thread.
+   */
+  void evict(BaseResource* resource);
+
+  // has streamTextures bring in the rest of a texture's levels
+  void addStreamedTexture(resource::Texture* texture);
+  // the first texture registered with this content hash, registering
+  // texture if there is none
+  resource::Texture* findTextureContent(uint64_t hash,
+                                        resource::Texture* texture);
+
+  uint64_t getFrame() { return frame; }
+  size_t getCpuBytes() { return cpuBytes; }
+  size_t getGpuBytes() { return gpuBytes; }
+
   void deleteGfxResources();
 
   static constexpr ResourceId hash(const char* input) {
@@ -142,7 +333,7 @@ class BaseGfxResource : public BaseResource {
   RDM_OBJECT;
   RDM_OBJECT_DEF(BaseGfxResource, BaseResource);
 
-  bool isReady;
+  std::atomic<bool> isReady;
 
  public:
   BaseGfxResource(ResourceManager* manager, std::string name);
@@ -150,8 +341,11 @@ class BaseGfxResource : public BaseResource {
   virtual void gfxDelete() = 0;
   virtual void gfxUpload(gfx::Engine* engine) = 0;
 
+  // drops the gpu copy, it is uploaded again once touched
+  virtual void evict();
+
   bool getReady() { return isReady; }
-  void setReady() { isReady = true; }
+  void setReady(bool v = true) { isReady = v; }
 };
 
 class Texture : public BaseGfxResource {
@@ -167,31 +361,83 @@ class Texture : public BaseGfxResource {
 
   TextureHandler handler;
 
-  void* textureData;
+  // Ktx2 textures keep the whole file, levels are uploaded straight from it
+  std::vector<unsigned char> ktx2Data;
+  ktx2::Ktx2File ktx2;
+  // Stbi textures are box filtered down to a full mip chain here
+  std::vector<unsigned char> mipData;
+  // every level, finest first, pointing into ktx2Data or mipData
+  std::vector<std::span<const unsigned char>> levels;
+  gfx::BaseTexture::Format format;
 
   int width;
   int height;
   int channels;
 
+  // finest level on the GPU. the first upload only sends the mip tail, and
+  // ResourceManager streams the rest in towards wantedLevel
+  int residentLevel;
+  int wantedLevel;
+  // finest level asked for by reportScreenSize since the last streaming
+  // pass, INT_MAX if there were no reports
+  std::atomic<int> requestedLevel;
+  bool streamed;
+
+  // set when another texture was loaded from the same bytes first, this one
+  // then keeps nothing and draws with that texture instead
+  std::atomic<Texture*> alias;
+
   bool dirtyTextureSettings;
 
+  void generateMips(const unsigned char* image);
+  // uploads levels from level on, with m held
+  void uploadLevels(int level);
+
  public:
   Texture(ResourceManager* rm, std::string name);
-  virtual ~Texture();
 
   gfx::TextureCache::Info getInfo();
+  // the texture that actually holds the data, this one unless it's an alias
+  Texture* getContent() {
+    Texture* content = alias;
+    return content ? content : this;
+  }
+  // the top level, NULL for compressed textures or before the data loads
+  unsigned char* getPixels();
 
   virtual void gfxDelete();
   virtual void gfxUpload(gfx::Engine* engine);
+  virtual void evict();
 
-  int getWidth() { return width; };
-  int getHeight() { return height; };
+  int getWidth() { return getContent()->width; };
+  int getHeight() { return getContent()->height; };
 
   virtual void onLoadData(common::OptionalData data);
 
   virtual Type getType() { return BaseResource::Texture; }
   gfx::BaseTexture* getTexture();
 
+  /**
+   * @brief Tells streaming how big the texture is drawn this frame.
+   *
+   * pixels is the on screen size of whatever the texture covers. Textures
+   * nobody reports for stream in at full resolution.
+   */
+  void reportScreenSize(float pixels);
+
+  int getLevelCount() { return levels.size(); }
+  // the coarsest level with RESOURCE_MIP_TAIL pixels or less, uploaded first
+  int getTailLevel();
+  int getResidentLevel() { return residentLevel; }
+  int getWantedLevel() { return wantedLevel; }
+  size_t getLevelBytes(int level) { return levels[level].size(); }
+
+  // called by ResourceManager::streamTextures on the render thread
+  void latchRequestedLevel();
+  void setResidentLevel(int level);
+
+  virtual void imguiDebug();
+
   struct TextureSettings {
     gfx::BaseTexture::Filtering minFiltering;
     gfx::BaseTexture::Filtering maxFiltering;
@@ -213,9 +459,33 @@ class Model : public BaseGfxResource {
   RDM_OBJECT;
   RDM_OBJECT_DEF(Model, BaseGfxResource);
 
-  Assimp::Importer importer;
-
-  const aiScene* scene;
+  // set for models loaded from a .rmdl written by model_baker, which are
+  // uploaded straight out of bakedData instead of going through assimp.
+  // bakedData is freed once it's on the GPU
+  bool isBaked;
+  std::vector<unsigned char> bakedData;
+  model::ModelFile baked;
+
+  // the nodes, bones, materials and animations below are only built by the
+  // first load. animators point into animations, so a reload after eviction
+  // leaves them alone and only stages what gfxUpload needs again
+  bool hasRuntimeData;
+
+  // the node hierarchy, depth first so parents come before their children
+  struct Node {
+    std::string name;
+    glm::mat4 transform;
+    int parent;
+    // filled in by linkNodes, boneId is -1 if the node isn't a bone
+    int boneId;
+    glm::mat4 boneOffset;
+    // transform split up, for blending nodes only one animation moves
+    glm::vec3 bindTranslation;
+    glm::quat bindRotation;
+    glm::vec3 bindScale;
+    bool leaf;
+  };
+  std::vector<Node> nodes;
 
   struct Texture {
     bool external;
@@ -251,6 +521,25 @@ class Model : public BaseGfxResource {
   };
 
   std::map<std::string, gfx::Mesh> meshes;
+  // meshes onLoadData built from the scene, optimized and with their levels
+  // of detail, ready for gfxUpload, which frees them
+  struct StagedMesh {
+    std::string name;
+    std::string material;
+    bool skinned;
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned char> indices;
+    gfx::DataType indexType;
+    std::vector<model::MeshLod> lods;
+  };
+  std::vector<StagedMesh> stagedMeshes;
+  // embedded textures copied out of the scene, decoded to RGBA
+  struct StagedTexture {
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+  };
+  std::vector<StagedTexture> stagedTextures;
   std::map<std::string, gfx::BoneInfo> boneInfo;
   std::shared_ptr<gfx::Material> gfx_material;
   std::shared_ptr<gfx::Material> gfx_materialDf;
@@ -274,29 +563,26 @@ class Model : public BaseGfxResource {
   virtual void onLoadData(common::OptionalData data);
   virtual Type getType() { return BaseResource::Model; }
 
-  struct KeyTranslate {
-    glm::vec3 position;
-    double timestamp;
-  };
-
-  struct KeyRotate {
-    glm::quat quat;
-    double timestamp;
-  };
-
-  struct KeyScale {
-    glm::vec3 scale;
-    double timestamp;
-  };
-
-  struct BoneKeyframe {
-    std::vector<KeyTranslate> translations;
-    std::vector<KeyRotate> rotations;
-    std::vector<KeyScale> scales;
+  // keys for one animated node. times are kept apart from the values so
+  // finding a key only walks the times
+  struct Track {
+    int node;
+    std::vector<float> translationTimes;
+    std::vector<glm::vec3> translations;
+    std::vector<float> rotationTimes;
+    std::vector<glm::quat> rotations;
+    std::vector<float> scaleTimes;
+    std::vector<glm::vec3> scales;
+
+    size_t getBytes() const;
   };
 
   struct Animation {
-    std::unordered_map<std::string, BoneKeyframe> boneKeys;
+    std::vector<Track> tracks;
+    // index into tracks for every node, -1 if the node isn't animated
+    std::vector<int> nodeTracks;
+    // nodeTracks only lines up with this model's nodes
+    Model* model;
 
     double tps;
     double duration;
@@ -307,7 +593,30 @@ class Model : public BaseGfxResource {
     glm::vec3 max;
   };
 
+  /**
+   * @brief Level of detail state for one instance of a model.
+   *
+   * Set transform to where the instance is drawn and pass it to render,
+   * which picks the level from how much of the current viewport the bounding
+   * box covers. level is what was drawn last, and only changes once the size
+   * is clearly past a threshold so instances don't flicker between levels.
+   * The same size, in pixels, is reported to the model's textures for
+   * streaming, and the share is reported as the priority of the model and
+   * its textures. Without one, render uses a state shared by every such call
+   * that assumes the model is drawn untransformed.
+   */
+  struct LodState {
+    glm::mat4 transform;
+    int level;
+    // the share of the viewport's height the model covered last draw
+    float screenSize;
+
+    LodState() : transform(1.f), level(0), screenSize(1.f) {}
+  };
+
  private:  // UGLYUGLYUGLYUGLY
+  // used by render calls that don't pass their own, as if drawn untransformed
+  LodState defaultLod;
   Animation* preferedAnimation;
   BoundingBox boundingBox;
 
@@ -316,25 +625,100 @@ class Model : public BaseGfxResource {
     Animation* animation;
     double currentTime;
     double speed;
-    std::unique_ptr<gfx::BaseBuffer> boneUniformBuffer;
-    glm::mat4 boneMatrices[MODEL_MAX_BONE_TRANSFORMS];
 
-    Animator() { reset(); }
+    // updates write the back pose and then flip front, so the render thread
+    // only ever copies a finished pose out
+    glm::mat4 boneMatrices[2][MODEL_MAX_BONE_TRANSFORMS];
+    std::atomic<int> front;
+    std::atomic<bool> dirty;
+    int numBones;
+
+    // alternated between uploads so an update never has to wait on a draw
+    // that still reads the other one
+    std::unique_ptr<gfx::BaseBuffer> boneUniformBuffer[2];
+    int currentBuffer;
+
+    // the animation being faded out by crossFade, NULL when not blending
+    Animation* blendFrom;
+    double blendFromTime;
+    double blendTime;
+    double blendDuration;
+
+    // level of detail, see setLod. with an updateRate above 1 the pose is
+    // evaluated into keyPoses every updateRate updates, and the updates in
+    // between interpolate from the previous key pose to the latest one
+    int updateRate;
+    bool skipLeafBones;
+    int framesSinceUpdate;
+    int latestKeyPose;
+    glm::mat4 keyPoses[2][MODEL_MAX_BONE_TRANSFORMS];
+
+    Animator() {
+      currentBuffer = 0;
+      reset();
+    }
+
+    /**
+     * @brief Blends from the current animation into to over seconds.
+     */
+    void crossFade(Animation* to, double seconds) {
+      if (animation && seconds > 0.0) {
+        blendFrom = animation;
+        blendFromTime = currentTime;
+        blendTime = 0.0;
+        blendDuration = seconds;
+      } else {
+        blendFrom = NULL;
+      }
+      animation = to;
+      currentTime = 0.0;
+    }
+
+    /**
+     * @brief Trades accuracy for update cost.
+     *
+     * updateRate 1 evaluates every update, 2 or 4 evaluate every other or
+     * every fourth update and interpolate in between. skipLeafBones leaves
+     * bones without children (fingers, toes...) in their bind pose.
+     */
+    void setLod(int updateRate, bool skipLeafBones) {
+      updateRate = std::max(updateRate, 1);
+      if (updateRate != this->updateRate) framesSinceUpdate = -1;
+      this->updateRate = updateRate;
+      this->skipLeafBones = skipLeafBones;
+    }
+
+    // picks a level of detail from the distance to the camera, going by
+    // r_anim_lod_distance
+    void setLodForDistance(float distance);
 
     void initBuffer(gfx::BaseDevice* device) {
-      if (boneUniformBuffer) return;
-      boneUniformBuffer = device->createBuffer();
-      boneUniformBuffer->upload(gfx::BaseBuffer::Uniform,
-                                gfx::BaseBuffer::DynamicDraw,
-                                sizeof(boneMatrices), boneMatrices);
+      if (boneUniformBuffer[0]) return;
+      for (auto& buffer : boneUniformBuffer) {
+        buffer = device->createBuffer();
+        buffer->upload(gfx::BaseBuffer::Uniform, gfx::BaseBuffer::DynamicDraw,
+                       sizeof(boneMatrices[0]), boneMatrices[front]);
+      }
     }
 
     void reset() {
       animation = NULL;
       speed = 1.f;
       currentTime = 0.f;
-      for (int i = 0; i < MODEL_MAX_BONE_TRANSFORMS; i++)
-        boneMatrices[i] = glm::mat4(1.f);
+      for (auto& pose : boneMatrices)
+        for (int i = 0; i < MODEL_MAX_BONE_TRANSFORMS; i++)
+          pose[i] = glm::mat4(1.f);
+      front = 0;
+      numBones = MODEL_MAX_BONE_TRANSFORMS;
+      dirty = true;
+      blendFrom = NULL;
+      blendFromTime = 0.0;
+      blendTime = 0.0;
+      blendDuration = 0.0;
+      updateRate = 1;
+      skipLeafBones = false;
+      framesSinceUpdate = -1;
+      latestKeyPose = 0;
     }
 
     void upload(gfx::BaseProgram* program);
@@ -343,9 +727,16 @@ class Model : public BaseGfxResource {
   void render(
       gfx::BaseDevice* device, Animator* animator = NULL,
       gfx::Material* material = NULL,
-      std::optional<std::function<void(gfx::BaseProgram*)>> setParameters = {});
+      std::optional<std::function<void(gfx::BaseProgram*)>> setParameters = {},
+      LodState* lod = NULL);
 
   void updateAnimator(gfx::Engine* engine, Animator* anim);
+  /**
+   * @brief Updates a batch of animators of this model on the worker pool.
+   *
+   * Blocks until every animator has its new pose.
+   */
+  void updateAnimators(gfx::Engine* engine, std::span<Animator*> anims);
   glm::mat4 getBoneTransform(std::string name, Animator* anim);
   Animation* getAnimation(std::string name);
   Animation* getAnimation() { return preferedAnimation; }
@@ -353,21 +744,54 @@ class Model : public BaseGfxResource {
   virtual void imguiDebug();
   BoundingBox getBoundingBox() { return boundingBox; }
 
+  // frees everything that came from the file, touching the model reads it
+  // again. the runtime data animators use is kept
+  virtual void evict();
+
+  // bytes used by each part of the model, staging is only non zero between
+  // onLoadData and gfxUpload
+  struct MemoryUsage {
+    size_t nodes;
+    size_t materials;
+    size_t animations;
+    size_t staging;
+    size_t gpu;
+  };
+  MemoryUsage getMemoryUsage();
+
  private:
   std::map<std::string, Animation> animations;
 
-  void calcAnimatorTransforms(aiNode* node, Animator* anim,
-                              glm::mat4 transform);
-
-  int positionIdx(BoneKeyframe k, float t) const;
-  int rotationIdx(BoneKeyframe k, float t) const;
-  int scaleIdx(BoneKeyframe k, float t) const;
-
-  glm::mat4 interpPosition(BoneKeyframe k, float t) const;
-  glm::mat4 interpRotation(BoneKeyframe k, float t) const;
-  glm::mat4 interpScale(BoneKeyframe k, float t) const;
+  // drops animations of other models from anim, false if it has none left
+  bool checkAnimator(Animator* anim);
+  void advanceAnimator(gfx::Engine* engine, Animator* anim);
+  void calcAnimatorTransforms(Animator* anim, bool animate);
+  void evaluatePose(Animator* anim, bool animate, glm::mat4* pose);
+
+  // builds the nodes, materials, bones and animations out of the scene
+  void loadScene(const aiScene* scene, const std::string& dir);
+  void flattenNodes(aiNode* node, int parent);
+  // these build stagedMeshes and stagedTextures from the scene, and return
+  // their size in bytes
+  size_t stageMeshes(const aiScene* scene);
+  size_t stageTextures(const aiScene* scene);
+  // frees the staged data and bakedData once gfxUpload is done with them
+  void freeStaging();
+  // getMemoryUsage without taking m, and the part of it that stays loaded
+  MemoryUsage measureMemory();
+  size_t getRuntimeBytes();
+  void selectLod(gfx::Camera& camera, LodState* lod);
+  bool loadBaked(common::OptionalData& data);
+  // checks the ranges gfxUpload reads from baked
+  bool checkBakedUploads();
+  // these return the number of bytes uploaded
+  size_t uploadEmbeddedTexture(gfx::Engine* engine, Texture* texture);
+  size_t uploadMeshes(gfx::Engine* engine);
+  size_t uploadBakedMeshes(gfx::Engine* engine);
+
+  int findNode(const std::string& name);
+  void linkNodes();
 
-  glm::mat4 boneTransform(BoneKeyframe k, float t) const;
 };
 
 };  // namespace resource
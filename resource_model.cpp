@@ -9,6 +9,10 @@
 #include <filesystem>
 #include <stdexcept>
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 #include "object.hpp"
 #include "object_property.hpp"
 #include "script/script_api.hpp"
@@ -16,13 +20,19 @@
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include "console.hpp"
+#include "game.hpp"
 #include "gfx/base_types.hpp"
 #include "gfx/engine.hpp"
 #include "gfx/stb_image.h"
+#include "mesh_optimize.hpp"
 #include "resource.hpp"
 #include "settings.hpp"
+#include "worker.hpp"
 
 namespace rdm::resource {
 RDM_REFLECTION_BEGIN_DESCRIBED(Model);
@@ -40,12 +50,39 @@ Model::Model(ResourceManager* rm, std::string name)
     : BaseGfxResource(rm, name) {
   path = std::string(name).find_last_of('/');
   broken = true;
+  skinned = false;
+  isBaked = false;
+  hasRuntimeData = false;
+  preferedAnimation = NULL;
   boneCount = 0;
   boundingBox.max = glm::vec3(0.0);
   boundingBox.min = glm::vec3(0.0);
 }
 
-void Model::gfxDelete() {}
+void Model::gfxDelete() {
+  std::scoped_lock l(m);
+  meshes.clear();
+  for (auto& [name, material] : materials) {
+    material.pbrData.reset();
+    // embedded textures are uploaded again once they're staged again
+    if (material.hasAlbedo && !material.diffuse.external &&
+        material.diffuse.texture) {
+      material.diffuse.texture.reset();
+      deferedTextures.push_back(&material.diffuse);
+    }
+  }
+  setGpuBytes(0);
+}
+
+void Model::evict() {
+  BaseGfxResource::evict();
+
+  // staging is already gone after gfxUpload, but the model isn't ready to
+  // upload again until it's read from disk
+  std::scoped_lock l(m);
+  freeStaging();
+  setDataReady(false);
+}
 
 class AssimpIOStream : public Assimp::IOStream {
   common::FileIO* io;
@@ -104,159 +141,206 @@ class AssimpIOSystem : public Assimp::IOSystem {
   virtual void Close(Assimp::IOStream* file) {}
 };
 
-void Model::gfxUpload(gfx::Engine* engine) {
-  std::scoped_lock l(m);
+static void addMeshAttribs(gfx::Mesh& meshData) {
+  if (meshData.skinned) {
+    meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
+        gfx::DtFloat, 0, 3, sizeof(model::ModelVertexSkinned),
+        (void*)offsetof(model::ModelVertexSkinned, position),
+        meshData.vertex.get()));
+    meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
+        gfx::DtInt2101010Rev, 1, 4, sizeof(model::ModelVertexSkinned),
+        (void*)offsetof(model::ModelVertexSkinned, normal),
+        meshData.vertex.get(), true));
+    meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
+        gfx::DtHalfFloat, 2, 2, sizeof(model::ModelVertexSkinned),
+        (void*)offsetof(model::ModelVertexSkinned, uv),
+        meshData.vertex.get()));
+    meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
+        gfx::DtUnsignedByte, 3, 4, sizeof(model::ModelVertexSkinned),
+        (void*)offsetof(model::ModelVertexSkinned, boneIds),
+        meshData.vertex.get(), false, true));
+    meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
+        gfx::DtUnsignedByte, 4, 4, sizeof(model::ModelVertexSkinned),
+        (void*)offsetof(model::ModelVertexSkinned, boneWeights),
+        meshData.vertex.get(), true));
+  } else {
+    meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
+        gfx::DtFloat, 0, 3, sizeof(model::ModelVertex),
+        (void*)offsetof(model::ModelVertex, position), meshData.vertex.get()));
+    meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
+        gfx::DtInt2101010Rev, 1, 4, sizeof(model::ModelVertex),
+        (void*)offsetof(model::ModelVertex, normal), meshData.vertex.get(),
+        true));
+    meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
+        gfx::DtHalfFloat, 2, 2, sizeof(model::ModelVertex),
+        (void*)offsetof(model::ModelVertex, uv), meshData.vertex.get()));
+  }
+  meshData.arrayPointers->upload();
+}
 
-  if (broken) {
-    setReady();
-    return;
+// see model::optimizeMesh. the index buffer comes out 16 bit if every vertex
+// fits
+template <typename T>
+static void packMesh(std::vector<uint32_t>& indices, std::vector<T>& vertices,
+                     std::vector<unsigned char>& vertexBytes,
+                     std::vector<unsigned char>& indexBytes,
+                     gfx::DataType& indexType,
+                     std::vector<model::MeshLod>& lods) {
+  lods = {{0, indices.size()}};
+  if (!vertices.empty()) {
+    std::vector<uint32_t> remap;
+    size_t count =
+        model::optimizeMesh(indices, vertices.data(), vertices.size(),
+                            sizeof(T), MESH_MAX_LODS, lods, remap);
+    vertices = model::remapVertices(vertices, remap, count);
+  }
+  vertexBytes.assign((const unsigned char*)vertices.data(),
+                     (const unsigned char*)(vertices.data() + vertices.size()));
+
+  if (vertices.size() <= UINT16_MAX) {
+    indexType = gfx::DtUnsignedShort;
+    indexBytes.resize(indices.size() * sizeof(uint16_t));
+    uint16_t* out16 = (uint16_t*)indexBytes.data();
+    for (size_t i = 0; i < indices.size(); i++) out16[i] = indices[i];
+  } else {
+    indexType = gfx::DtUnsignedInt;
+    indexBytes.resize(indices.size() * sizeof(uint32_t));
+    memcpy(indexBytes.data(), indices.data(), indexBytes.size());
   }
+}
 
-  for (int i = 0; i < deferedTextures.size(); i++) {
-    Texture* texture = deferedTextures[i];
-    aiTexture* textureData = scene->mTextures[texture->textureId];
-    texture->texture = engine->getDevice()->createTexture();
+size_t Model::uploadEmbeddedTexture(gfx::Engine* engine, Texture* texture) {
+  texture->texture = engine->getDevice()->createTexture();
+  if (!isBaked) {
+    // already decoded by stageTextures
+    const StagedTexture& staged = stagedTextures[texture->textureId];
+    texture->texture->upload2d(staged.width, staged.height,
+                               gfx::DtUnsignedByte, gfx::BaseTexture::RGBA,
+                               (void*)staged.pixels.data());
+    return staged.pixels.size();
+  }
 
-    if (textureData->mHeight == 0) {
-      int width, height, channels;
-      stbi_uc* uc = stbi_load_from_memory((stbi_uc*)textureData->pcData,
-                                          textureData->mWidth, &width, &height,
-                                          &channels, 4);
-      texture->texture->upload2d(width, height, gfx::DtUnsignedByte,
-                                 gfx::BaseTexture::RGBA, uc);
-      stbi_image_free(uc);
-    } else {
-      texture->texture->upload2d(textureData->mWidth, textureData->mHeight,
-                                 gfx::DtUnsignedByte, gfx::BaseTexture::RGBA,
-                                 (void*)textureData->pcData);
+  const model::ModelTexture& info = baked.get<model::ModelTexture>(
+      baked.getHeader()->textures)[texture->textureId];
+  const unsigned char* pixels =
+      baked.getBytes(baked.getHeader()->textureData) + info.dataOffset;
+  if (info.height == 0) {
+    int w, h, channels;
+    stbi_uc* uc =
+        stbi_load_from_memory(pixels, info.width, &w, &h, &channels, 4);
+    if (!uc) {
+      // same as stageTextures does for the assimp path
+      Log::printf(LOG_WARN,
+                  "Could not decode embedded texture %i in %s, "
+                  "stbi_failure_reason = %s",
+                  texture->textureId, getName().c_str(),
+                  stbi_failure_reason());
+      unsigned char white[4] = {255, 255, 255, 255};
+      texture->texture->upload2d(1, 1, gfx::DtUnsignedByte,
+                                 gfx::BaseTexture::RGBA, white);
+      return sizeof(white);
     }
+    texture->texture->upload2d(w, h, gfx::DtUnsignedByte,
+                               gfx::BaseTexture::RGBA, uc);
+    stbi_image_free(uc);
+    return (size_t)w * h * 4;
+  } else {
+    texture->texture->upload2d(info.width, info.height, gfx::DtUnsignedByte,
+                               gfx::BaseTexture::RGBA, (void*)pixels);
+    return (size_t)info.width * info.height * 4;
   }
+}
 
-  Log::printf(LOG_DEBUG, "Loaded %i textures", deferedTextures.size());
-  deferedTextures.clear();
-
-  for (int mesh_id = 0; mesh_id < scene->mNumMeshes; mesh_id++) {
-    aiMesh* mesh = scene->mMeshes[mesh_id];
+size_t Model::uploadBakedMeshes(gfx::Engine* engine) {
+  const model::ModelHeader* hdr = baked.getHeader();
+  std::span<const model::ModelMaterial> bakedMaterials =
+      baked.get<model::ModelMaterial>(hdr->materials);
+  const unsigned char* indices = baked.getBytes(hdr->indices);
+  const unsigned char* vertices = baked.getBytes(hdr->vertices);
+  std::span<const model::ModelLod> lods = baked.get<model::ModelLod>(hdr->lods);
+
+  // ranges were checked by loadBaked, everything goes up as is
+  size_t gpuBytes = 0;
+  for (const model::ModelMesh& mesh :
+       baked.get<model::ModelMesh>(hdr->meshes)) {
     gfx::Mesh meshData;
-    meshData.skinned = mesh->HasBones();
+    meshData.skinned = mesh.skinned;
     meshData.element = engine->getDevice()->createBuffer();
     meshData.vertex = engine->getDevice()->createBuffer();
     meshData.arrayPointers = engine->getDevice()->createArrayPointers();
-    meshData.material =
-        scene->mMaterials[mesh->mMaterialIndex]->GetName().C_Str();
+    meshData.material = baked.getString(bakedMaterials[mesh.material].name);
+    meshData.numIndices = mesh.numIndices;
+    meshData.indexType =
+        mesh.indexSize == 2 ? gfx::DtUnsignedShort : gfx::DtUnsignedInt;
+    for (const model::ModelLod& lod :
+         lods.subspan(mesh.firstLod, mesh.numLods))
+      meshData.lods.push_back(
+          gfx::Mesh::Lod{(size_t)lod.firstIndex, (size_t)lod.numIndices});
+    meshData.numIndices = meshData.lods[0].numIndices;
+
+    size_t vertexSize = mesh.skinned ? sizeof(model::ModelVertexSkinned)
+                                     : sizeof(model::ModelVertex);
+    meshData.element->upload(
+        gfx::BaseBuffer::Element, gfx::BaseBuffer::StaticDraw,
+        mesh.numIndices * mesh.indexSize, indices + mesh.indexOffset);
+    meshData.vertex->upload(gfx::BaseBuffer::Array,
+                            gfx::BaseBuffer::StaticDraw,
+                            mesh.numVertices * vertexSize,
+                            vertices + mesh.vertexOffset);
+    gpuBytes += mesh.numIndices * mesh.indexSize;
+    gpuBytes += mesh.numVertices * vertexSize;
+
+    addMeshAttribs(meshData);
+    meshes[baked.getString(mesh.name)] = std::move(meshData);
+  }
+  return gpuBytes;
+}
 
-    for (int i = 0; i < mesh->mNumFaces; i++) {
-      aiFace face = mesh->mFaces[i];
-      for (int j = 0; j < face.mNumIndices; j++) {
-        meshData.indices.push_back(face.mIndices[j]);
-      }
-    }
+size_t Model::uploadMeshes(gfx::Engine* engine) {
+  size_t gpuBytes = 0;
+  for (const StagedMesh& staged : stagedMeshes) {
+    gfx::Mesh meshData;
+    meshData.skinned = staged.skinned;
+    meshData.element = engine->getDevice()->createBuffer();
+    meshData.vertex = engine->getDevice()->createBuffer();
+    meshData.arrayPointers = engine->getDevice()->createArrayPointers();
+    meshData.material = staged.material;
+    meshData.indexType = staged.indexType;
+    for (const model::MeshLod& lod : staged.lods)
+      meshData.lods.push_back(gfx::Mesh::Lod{lod.firstIndex, lod.numIndices});
+    meshData.numIndices = meshData.lods[0].numIndices;
 
     meshData.element->upload(gfx::BaseBuffer::Element,
-                             gfx::BaseBuffer::StaticDraw,
-                             meshData.indices.size() * sizeof(unsigned int),
-                             meshData.indices.data());
-
-    if (meshData.skinned) {
-      std::vector<gfx::MeshVertexSkinned> vertices;
-      for (int i = 0; i < mesh->mNumVertices; i++) {
-        gfx::MeshVertexSkinned vertex;
-        vertex.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y,
-                                    mesh->mVertices[i].z);
-        vertex.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y,
-                                  mesh->mNormals[i].z);
-        vertex.uv = glm::vec2(mesh->mTextureCoords[0][i].x,
-                              1.0 - mesh->mTextureCoords[0][i].y);
-        vertex.boneIds[0] = -1;
-        vertex.boneIds[1] = -1;
-        vertex.boneIds[2] = -1;
-        vertex.boneIds[3] = -1;
-
-        vertex.boneWeights[0] = 0.0;
-        vertex.boneWeights[1] = 0.0;
-        vertex.boneWeights[2] = 0.0;
-        vertex.boneWeights[3] = 0.0;
-
-        vertices.push_back(vertex);
-      }
-
-      for (int i = 0; i < mesh->mNumBones; i++) {
-        aiBone* bone = mesh->mBones[i];
-        int boneId = -1;
-        if (boneInfo.find(bone->mName.C_Str()) != boneInfo.end()) {
-          boneId = boneInfo[bone->mName.C_Str()].id;
-        } else
-          Log::printf(LOG_WARN, "Mesh ref unknown bone %s",
-                      bone->mName.C_Str());
+                             gfx::BaseBuffer::StaticDraw, staged.indices.size(),
+                             staged.indices.data());
+    meshData.vertex->upload(gfx::BaseBuffer::Array,
+                            gfx::BaseBuffer::StaticDraw,
+                            staged.vertices.size(), staged.vertices.data());
+    gpuBytes += staged.indices.size() + staged.vertices.size();
+
+    addMeshAttribs(meshData);
+    meshes[staged.name] = std::move(meshData);
+  }
+  return gpuBytes;
+}
 
-        for (int j = 0; j < bone->mNumWeights; j++) {
-          aiVertexWeight weight = bone->mWeights[j];
-          int vertex = weight.mVertexId;
-          float value = weight.mWeight;
+void Model::gfxUpload(gfx::Engine* engine) {
+  std::scoped_lock l(m);
 
-          if (value == 0.0) continue;
+  if (broken) {
+    freeStaging();
+    setReady();
+    return;
+  }
 
-          for (int z = 0; z < MODEL_MAX_WEIGHTS; z++) {
-            if (vertices[vertex].boneIds[z] < 0) {
-              vertices[vertex].boneIds[z] = boneId;
-              vertices[vertex].boneWeights[z] = value;
-              break;
-            }
-          }
-        }
-      }
+  size_t gpuBytes = 0;
+  for (Texture* texture : deferedTextures)
+    gpuBytes += uploadEmbeddedTexture(engine, texture);
 
-      meshData.vertex->upload(
-          gfx::BaseBuffer::Array, gfx::BaseBuffer::StaticDraw,
-          vertices.size() * sizeof(gfx::MeshVertexSkinned), vertices.data());
-      meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
-          gfx::DtFloat, 0, 3, sizeof(gfx::MeshVertexSkinned),
-          (void*)offsetof(gfx::MeshVertexSkinned, position),
-          meshData.vertex.get()));
-      meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
-          gfx::DtFloat, 1, 3, sizeof(gfx::MeshVertexSkinned),
-          (void*)offsetof(gfx::MeshVertexSkinned, normal),
-          meshData.vertex.get()));
-      meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
-          gfx::DtFloat, 2, 2, sizeof(gfx::MeshVertexSkinned),
-          (void*)offsetof(gfx::MeshVertexSkinned, uv), meshData.vertex.get()));
-      meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
-          gfx::DtInt, 3, 4, sizeof(gfx::MeshVertexSkinned),
-          (void*)offsetof(gfx::MeshVertexSkinned, boneIds),
-          meshData.vertex.get()));
-      meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
-          gfx::DtFloat, 4, 4, sizeof(gfx::MeshVertexSkinned),
-          (void*)offsetof(gfx::MeshVertexSkinned, boneWeights),
-          meshData.vertex.get()));
-    } else {
-      std::vector<gfx::MeshVertex> vertices;
-      for (int i = 0; i < mesh->mNumVertices; i++) {
-        gfx::MeshVertex vertex;
-        vertex.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y,
-                                    mesh->mVertices[i].z);
-        vertex.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y,
-                                  mesh->mNormals[i].z);
-        vertex.uv = glm::vec2(mesh->mTextureCoords[0][i].x,
-                              1.0 - mesh->mTextureCoords[0][i].y);
-        vertices.push_back(vertex);
-      }
-      meshData.vertex->upload(
-          gfx::BaseBuffer::Array, gfx::BaseBuffer::StaticDraw,
-          vertices.size() * sizeof(gfx::MeshVertex), vertices.data());
-      meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
-          gfx::DtFloat, 0, 3, sizeof(gfx::MeshVertex),
-          (void*)offsetof(gfx::MeshVertex, position), meshData.vertex.get()));
-      meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
-          gfx::DtFloat, 1, 3, sizeof(gfx::MeshVertex),
-          (void*)offsetof(gfx::MeshVertex, normal), meshData.vertex.get()));
-      meshData.arrayPointers->addAttrib(gfx::BaseArrayPointers::Attrib(
-          gfx::DtFloat, 2, 2, sizeof(gfx::MeshVertex),
-          (void*)offsetof(gfx::MeshVertex, uv), meshData.vertex.get()));
-    }
+  Log::printf(LOG_DEBUG, "Loaded %zu textures", deferedTextures.size());
+  deferedTextures.clear();
 
-    meshData.arrayPointers->upload();
-    meshes[mesh->mName.C_Str()] = std::move(meshData);
-  }
+  gpuBytes += isBaked ? uploadBakedMeshes(engine) : uploadMeshes(engine);
 
   for (auto& [name, material] : materials) {
     material.pbrData = engine->getDevice()->createBuffer();
@@ -274,18 +358,28 @@ void Model::gfxUpload(gfx::Engine* engine) {
   gfx_materialDf =
       engine->getMaterialCache()->getOrLoad(materialName.c_str()).value();
 
+  // everything is on the GPU now, and eviction reads the file again
+  freeStaging();
+  setGpuBytes(gpuBytes);
   setReady();
 }
 
 void Model::onLoadData(common::OptionalData data) {
+  // getMemoryUsage and evict read and free what's built here
+  std::scoped_lock l(m);
   namespace fs = std::filesystem;
   fs::path path = getName();
   broken = false;
-  if (path.extension() == "cqc") {
+  if (path.extension() == ".rmdl") {
+    if (!loadBaked(data)) broken = true;
   } else {
     std::string dir = getName().substr(0, getName().find_last_of('/') + 1);
+    // the importer and its scene only live as long as this load, anything
+    // the model keeps is copied out of them
+    Assimp::Importer importer;
     AssimpIOSystem* system = new AssimpIOSystem(dir);
     importer.SetIOHandler(system);
+    const aiScene* scene;
 #ifdef _WIN32
     char xtnsion[64];
     wcstombs(xtnsion, path.extension().c_str(), sizeof(xtnsion));
@@ -304,153 +398,605 @@ void Model::onLoadData(common::OptionalData data) {
       broken = true;
       return;
     }
-    inverseGlobalTransform = glm::inverse(
-        gfx::ConvertMatrixToGLMFormat(scene->mRootNode->mTransformation));
-    for (int i = 0; i < scene->mNumMaterials; i++) {
-      aiMaterial* material = scene->mMaterials[i];
-      Material& matData = materials[material->GetName().C_Str()];
-      if (aiGetMaterialFloat(material, AI_MATKEY_ROUGHNESS_FACTOR,
-                             &matData.roughness) != AI_SUCCESS) {
-        Log::printf(LOG_DEBUG, "Unable to load material roughness");
-        matData.roughness = 1.f;
+    if (!hasRuntimeData) {
+      loadScene(scene, dir);
+      hasRuntimeData = true;
+    }
+    // optimizing, simplifying and decoding are too slow for the render thread
+    size_t stagedBytes = stageMeshes(scene) + stageTextures(scene);
+    setCpuBytes(getRuntimeBytes() + stagedBytes);
+  }
+}
+
+void Model::loadScene(const aiScene* scene, const std::string& dir) {
+  inverseGlobalTransform = glm::inverse(
+      gfx::ConvertMatrixToGLMFormat(scene->mRootNode->mTransformation));
+  flattenNodes(scene->mRootNode, -1);
+  for (int i = 0; i < scene->mNumMaterials; i++) {
+    aiMaterial* material = scene->mMaterials[i];
+    Material& matData = materials[material->GetName().C_Str()];
+    if (aiGetMaterialFloat(material, AI_MATKEY_ROUGHNESS_FACTOR,
+                           &matData.roughness) != AI_SUCCESS) {
+      Log::printf(LOG_DEBUG, "Unable to load material roughness");
+      matData.roughness = 1.f;
+    }
+    if (aiGetMaterialFloat(material, AI_MATKEY_METALLIC_FACTOR,
+                           &matData.metallic) != AI_SUCCESS) {
+      Log::printf(LOG_DEBUG, "Unable to load material metallic");
+      matData.metallic = 0.f;
+    }
+    if (aiGetMaterialFloat(material, AI_MATKEY_SPECULAR_FACTOR,
+                           &matData.specular) != AI_SUCCESS) {
+      Log::printf(LOG_DEBUG, "Unable to load material specular");
+      matData.specular = 0.f;
+    }
+    matData.rimLight = 0.f;
+
+    aiColor4D color;
+    if (aiGetMaterialColor(material, AI_MATKEY_COLOR_DIFFUSE, &color) !=
+        AI_SUCCESS) {
+      Log::printf(LOG_DEBUG, "Unable to load material diffuse");
+    }
+
+    matData.albedo = glm::vec3(color.r, color.g, color.b);
+    matData.hasAlbedo = false;
+
+    if (material->GetTextureCount(aiTextureType_DIFFUSE)) {
+      Texture& texture = matData.diffuse;
+      matData.hasAlbedo = true;
+      texture.texture_ref = NULL;
+      std::string texturePath;
+      {
+        aiString aiTexturePath;
+        material->GetTexture(aiTextureType_DIFFUSE, 0, &aiTexturePath);
+
+        if (aiTexturePath.C_Str()[0] == '*') {
+          texturePath = aiTexturePath.C_Str();
+          texture.textureId = std::atoi(texturePath.substr(1).c_str());
+          texture.external = false;
+          if (texture.textureId < 0 ||
+              texture.textureId >= scene->mNumTextures) {
+            Log::printf(LOG_ERROR, "Bad embedded texture %s for material %s",
+                        texturePath.c_str(), material->GetName().C_Str());
+            matData.hasAlbedo = false;
+            continue;
+          }
+
+          // defer loading this
+          deferedTextures.push_back(&texture);
+        } else {
+          texture.external = true;
+          texturePath = dir + aiTexturePath.C_Str();
+          matData.diffuse.texture_ref =
+              getResourceManager()->load<resource::Texture>(
+                  texturePath.c_str());
+          if (!matData.diffuse.texture_ref)
+            Log::printf(LOG_ERROR,
+                        "Could not load diffuse texture %s for material %s",
+                        texturePath.c_str(), material->GetName().C_Str());
+        }
+      }
+    }
+  }
+  for (int i = 0; i < scene->mNumMeshes; i++) {
+    aiMesh* mesh = scene->mMeshes[i];
+    std::string meshName = mesh->mName.C_Str();
+
+    for (int i = 0; i < mesh->mNumVertices; i++) {
+      glm::vec3 position = glm::vec3(
+          mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+      boundingBox.max = glm::max(boundingBox.max, position);
+      boundingBox.min = glm::min(boundingBox.min, position);
+    }
+
+    if (mesh->HasBones()) {
+      skinned = true;
+
+      for (int j = 0; j < mesh->mNumBones; j++) {
+        aiBone* bone = mesh->mBones[j];
+        std::string boneName = bone->mName.C_Str();
+        if (boneInfo.find(boneName) != boneInfo.end()) continue;
+
+        gfx::BoneInfo boneData;
+        boneData.id = boneCount++;
+        boneData.offset = gfx::ConvertMatrixToGLMFormat(bone->mOffsetMatrix);
+        // boneData.offset = glm::identity<glm::mat4>();
+        boneInfo[boneName] = boneData;
+      }
+    }
+  }
+  for (int i = 0; i < scene->mNumAnimations; i++) {
+    aiAnimation* anim = scene->mAnimations[i];
+    Animation animData;
+
+    animData.tps = anim->mTicksPerSecond;
+    animData.duration = anim->mDuration;
+    for (int j = 0; j < anim->mNumChannels; j++) {
+      aiNodeAnim* nodeAnim = anim->mChannels[j];
+
+      if (skinned &&
+          boneInfo.find(nodeAnim->mNodeName.C_Str()) == boneInfo.end()) {
+        gfx::BoneInfo& info = boneInfo[nodeAnim->mNodeName.C_Str()];
+        info.id = boneCount++;
+        info.offset = glm::identity<glm::mat4>();
+        Log::printf(LOG_WARN, "Anim %s adds missing bone %s",
+                    anim->mName.C_Str(), nodeAnim->mNodeName.C_Str());
       }
-      if (aiGetMaterialFloat(material, AI_MATKEY_METALLIC_FACTOR,
-                             &matData.metallic) != AI_SUCCESS) {
-        Log::printf(LOG_DEBUG, "Unable to load material metallic");
-        matData.metallic = 0.f;
+
+      int node = findNode(nodeAnim->mNodeName.C_Str());
+      if (node < 0) continue;
+
+      Track& track = animData.tracks.emplace_back();
+      track.node = node;
+      track.translationTimes.reserve(nodeAnim->mNumPositionKeys);
+      track.translations.reserve(nodeAnim->mNumPositionKeys);
+      track.rotationTimes.reserve(nodeAnim->mNumRotationKeys);
+      track.rotations.reserve(nodeAnim->mNumRotationKeys);
+      track.scaleTimes.reserve(nodeAnim->mNumScalingKeys);
+      track.scales.reserve(nodeAnim->mNumScalingKeys);
+
+      for (int j = 0; j < nodeAnim->mNumPositionKeys; j++) {
+        aiVector3D p = nodeAnim->mPositionKeys[j].mValue;
+        track.translationTimes.push_back(nodeAnim->mPositionKeys[j].mTime);
+        track.translations.push_back(glm::vec3(p.x, p.y, p.z));
       }
-      if (aiGetMaterialFloat(material, AI_MATKEY_SPECULAR_FACTOR,
-                             &matData.specular) != AI_SUCCESS) {
-        Log::printf(LOG_DEBUG, "Unable to load material specular");
-        matData.specular = 0.f;
+
+      for (int j = 0; j < nodeAnim->mNumScalingKeys; j++) {
+        aiVector3D p = nodeAnim->mScalingKeys[j].mValue;
+        track.scaleTimes.push_back(nodeAnim->mScalingKeys[j].mTime);
+        track.scales.push_back(glm::vec3(p.x, p.y, p.z));
       }
-      matData.rimLight = 0.f;
 
-      aiColor4D color;
-      if (aiGetMaterialColor(material, AI_MATKEY_COLOR_DIFFUSE, &color) !=
-          AI_SUCCESS) {
-        Log::printf(LOG_DEBUG, "Unable to load material diffuse");
+      for (int j = 0; j < nodeAnim->mNumRotationKeys; j++) {
+        aiQuaternion p = nodeAnim->mRotationKeys[j].mValue;
+        track.rotationTimes.push_back(nodeAnim->mRotationKeys[j].mTime);
+        track.rotations.push_back(glm::quat(p.w, p.x, p.y, p.z));
       }
+    }
 
-      matData.albedo = glm::vec3(color.r, color.g, color.b);
-      matData.hasAlbedo = false;
-
-      if (material->GetTextureCount(aiTextureType_DIFFUSE)) {
-        Texture& texture = matData.diffuse;
-        matData.hasAlbedo = true;
-        texture.texture_ref = NULL;
-        std::string texturePath;
-        {
-          aiString aiTexturePath;
-          material->GetTexture(aiTextureType_DIFFUSE, 0, &aiTexturePath);
-
-          if (aiTexturePath.C_Str()[0] == '*') {
-            texturePath = aiTexturePath.C_Str();
-            texture.textureId = std::atoi(texturePath.substr(1).c_str());
-            texture.external = false;
-
-            // defer loading this
-            deferedTextures.push_back(&texture);
-          } else {
-            texture.external = true;
-            texturePath = dir + aiTexturePath.C_Str();
-            matData.diffuse.texture_ref =
-                getResourceManager()->load<resource::Texture>(
-                    texturePath.c_str());
-            if (!matData.diffuse.texture_ref)
-              Log::printf(LOG_ERROR,
-                          "Could not load diffuse texture %s for material %s",
-                          texturePath.c_str(), material->GetName().C_Str());
-          }
-        }
+    animations[anim->mName.C_Str()] = animData;
+    if (!preferedAnimation)
+      preferedAnimation = &animations[anim->mName.C_Str()];
+  }
+  linkNodes();
+}
+
+void Model::flattenNodes(aiNode* node, int parent) {
+  int index = nodes.size();
+  nodes.push_back(Node{
+      .name = node->mName.C_Str(),
+      .transform = gfx::ConvertMatrixToGLMFormat(node->mTransformation),
+      .parent = parent,
+  });
+  for (int i = 0; i < node->mNumChildren; i++)
+    flattenNodes(node->mChildren[i], index);
+}
+
+size_t Model::stageMeshes(const aiScene* scene) {
+  size_t bytes = 0;
+  stagedMeshes.clear();
+  for (int mesh_id = 0; mesh_id < scene->mNumMeshes; mesh_id++) {
+    aiMesh* mesh = scene->mMeshes[mesh_id];
+    StagedMesh& staged = stagedMeshes.emplace_back();
+    staged.name = mesh->mName.C_Str();
+    staged.skinned = mesh->HasBones();
+    staged.material =
+        scene->mMaterials[mesh->mMaterialIndex]->GetName().C_Str();
+
+    std::vector<uint32_t> indices;
+    for (int i = 0; i < mesh->mNumFaces; i++) {
+      aiFace face = mesh->mFaces[i];
+      for (int j = 0; j < face.mNumIndices; j++) {
+        indices.push_back(face.mIndices[j]);
       }
     }
-    for (int i = 0; i < scene->mNumMeshes; i++) {
-      aiMesh* mesh = scene->mMeshes[i];
-      std::string meshName = mesh->mName.C_Str();
 
+    if (staged.skinned) {
+      std::vector<model::ModelVertexSkinned> vertices;
+      std::vector<float> weights(mesh->mNumVertices * MODEL_MAX_WEIGHTS, 0.f);
       for (int i = 0; i < mesh->mNumVertices; i++) {
-        glm::vec3 position = glm::vec3(
-            mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-        boundingBox.max = glm::max(boundingBox.max, position);
-        boundingBox.min = glm::min(boundingBox.min, position);
+        model::ModelVertexSkinned vertex;
+        vertex.position[0] = mesh->mVertices[i].x;
+        vertex.position[1] = mesh->mVertices[i].y;
+        vertex.position[2] = mesh->mVertices[i].z;
+        vertex.normal = model::packNormal(
+            mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+        vertex.uv[0] = model::packHalf(mesh->mTextureCoords[0][i].x);
+        vertex.uv[1] = model::packHalf(1.0 - mesh->mTextureCoords[0][i].y);
+        memset(vertex.boneIds, MODEL_NO_BONE, sizeof(vertex.boneIds));
+        memset(vertex.boneWeights, 0, sizeof(vertex.boneWeights));
+
+        vertices.push_back(vertex);
       }
 
-      if (mesh->HasBones()) {
-        skinned = true;
+      for (int i = 0; i < mesh->mNumBones; i++) {
+        aiBone* bone = mesh->mBones[i];
+        int boneId = -1;
+        if (boneInfo.find(bone->mName.C_Str()) != boneInfo.end()) {
+          boneId = boneInfo[bone->mName.C_Str()].id;
+        } else
+          Log::printf(LOG_WARN, "Mesh ref unknown bone %s",
+                      bone->mName.C_Str());
+        if (boneId < 0) continue;
+        // ids past the bone uniform block fall back to the bind pose in the
+        // shader anyway
+        boneId = std::min(boneId, MODEL_NO_BONE - 1);
 
-        for (int j = 0; j < mesh->mNumBones; j++) {
-          aiBone* bone = mesh->mBones[j];
-          std::string boneName = bone->mName.C_Str();
-          if (boneInfo.find(boneName) != boneInfo.end()) continue;
+        for (int j = 0; j < bone->mNumWeights; j++) {
+          aiVertexWeight weight = bone->mWeights[j];
+          int vertex = weight.mVertexId;
+          float value = weight.mWeight;
+
+          if (value == 0.0) continue;
 
-          gfx::BoneInfo boneData;
-          boneData.id = boneCount++;
-          boneData.offset = gfx::ConvertMatrixToGLMFormat(bone->mOffsetMatrix);
-          // boneData.offset = glm::identity<glm::mat4>();
-          boneInfo[boneName] = boneData;
+          for (int z = 0; z < MODEL_MAX_WEIGHTS; z++) {
+            if (vertices[vertex].boneIds[z] == MODEL_NO_BONE) {
+              vertices[vertex].boneIds[z] = boneId;
+              weights[vertex * MODEL_MAX_WEIGHTS + z] = value;
+              break;
+            }
+          }
         }
       }
+      for (int i = 0; i < mesh->mNumVertices; i++)
+        model::packWeights(&weights[i * MODEL_MAX_WEIGHTS],
+                           vertices[i].boneWeights);
+
+      packMesh(indices, vertices, staged.vertices, staged.indices,
+               staged.indexType, staged.lods);
+    } else {
+      std::vector<model::ModelVertex> vertices;
+      for (int i = 0; i < mesh->mNumVertices; i++) {
+        model::ModelVertex vertex;
+        vertex.position[0] = mesh->mVertices[i].x;
+        vertex.position[1] = mesh->mVertices[i].y;
+        vertex.position[2] = mesh->mVertices[i].z;
+        vertex.normal = model::packNormal(
+            mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+        vertex.uv[0] = model::packHalf(mesh->mTextureCoords[0][i].x);
+        vertex.uv[1] = model::packHalf(1.0 - mesh->mTextureCoords[0][i].y);
+        vertices.push_back(vertex);
+      }
+
+      packMesh(indices, vertices, staged.vertices, staged.indices,
+               staged.indexType, staged.lods);
     }
-    for (int i = 0; i < scene->mNumAnimations; i++) {
-      aiAnimation* anim = scene->mAnimations[i];
-      Animation animData;
-
-      animData.tps = anim->mTicksPerSecond;
-      animData.duration = anim->mDuration;
-      for (int j = 0; j < anim->mNumChannels; j++) {
-        aiNodeAnim* nodeAnim = anim->mChannels[j];
-
-        if (skinned &&
-            boneInfo.find(nodeAnim->mNodeName.C_Str()) == boneInfo.end()) {
-          gfx::BoneInfo& info = boneInfo[nodeAnim->mNodeName.C_Str()];
-          info.id = boneCount++;
-          info.offset = glm::identity<glm::mat4>();
-          Log::printf(LOG_WARN, "Anim %s adds missing bone %s",
-                      nodeAnim->mNodeName.C_Str());
-        }
+    bytes += staged.vertices.size() + staged.indices.size();
+  }
+  return bytes;
+}
 
-        BoneKeyframe& chan_keys =
-            animData.boneKeys[nodeAnim->mNodeName.C_Str()];
-        chan_keys.translations.reserve(nodeAnim->mNumPositionKeys);
-        chan_keys.rotations.reserve(nodeAnim->mNumRotationKeys);
-        chan_keys.scales.reserve(nodeAnim->mNumScalingKeys);
-
-        for (int j = 0; j < nodeAnim->mNumPositionKeys; j++) {
-          KeyTranslate k;
-          aiVector3D p = nodeAnim->mPositionKeys[j].mValue;
-          k.position = glm::vec3(p.x, p.y, p.z);
-          k.timestamp = nodeAnim->mPositionKeys[j].mTime;
-          chan_keys.translations.push_back(k);
-        }
+size_t Model::stageTextures(const aiScene* scene) {
+  size_t bytes = 0;
+  stagedTextures.clear();
+  for (int i = 0; i < scene->mNumTextures; i++) {
+    aiTexture* texture = scene->mTextures[i];
+    StagedTexture& staged = stagedTextures.emplace_back();
+    if (texture->mHeight == 0) {
+      // compressed, mWidth is the size of the file
+      int channels;
+      stbi_uc* uc = stbi_load_from_memory(
+          (const stbi_uc*)texture->pcData, texture->mWidth, &staged.width,
+          &staged.height, &channels, 4);
+      if (!uc) {
+        Log::printf(LOG_WARN, "Could not decode embedded texture %i in %s",
+                    i, getName().c_str());
+        staged.width = 1;
+        staged.height = 1;
+        staged.pixels.assign(4, 255);
+      } else {
+        staged.pixels.assign(uc,
+                             uc + (size_t)staged.width * staged.height * 4);
+        stbi_image_free(uc);
+      }
+    } else {
+      const unsigned char* texels = (const unsigned char*)texture->pcData;
+      staged.width = texture->mWidth;
+      staged.height = texture->mHeight;
+      staged.pixels.assign(texels,
+                           texels + (size_t)staged.width * staged.height * 4);
+    }
+    bytes += staged.pixels.size();
+  }
+  return bytes;
+}
 
-        for (int j = 0; j < nodeAnim->mNumScalingKeys; j++) {
-          KeyScale k;
-          aiVector3D p = nodeAnim->mScalingKeys[j].mValue;
-          k.scale = glm::vec3(p.x, p.y, p.z);
-          k.timestamp = nodeAnim->mScalingKeys[j].mTime;
-          chan_keys.scales.push_back(k);
-        }
+void Model::freeStaging() {
+  // swapped with empty vectors so the memory actually goes
+  std::vector<StagedMesh>().swap(stagedMeshes);
+  std::vector<StagedTexture>().swap(stagedTextures);
+  std::vector<unsigned char>().swap(bakedData);
+  baked = model::ModelFile();
+  setCpuBytes(getRuntimeBytes());
+}
 
-        for (int j = 0; j < nodeAnim->mNumRotationKeys; j++) {
-          KeyRotate k;
-          aiQuaternion p = nodeAnim->mRotationKeys[j].mValue;
-          k.quat = glm::quat(p.w, p.x, p.y, p.z);
-          k.timestamp = nodeAnim->mRotationKeys[j].mTime;
-          chan_keys.rotations.push_back(k);
-        }
+bool Model::loadBaked(common::OptionalData& data) {
+  bakedData = std::move(data.value());
+  if (!baked.open(bakedData.data(), bakedData.size())) {
+    Log::printf(LOG_ERROR, "%s is not a baked model this build can read",
+                getName().c_str());
+    return false;
+  }
+  isBaked = true;
+  if (!checkBakedUploads()) return false;
+  if (hasRuntimeData) {
+    setCpuBytes(getRuntimeBytes() + bakedData.size());
+    return true;
+  }
+
+  const model::ModelHeader* hdr = baked.getHeader();
+  std::string dir = getName().substr(0, getName().find_last_of('/') + 1);
+  boundingBox.min = glm::make_vec3(hdr->boundsMin);
+  boundingBox.max = glm::make_vec3(hdr->boundsMax);
+  skinned = hdr->flags & model::MODEL_FLAG_SKINNED;
+
+  for (const model::ModelNode& node : baked.get<model::ModelNode>(hdr->nodes)) {
+    const char* name = baked.getString(node.name);
+    if (!name || node.parent >= (int)nodes.size()) {
+      Log::printf(LOG_ERROR, "Bad node %zu in %s", nodes.size(),
+                  getName().c_str());
+      return false;
+    }
+    nodes.push_back(Node{.name = name,
+                         .transform = glm::make_mat4(node.transform),
+                         .parent = node.parent});
+  }
+  if (nodes.empty()) {
+    Log::printf(LOG_ERROR, "%s has no nodes", getName().c_str());
+    return false;
+  }
+  inverseGlobalTransform = glm::inverse(nodes[0].transform);
+
+  std::span<const model::ModelTexture> textures =
+      baked.get<model::ModelTexture>(hdr->textures);
+  std::span<const model::ModelMaterial> bakedMaterials =
+      baked.get<model::ModelMaterial>(hdr->materials);
+  for (const model::ModelMaterial& material : bakedMaterials) {
+    const char* name = baked.getString(material.name);
+    if (!name) return false;
+    Material& matData = materials[name];
+    matData.albedo = glm::make_vec3(material.albedo);
+    matData.roughness = material.roughness;
+    matData.metallic = material.metallic;
+    matData.specular = material.specular;
+    matData.rimLight = 0.f;
+    matData.hasAlbedo = material.hasAlbedo;
+    if (!material.hasAlbedo) continue;
+
+    Texture& texture = matData.diffuse;
+    texture.texture_ref = NULL;
+    if (material.embeddedTexture != MODEL_NONE) {
+      if (material.embeddedTexture >= textures.size()) return false;
+      texture.textureId = material.embeddedTexture;
+      texture.external = false;
+      deferedTextures.push_back(&texture);
+    } else {
+      const char* texturePath = baked.getString(material.texturePath);
+      if (!texturePath) return false;
+      texture.external = true;
+      texture.texture_ref = getResourceManager()->load<resource::Texture>(
+          (dir + texturePath).c_str());
+      if (!texture.texture_ref)
+        Log::printf(LOG_ERROR,
+                    "Could not load diffuse texture %s for material %s",
+                    texturePath, name);
+    }
+  }
+
+  for (const model::ModelBone& bone : baked.get<model::ModelBone>(hdr->bones)) {
+    const char* name = baked.getString(bone.name);
+    if (!name || bone.id < 0 || bone.id >= MODEL_MAX_BONE_TRANSFORMS)
+      return false;
+    gfx::BoneInfo& info = boneInfo[name];
+    info.id = bone.id;
+    info.offset = glm::make_mat4(bone.offset);
+    boneCount = std::max(boneCount, bone.id + 1);
+  }
+
+  std::span<const model::ModelChannel> channels =
+      baked.get<model::ModelChannel>(hdr->channels);
+  std::span<const model::ModelKeyVec3> translations =
+      baked.get<model::ModelKeyVec3>(hdr->translations);
+  std::span<const model::ModelKeyQuat> rotations =
+      baked.get<model::ModelKeyQuat>(hdr->rotations);
+  std::span<const model::ModelKeyVec3> scales =
+      baked.get<model::ModelKeyVec3>(hdr->scales);
+  for (const model::ModelAnimation& anim :
+       baked.get<model::ModelAnimation>(hdr->animations)) {
+    const char* animName = baked.getString(anim.name);
+    if (!animName || anim.firstChannel > channels.size() ||
+        anim.numChannels > channels.size() - anim.firstChannel)
+      return false;
+
+    Animation animData;
+    animData.tps = anim.tps;
+    animData.duration = anim.duration;
+    for (const model::ModelChannel& channel :
+         channels.subspan(anim.firstChannel, anim.numChannels)) {
+      if (channel.node >= nodes.size() ||
+          channel.firstTranslation > translations.size() ||
+          channel.numTranslations >
+              translations.size() - channel.firstTranslation ||
+          channel.firstRotation > rotations.size() ||
+          channel.numRotations > rotations.size() - channel.firstRotation ||
+          channel.firstScale > scales.size() ||
+          channel.numScales > scales.size() - channel.firstScale)
+        return false;
+
+      Track& track = animData.tracks.emplace_back();
+      track.node = channel.node;
+      for (const model::ModelKeyVec3& key : translations.subspan(
+               channel.firstTranslation, channel.numTranslations)) {
+        track.translationTimes.push_back(key.time);
+        track.translations.push_back(glm::make_vec3(key.value));
+      }
+      for (const model::ModelKeyQuat& key :
+           rotations.subspan(channel.firstRotation, channel.numRotations)) {
+        track.rotationTimes.push_back(key.time);
+        track.rotations.push_back(glm::quat(key.value[0], key.value[1],
+                                            key.value[2], key.value[3]));
+      }
+      for (const model::ModelKeyVec3& key :
+           scales.subspan(channel.firstScale, channel.numScales)) {
+        track.scaleTimes.push_back(key.time);
+        track.scales.push_back(glm::make_vec3(key.value));
+      }
+    }
+
+    animations[animName] = animData;
+    if (!preferedAnimation) preferedAnimation = &animations[animName];
+  }
+
+  linkNodes();
+  hasRuntimeData = true;
+  setCpuBytes(getRuntimeBytes() + bakedData.size());
+  return true;
+}
+
+bool Model::checkBakedUploads() {
+  const model::ModelHeader* hdr = baked.getHeader();
+  std::span<const model::ModelTexture> textures =
+      baked.get<model::ModelTexture>(hdr->textures);
+  for (const model::ModelTexture& texture : textures) {
+    size_t size = texture.height == 0
+                      ? texture.width
+                      : (size_t)texture.width * texture.height * 4;
+    if (texture.dataOffset > hdr->textureData.size ||
+        size > hdr->textureData.size - texture.dataOffset) {
+      Log::printf(LOG_ERROR, "Bad texture in %s", getName().c_str());
+      return false;
+    }
+  }
+
+  // a reload has to point at the same textures the materials were made with
+  for (auto& [name, material] : materials) {
+    if (material.hasAlbedo && !material.diffuse.external &&
+        (size_t)material.diffuse.textureId >= textures.size()) {
+      Log::printf(LOG_ERROR, "Bad texture in %s", getName().c_str());
+      return false;
+    }
+  }
+
+  std::span<const model::ModelMaterial> bakedMaterials =
+      baked.get<model::ModelMaterial>(hdr->materials);
+  std::span<const model::ModelLod> lods = baked.get<model::ModelLod>(hdr->lods);
+  for (const model::ModelMesh& mesh :
+       baked.get<model::ModelMesh>(hdr->meshes)) {
+    size_t vertexSize = mesh.skinned ? sizeof(model::ModelVertexSkinned)
+                                     : sizeof(model::ModelVertex);
+    if (!baked.getString(mesh.name) || mesh.material >= bakedMaterials.size() ||
+        mesh.vertexOffset > hdr->vertices.size ||
+        (size_t)mesh.numVertices * vertexSize >
+            hdr->vertices.size - mesh.vertexOffset ||
+        (mesh.indexSize != 2 && mesh.indexSize != 4) ||
+        mesh.indexOffset % mesh.indexSize != 0 ||
+        mesh.indexOffset > hdr->indices.size ||
+        mesh.numIndices >
+            (hdr->indices.size - mesh.indexOffset) / mesh.indexSize ||
+        mesh.numLods == 0 || mesh.firstLod > lods.size() ||
+        mesh.numLods > lods.size() - mesh.firstLod) {
+      Log::printf(LOG_ERROR, "Bad mesh in %s", getName().c_str());
+      return false;
+    }
+    for (const model::ModelLod& lod :
+         lods.subspan(mesh.firstLod, mesh.numLods)) {
+      if (lod.firstIndex > mesh.numIndices ||
+          lod.numIndices > mesh.numIndices - lod.firstIndex) {
+        Log::printf(LOG_ERROR, "Bad level of detail in %s", getName().c_str());
+        return false;
       }
+    }
+  }
 
-      animations[anim->mName.C_Str()] = animData;
-      if (!preferedAnimation)
-        preferedAnimation = &animations[anim->mName.C_Str()];
+  return true;
+}
+
+int Model::findNode(const std::string& name) {
+  for (int i = 0; i < nodes.size(); i++)
+    if (nodes[i].name == name) return i;
+  return -1;
+}
+
+void Model::linkNodes() {
+  for (Node& node : nodes) node.leaf = true;
+  for (Node& node : nodes) {
+    if (node.parent >= 0) nodes[node.parent].leaf = false;
+
+    glm::vec3 skew;
+    glm::vec4 perspective;
+    glm::decompose(node.transform, node.bindScale, node.bindRotation,
+                   node.bindTranslation, skew, perspective);
+
+    auto it = boneInfo.find(node.name);
+    node.boneId = -1;
+    if (it == boneInfo.end()) continue;
+    if (it->second.id >= MODEL_MAX_BONE_TRANSFORMS) {
+      Log::printf(LOG_WARN, "Bone %s in %s is past MODEL_MAX_BONE_TRANSFORMS",
+                  node.name.c_str(), getName().c_str());
+      continue;
     }
+    node.boneId = it->second.id;
+    node.boneOffset = it->second.offset;
+  }
+
+  for (auto& [name, animation] : animations) {
+    animation.model = this;
+    animation.nodeTracks.assign(nodes.size(), -1);
+    for (int i = 0; i < animation.tracks.size(); i++)
+      animation.nodeTracks[animation.tracks[i].node] = i;
+  }
+}
+
+static CVar r_lod_scale("r_lod_scale", "1", CVARF_SAVE | CVARF_GLOBAL);
+
+// how much of the viewport's height the bounding sphere has to cover to stay
+// at each level of detail, finest first
+static const float lodScreenSizes[MESH_MAX_LODS - 1] = {0.25f, 0.12f, 0.05f};
+// a level only changes once the size is this far past its threshold
+#define MODEL_LOD_HYSTERESIS 0.15f
+
+void Model::selectLod(gfx::Camera& camera, LodState* lod) {
+  glm::vec3 centre = glm::vec3(
+      lod->transform *
+      glm::vec4((boundingBox.min + boundingBox.max) * 0.5f, 1.f));
+  float transformScale = std::max({glm::length(glm::vec3(lod->transform[0])),
+                                   glm::length(glm::vec3(lod->transform[1])),
+                                   glm::length(glm::vec3(lod->transform[2]))});
+  float radius =
+      glm::distance(boundingBox.min, boundingBox.max) * 0.5f * transformScale;
+
+  glm::mat4 projection = camera.getProjectionMatrix();
+  float size;
+  if (projection[2][3] == 0.f) {  // orthographic
+    size = radius * projection[1][1];
+  } else {
+    float distance = glm::distance(camera.getPosition(), centre);
+    size = distance > radius ? radius * projection[1][1] / distance : 1.f;
+  }
+  lod->screenSize = size;
+
+  float scale = r_lod_scale.getFloat();
+  if (scale <= 0.f) {
+    lod->level = 0;
+    return;
   }
+  size *= scale;
+
+  int level = lod->level;
+  while (level < MESH_MAX_LODS - 1 &&
+         size < lodScreenSizes[level] * (1.f - MODEL_LOD_HYSTERESIS))
+    level++;
+  while (level > 0 &&
+         size > lodScreenSizes[level - 1] * (1.f + MODEL_LOD_HYSTERESIS))
+    level--;
+  lod->level = level;
 }
 
 void Model::render(
     gfx::BaseDevice* device, Animator* animator, gfx::Material* material,
-    std::optional<std::function<void(gfx::BaseProgram*)>> setParameters) {
+    std::optional<std::function<void(gfx::BaseProgram*)>> setParameters,
+    LodState* lod) {
+  touch();
   if (!getReady()) return;
   if (meshes.size() == 0)
     throw std::runtime_error("There are no meshes in this model");
@@ -471,8 +1017,22 @@ void Model::render(
     if (skinned && animator) animator->upload(bp);
     if (setParameters) setParameters.value()(bp);
 
+    if (!lod) lod = &defaultLod;
+    selectLod(device->getEngine()->getCamera(), lod);
+    int level = lod->level;
+    float screenPixels = lod->screenSize * device->getEngine()
+                                               ->getCurrentViewport()
+                                               ->getSettings()
+                                               .resolution.y;
+    // bigger on screen loads, uploads and streams first, and is evicted last
+    reportPriority(lod->screenSize);
+
     for (auto& [name, mesh] : meshes) {
       Material& mat = materials[mesh.material];
+      if (mat.hasAlbedo && mat.diffuse.external && mat.diffuse.texture_ref) {
+        mat.diffuse.texture_ref->reportScreenSize(screenPixels);
+        mat.diffuse.texture_ref->reportPriority(lod->screenSize);
+      }
       gfx::BaseTexture* texture =
           mat.hasAlbedo
               ? (mat.diffuse.external ? mat.diffuse.texture_ref->getTexture()
@@ -485,26 +1045,178 @@ void Model::render(
       bp->setParameter("Material", gfx::DtBuffer,
                        {.buffer = {.slot = 0, .buffer = mat.pbrData.get()}});
       bp->bind();
-      mesh.render(device);
+      mesh.render(device, level);
+    }
+  }
+}
+
+static CVar r_anim("r_anim", "1");
+
+bool Model::checkAnimator(Animator* anim) {
+  // animators aren't tied to a model, so they can be handed an animation, or
+  // be reused on a model, whose tracks don't match these nodes
+  if (anim->blendFrom && anim->blendFrom->model != this)
+    anim->blendFrom = NULL;
+  if (anim->animation->model != this) {
+    Log::printf(LOG_ERROR, "Animator on %s is playing another model's "
+                "animation, stopping it", getName().c_str());
+    anim->animation = NULL;
+    return false;
+  }
+  return true;
+}
+
+void Model::advanceAnimator(gfx::Engine* engine, Animator* anim) {
+  double deltaTime = engine->getRenderJob()->getStats().deltaTime;
+  anim->currentTime += anim->animation->tps * deltaTime * anim->speed;
+  anim->currentTime = fmod(anim->currentTime, anim->animation->duration);
+
+  if (anim->blendFrom) {
+    anim->blendTime += deltaTime;
+    if (anim->blendTime >= anim->blendDuration) {
+      anim->blendFrom = NULL;
+    } else {
+      anim->blendFromTime += anim->blendFrom->tps * deltaTime * anim->speed;
+      anim->blendFromTime =
+          fmod(anim->blendFromTime, anim->blendFrom->duration);
     }
   }
 }
 
+static CVar r_anim_lod_distance("r_anim_lod_distance", "25",
+                                CVARF_SAVE | CVARF_GLOBAL);
+
+void Model::Animator::setLodForDistance(float distance) {
+  float lodDistance = r_anim_lod_distance.getFloat();
+  if (lodDistance <= 0.f || distance < lodDistance)
+    setLod(1, false);
+  else if (distance < lodDistance * 2.f)
+    setLod(2, false);
+  else
+    setLod(4, true);
+}
+
 void Model::updateAnimator(gfx::Engine* engine, Animator* anim) {
   if (!skinned)
     throw std::runtime_error("Calling updateAnimator on unskinned model");
-  if (!anim->animation) return;
-  anim->currentTime += anim->animation->tps *
-                       engine->getRenderJob()->getStats().deltaTime *
-                       anim->speed;
-  anim->currentTime = fmod(anim->currentTime, anim->animation->duration);
-  calcAnimatorTransforms(scene->mRootNode, anim, glm::mat4(1));
+  if (!anim->animation || !checkAnimator(anim)) return;
+  advanceAnimator(engine, anim);
+  calcAnimatorTransforms(anim, r_anim.getBool());
+}
+
+// animators per worker job, a few hundred bones worth of work
+#define MODEL_ANIMATOR_GRAIN 4
+
+void Model::updateAnimators(gfx::Engine* engine, std::span<Animator*> anims) {
+  if (!skinned)
+    throw std::runtime_error("Calling updateAnimators on unskinned model");
+
+  // anything touching the engine stays on this thread
+  for (Animator* anim : anims)
+    if (anim->animation && checkAnimator(anim)) advanceAnimator(engine, anim);
+
+  bool animate = r_anim.getBool();
+  WorkerManager::singleton()->parallelFor(
+      anims.size(), MODEL_ANIMATOR_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+          if (anims[i]->animation) calcAnimatorTransforms(anims[i], animate);
+      });
+}
+
+Model::MemoryUsage Model::measureMemory() {
+  MemoryUsage usage;
+  usage.nodes = nodes.capacity() * sizeof(Node);
+  for (const Node& node : nodes) usage.nodes += node.name.capacity();
+  for (auto& [name, info] : boneInfo)
+    usage.nodes +=
+        sizeof(std::pair<std::string, gfx::BoneInfo>) + name.capacity();
+  usage.materials =
+      materials.size() * sizeof(std::pair<std::string, Material>);
+  usage.animations = 0;
+  for (auto& [name, animation] : animations) {
+    usage.animations += sizeof(std::pair<std::string, Animation>) +
+                        animation.nodeTracks.capacity() * sizeof(int);
+    for (const Track& track : animation.tracks)
+      usage.animations += track.getBytes();
+  }
+  usage.staging = bakedData.size();
+  for (const StagedMesh& mesh : stagedMeshes)
+    usage.staging += mesh.vertices.size() + mesh.indices.size();
+  for (const StagedTexture& texture : stagedTextures)
+    usage.staging += texture.pixels.size();
+  usage.gpu = getGpuBytes();
+  return usage;
+}
+
+Model::MemoryUsage Model::getMemoryUsage() {
+  std::scoped_lock l(m);
+  return measureMemory();
+}
+
+size_t Model::getRuntimeBytes() {
+  MemoryUsage usage = measureMemory();
+  return usage.nodes + usage.materials + usage.animations;
 }
 
+static ConsoleCommand mdl_memory(
+    "mdl_memory", "mdl_memory",
+    "prints how much memory each loaded model uses, largest first",
+    [](Game* game, ConsoleArgReader reader) {
+      std::vector<Model*> models;
+      game->getResourceManager()->forEachResource(
+          [&](ResourceId id, BaseResource* rsc) {
+            if (Model* model = dynamic_cast<Model*>(rsc))
+              models.push_back(model);
+          });
+
+      // measured outside forEachResource so no shard is locked while
+      // waiting on a model
+      std::vector<std::pair<Model*, Model::MemoryUsage>> usages;
+      for (Model* model : models)
+        usages.push_back({model, model->getMemoryUsage()});
+      auto total = [](const Model::MemoryUsage& usage) {
+        return usage.nodes + usage.materials + usage.animations +
+               usage.staging + usage.gpu;
+      };
+      std::sort(usages.begin(), usages.end(), [&](auto& a, auto& b) {
+        return total(a.second) > total(b.second);
+      });
+
+      size_t cpu = 0, gpu = 0;
+      for (auto& [model, usage] : usages) {
+        Log::printf(LOG_INFO,
+                    "%s - nodes %zu KB, materials %zu KB, animations %zu KB, "
+                    "staging %zu KB, gpu %zu KB",
+                    model->getName().c_str(), usage.nodes / 1024,
+                    usage.materials / 1024, usage.animations / 1024,
+                    usage.staging / 1024, usage.gpu / 1024);
+        cpu += total(usage) - usage.gpu;
+        gpu += usage.gpu;
+      }
+      Log::printf(LOG_INFO, "%zu models, %zu KB CPU, %zu KB GPU",
+                  usages.size(), cpu / 1024, gpu / 1024);
+    });
+
 void Model::imguiDebug() {
-  for (auto [name, animation] : animations) {
+  MemoryUsage usage = getMemoryUsage();
+  ImGui::Text("Nodes: %zu KB, Materials: %zu KB", usage.nodes / 1024,
+              usage.materials / 1024);
+  ImGui::Text("Animations: %zu KB, Staging: %zu KB", usage.animations / 1024,
+              usage.staging / 1024);
+  ImGui::Text("GPU: %zu KB", usage.gpu / 1024);
+  for (auto& [name, mesh] : meshes) {
+    if (ImGui::TreeNode(name.c_str())) {
+      ImGui::Text("Triangles: %i", (int)mesh.numIndices / 3);
+      for (int i = 1; i < mesh.lods.size(); i++)
+        ImGui::Text("LOD %i: %i", i, (int)mesh.lods[i].numIndices / 3);
+
+      ImGui::TreePop();
+    }
+  }
+  for (auto& [name, animation] : animations) {
     if (ImGui::TreeNode(name.c_str())) {
       ImGui::Text("Duration: %f", animation.duration);
+      ImGui::Text("Tracks: %i", (int)animation.tracks.size());
       ImGui::Text("Ticks/Second: %f", animation.tps);
 
       ImGui::TreePop();
@@ -512,39 +1224,130 @@ void Model::imguiDebug() {
   }
 }
 
-static CVar r_anim("r_anim", "1");
+// out = a * b, four columns at a time where SSE is available
+static inline void mulMat4(const glm::mat4& a, const glm::mat4& b,
+                           glm::mat4& out) {
+#ifdef __SSE__
+  __m128 a0 = _mm_loadu_ps(&a[0][0]);
+  __m128 a1 = _mm_loadu_ps(&a[1][0]);
+  __m128 a2 = _mm_loadu_ps(&a[2][0]);
+  __m128 a3 = _mm_loadu_ps(&a[3][0]);
+  for (int i = 0; i < 4; i++) {
+    __m128 col = _mm_mul_ps(a0, _mm_set1_ps(b[i][0]));
+    col = _mm_add_ps(col, _mm_mul_ps(a1, _mm_set1_ps(b[i][1])));
+    col = _mm_add_ps(col, _mm_mul_ps(a2, _mm_set1_ps(b[i][2])));
+    col = _mm_add_ps(col, _mm_mul_ps(a3, _mm_set1_ps(b[i][3])));
+    _mm_storeu_ps(&out[i][0], col);
+  }
+#else
+  out = a * b;
+#endif
+}
+
+struct LocalPose {
+  glm::vec3 translation;
+  glm::quat rotation;
+  glm::vec3 scale;
+};
+
+static void sampleTrack(const Model::Track& track, float t, LocalPose& pose);
+static glm::mat4 composePose(const LocalPose& pose);
 
-void Model::calcAnimatorTransforms(aiNode* node, Animator* anim,
-                                   glm::mat4 parentTransform) {
+void Model::evaluatePose(Animator* anim, bool animate, glm::mat4* pose) {
   Animation* animation = anim->animation;
+  Animation* from = anim->blendFrom;
+  float t = anim->currentTime;
+  float fromT = anim->blendFromTime;
+  float blend = from ? anim->blendTime / anim->blendDuration : 1.f;
+
+  // parents come first, so their global transform is always ready
+  static thread_local std::vector<glm::mat4> globalTransforms;
+  globalTransforms.resize(nodes.size());
+  for (int i = 0; i < nodes.size(); i++) {
+    const Node& node = nodes[i];
+    int track = animation->nodeTracks[i];
+    int fromTrack = from ? from->nodeTracks[i] : -1;
+    glm::mat4 nodeTransform = node.transform;
+    if (!animate || (anim->skipLeafBones && node.leaf)) {
+      // stays in the bind pose
+    } else if (fromTrack >= 0 || (from && track >= 0)) {
+      LocalPose a = {node.bindTranslation, node.bindRotation, node.bindScale};
+      LocalPose b = a;
+      if (fromTrack >= 0) sampleTrack(from->tracks[fromTrack], fromT, a);
+      if (track >= 0) sampleTrack(animation->tracks[track], t, b);
+      nodeTransform = composePose(
+          {glm::mix(a.translation, b.translation, blend),
+           glm::slerp(a.rotation, b.rotation, blend),
+           glm::mix(a.scale, b.scale, blend)});
+    } else if (track >= 0) {
+      LocalPose p = {node.bindTranslation, node.bindRotation, node.bindScale};
+      sampleTrack(animation->tracks[track], t, p);
+      nodeTransform = composePose(p);
+    }
+
+    glm::mat4& globalTransform = globalTransforms[i];
+    if (node.parent < 0)
+      globalTransform = nodeTransform;
+    else
+      mulMat4(globalTransforms[node.parent], nodeTransform, globalTransform);
 
-  glm::mat4 nodeTransform =
-      gfx::ConvertMatrixToGLMFormat(node->mTransformation);
-  // glm::identity<glm::mat4>();
-  if (animation->boneKeys.find(node->mName.C_Str()) !=
-      animation->boneKeys.end()) {
-    // Log::printf(LOG_DEBUG, "Found bonekey for %s", node->mName.C_Str());
-    BoneKeyframe& k = animation->boneKeys[node->mName.C_Str()];
-    if (r_anim.getBool()) nodeTransform = boneTransform(k, anim->currentTime);
+    if (node.boneId >= 0) {
+      glm::mat4 skin;
+      mulMat4(inverseGlobalTransform, globalTransform, skin);
+      mulMat4(skin, node.boneOffset, pose[node.boneId]);
+    }
   }
-  glm::mat4 globalTransform = parentTransform * nodeTransform;
+}
+
+void Model::calcAnimatorTransforms(Animator* anim, bool animate) {
+  int back = anim->front ^ 1;
+  int numBones = std::min(boneCount, MODEL_MAX_BONE_TRANSFORMS);
+  glm::mat4* boneMatrices = anim->boneMatrices[back];
 
-  if (boneInfo.find(node->mName.C_Str()) != boneInfo.end()) {
-    gfx::BoneInfo& info = boneInfo[node->mName.C_Str()];
-    anim->boneMatrices[info.id] =
-        inverseGlobalTransform * globalTransform * info.offset;
+  if (anim->updateRate <= 1) {
+    evaluatePose(anim, animate, boneMatrices);
+  } else {
+    // a key pose every updateRate updates, with the ones in between lerping
+    // towards it. this shows the pose one key late, which isn't noticeable
+    // at the distances update rate LOD is used
+    if (anim->framesSinceUpdate < 0 ||
+        anim->framesSinceUpdate >= anim->updateRate) {
+      bool first = anim->framesSinceUpdate < 0;
+      anim->latestKeyPose ^= 1;
+      glm::mat4* latest = anim->keyPoses[anim->latestKeyPose];
+      evaluatePose(anim, animate, latest);
+      if (first)
+        std::copy(latest, latest + numBones,
+                  anim->keyPoses[anim->latestKeyPose ^ 1]);
+      anim->framesSinceUpdate = 0;
+    }
+    anim->framesSinceUpdate++;
+
+    float fac = (float)anim->framesSinceUpdate / anim->updateRate;
+    glm::mat4* previous = anim->keyPoses[anim->latestKeyPose ^ 1];
+    glm::mat4* latest = anim->keyPoses[anim->latestKeyPose];
+    for (int i = 0; i < numBones; i++)
+      for (int c = 0; c < 4; c++)
+        boneMatrices[i][c] = glm::mix(previous[i][c], latest[i][c], fac);
   }
 
-  for (int i = 0; i < node->mNumChildren; i++)
-    calcAnimatorTransforms(node->mChildren[i], anim, globalTransform);
+  anim->numBones = numBones;
+  anim->front = back;
+  anim->dirty = true;
 }
 
 void Model::Animator::upload(gfx::BaseProgram* program) {
-  if (boneUniformBuffer) {
-    boneUniformBuffer->uploadSub(0, sizeof(boneMatrices), boneMatrices);
+  if (boneUniformBuffer[0]) {
+    // only a new pose is copied, and only the bones the model has
+    if (dirty.exchange(false)) {
+      currentBuffer ^= 1;
+      boneUniformBuffer[currentBuffer]->uploadSub(
+          0, numBones * sizeof(glm::mat4), boneMatrices[front]);
+    }
     program->setParameter(
         "BoneTransformBlock", gfx::DtBuffer,
-        {.buffer = {.slot = 1, .buffer = boneUniformBuffer.get()}});
+        {.buffer = {.slot = 1,
+                    .buffer = boneUniformBuffer[currentBuffer].get()}});
   } else {
     throw std::runtime_error("Call Animator::initBuffer");
     /*for (int i = 0; i < MODEL_MAX_BONE_TRANSFORMS; i++)
@@ -564,70 +1367,60 @@ Model::Animation* Model::getAnimation(std::string name) {
   }
 }
 
-int Model::positionIdx(BoneKeyframe k, float t) const {
-  for (int i = 0; i < k.translations.size() - 1; ++i)
-    if (t < k.translations[i + 1].timestamp) return i;
-  throw std::runtime_error("");
+size_t Model::Track::getBytes() const {
+  return (translationTimes.size() + rotationTimes.size() + scaleTimes.size()) *
+             sizeof(float) +
+         (translations.size() + scales.size()) * sizeof(glm::vec3) +
+         rotations.size() * sizeof(glm::quat);
 }
 
-int Model::rotationIdx(BoneKeyframe k, float t) const {
-  for (int i = 0; i < k.rotations.size() - 1; ++i)
-    if (t < k.rotations[i + 1].timestamp) return i;
-  throw std::runtime_error("");
+// the key at or before t and how far t is towards the next one. times
+// outside the track clamp to its first and last key
+static inline int findKey(const std::vector<float>& times, float t,
+                          float& fac) {
+  auto next = std::upper_bound(times.begin(), times.end(), t);
+  fac = 0.f;
+  if (next == times.begin()) return 0;
+  if (next == times.end()) return times.size() - 1;
+  int key = next - times.begin() - 1;
+  fac = (t - times[key]) / (times[key + 1] - times[key]);
+  return key;
 }
 
-int Model::scaleIdx(BoneKeyframe k, float t) const {
-  for (int i = 0; i < k.scales.size() - 1; ++i)
-    if (t < k.scales[i + 1].timestamp) return i;
-  throw std::runtime_error("");
+static inline void sampleVec3(const std::vector<float>& times,
+                              const std::vector<glm::vec3>& values, float t,
+                              glm::vec3& out) {
+  if (values.empty()) return;
+  float fac;
+  int key = findKey(times, t, fac);
+  out = fac == 0.f ? values[key] : glm::mix(values[key], values[key + 1], fac);
 }
 
-static inline float scale_factor(float last_t, float next_t, float t) {
-  return (t - last_t) / (next_t - last_t);
+static inline void sampleQuat(const std::vector<float>& times,
+                              const std::vector<glm::quat>& values, float t,
+                              glm::quat& out) {
+  if (values.empty()) return;
+  float fac;
+  int key = findKey(times, t, fac);
+  out = glm::normalize(fac == 0.f
+                           ? values[key]
+                           : glm::slerp(values[key], values[key + 1], fac));
 }
 
-glm::mat4 Model::interpPosition(BoneKeyframe k, float t) const {
-  if (k.translations.size() == 1) {
-    return glm::translate(glm::identity<glm::mat4>(),
-                          k.translations[0].position);
-  }
-
-  int p0i = positionIdx(k, t);
-  int p1i = p0i + 1;
-  float fac = scale_factor(k.translations[p0i].timestamp,
-                           k.translations[p1i].timestamp, t);
-  glm::vec3 position =
-      glm::mix(k.translations[p0i].position, k.translations[p1i].position, fac);
-  return glm::translate(glm::identity<glm::mat4>(), position);
-}
-
-glm::mat4 Model::interpRotation(BoneKeyframe k, float t) const {
-  if (k.rotations.size() == 1) {
-    return glm::toMat4(glm::normalize(k.rotations[0].quat));
-  }
-
-  int p0i = rotationIdx(k, t);
-  int p1i = p0i + 1;
-  float fac =
-      scale_factor(k.rotations[p0i].timestamp, k.rotations[p1i].timestamp, t);
-  glm::quat rotation =
-      glm::slerp(k.rotations[p0i].quat, k.rotations[p1i].quat, fac);
-  return glm::toMat4(glm::normalize(rotation));
-}
-
-glm::mat4 Model::interpScale(BoneKeyframe k, float t) const {
-  if (k.scales.size() == 1) {
-    return glm::scale(glm::identity<glm::mat4>(), k.scales[0].scale);
-  }
-
-  int p0i = scaleIdx(k, t);
-  int p1i = p0i + 1;
-  float fac = scale_factor(k.scales[p0i].timestamp, k.scales[p1i].timestamp, t);
-  glm::vec3 size = glm::mix(k.scales[p0i].scale, k.scales[p1i].scale, fac);
-  return glm::scale(glm::identity<glm::mat4>(), size);
+// channels without keys keep whatever pose already holds
+static void sampleTrack(const Model::Track& track, float t, LocalPose& pose) {
+  sampleVec3(track.translationTimes, track.translations, t, pose.translation);
+  sampleQuat(track.rotationTimes, track.rotations, t, pose.rotation);
+  sampleVec3(track.scaleTimes, track.scales, t, pose.scale);
 }
 
-glm::mat4 Model::boneTransform(BoneKeyframe k, float t) const {
-  return interpPosition(k, t) * interpRotation(k, t) * interpScale(k, t);
+// translate * rotate * scale, without the two matrix products
+static glm::mat4 composePose(const LocalPose& pose) {
+  glm::mat4 m = glm::toMat4(pose.rotation);
+  m[0] *= pose.scale.x;
+  m[1] *= pose.scale.y;
+  m[2] *= pose.scale.z;
+  m[3] = glm::vec4(pose.translation, 1.f);
+  return m;
 }
 }  // namespace rdm::resource
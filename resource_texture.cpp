@@ -2,7 +2,11 @@
 #include <unicode/unistr.h>
 #include <unicode/ustream.h>
 
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include <filesystem>
+#include <string_view>
 
 #include "gfx/base_types.hpp"
 #include "gfx/engine.hpp"
@@ -16,75 +20,275 @@ Texture::Texture(ResourceManager* manager, std::string name)
   textureSettings.minFiltering = gfx::BaseTexture::Linear;
   textureSettings.maxFiltering = gfx::BaseTexture::Linear;
   handler = Unloaded;
-  textureData = NULL;
-}
-
-Texture::~Texture() {
-  switch (Unloaded) {
-    case Ktx2:
-
-      break;
-    case Stbi:
-      stbi_image_free((stbi_uc*)textureData);
-      break;
-    default:
-      break;
-  }
+  format = gfx::BaseTexture::RGBA;
+  residentLevel = 0;
+  wantedLevel = 0;
+  requestedLevel = INT_MAX;
+  streamed = false;
+  alias = NULL;
+  width = 0;
+  height = 0;
+  channels = 0;
 }
 
 void Texture::gfxDelete() {
   std::scoped_lock l(m);
   texture.reset();
+  setGpuBytes(0);
 }
 
-void Texture::gfxUpload(gfx::Engine* engine) {
+void Texture::evict() {
+  BaseGfxResource::evict();
+
+  // the decoded image goes too, it's read from disk again when touched
   std::scoped_lock l(m);
+  levels.clear();
+  mipData = std::vector<unsigned char>();
+  ktx2Data = std::vector<unsigned char>();
+  handler = Unloaded;
+  residentLevel = 0;
+  setCpuBytes(0);
+  setDataReady(false);
+}
 
-  gfx::BaseTexture::Format fmt;
-  switch (channels) {
-    case 3:
-      fmt = gfx::BaseTexture::RGB;
-      break;
-    case 4:
-      fmt = gfx::BaseTexture::RGBA;
-      break;
-    default:
-      return;
+void Texture::uploadLevels(int level) {
+  texture->upload2dMips(width, height, format, levels, level);
+  residentLevel = level;
+  // uploads reset the filtering
+  dirtyTextureSettings = true;
+  size_t gpuBytes = 0;
+  for (int i = level; i < levels.size(); i++) gpuBytes += levels[i].size();
+  setGpuBytes(gpuBytes);
+}
+
+void Texture::gfxUpload(gfx::Engine* engine) {
+  std::scoped_lock l(m);
+  if (alias) {
+    setReady();
+    return;
+  }
+  // 1 and 2 channel images only keep their pixels for getPixels, there is
+  // nothing to upload but they shouldn't be queued again every frame
+  if (levels.empty()) {
+    setReady();
+    return;
   }
+
+  // only the mip tail goes up now so the texture can be drawn straight away,
+  // ResourceManager::streamTextures sends the finer levels later
   texture = engine->getDevice()->createTexture();
-  texture->upload2d(width, height, gfx::DtUnsignedByte, fmt, textureData, 4);
+  uploadLevels(getTailLevel());
   setReady();
+
+  if (!streamed) {
+    streamed = true;
+    getResourceManager()->addStreamedTexture(this);
+  }
+}
+
+int Texture::getTailLevel() {
+  int level = 0;
+  while (level < (int)levels.size() - 1 &&
+         std::max(width >> level, height >> level) > RESOURCE_MIP_TAIL)
+    level++;
+  return level;
+}
+
+void Texture::reportScreenSize(float pixels) {
+  if (Texture* content = alias) {
+    content->reportScreenSize(pixels);
+    return;
+  }
+  if (!getReady()) return;
+
+  // the coarsest level that's still at least as big as it's drawn
+  int size = std::max(width, height);
+  int level = 0;
+  while (level < (int)levels.size() - 1 && (size >> (level + 1)) >= pixels)
+    level++;
+
+  int current = requestedLevel;
+  while (level < current &&
+         !requestedLevel.compare_exchange_weak(current, level)) {
+  }
+}
+
+void Texture::latchRequestedLevel() {
+  int level = requestedLevel.exchange(INT_MAX);
+  if (level != INT_MAX) wantedLevel = level;
+}
+
+void Texture::setResidentLevel(int level) {
+  std::scoped_lock l(m);
+  if (!texture || level == residentLevel) return;
+  uploadLevels(level);
+}
+
+void Texture::imguiDebug() {
+  if (Texture* content = alias) {
+    ImGui::Text("Same contents as %s", content->getName().c_str());
+    return;
+  }
+  ImGui::Text("%ix%i, %i levels, tail %i", width, height, (int)levels.size(),
+              getTailLevel());
+  ImGui::Text("Resident level: %i, Wanted level: %i", residentLevel,
+              wantedLevel);
+}
+
+void Texture::generateMips(const unsigned char* image) {
+  int levelCount = 1;
+  while ((std::max(width, height) >> levelCount) > 0) levelCount++;
+
+  size_t total = 0;
+  for (int i = 0; i < levelCount; i++)
+    total += (size_t)std::max(width >> i, 1) * std::max(height >> i, 1) *
+             channels;
+  mipData.resize(total);
+
+  size_t offset = 0;
+  for (int i = 0; i < levelCount; i++) {
+    int w = std::max(width >> i, 1);
+    int h = std::max(height >> i, 1);
+    size_t size = (size_t)w * h * channels;
+    unsigned char* dst = mipData.data() + offset;
+    if (i == 0) {
+      memcpy(dst, image, size);
+    } else {
+      // 2x2 box filter, edges of odd sized levels are repeated
+      const unsigned char* src = levels.back().data();
+      int sw = std::max(width >> (i - 1), 1);
+      int sh = std::max(height >> (i - 1), 1);
+      for (int y = 0; y < h; y++) {
+        const unsigned char* row0 = src + (size_t)std::min(y * 2, sh - 1) *
+                                              sw * channels;
+        const unsigned char* row1 = src + (size_t)std::min(y * 2 + 1, sh - 1) *
+                                              sw * channels;
+        for (int x = 0; x < w; x++) {
+          int x0 = std::min(x * 2, sw - 1) * channels;
+          int x1 = std::min(x * 2 + 1, sw - 1) * channels;
+          for (int c = 0; c < channels; c++)
+            *dst++ = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] +
+                      row1[x1 + c] + 2) >>
+                     2;
+        }
+      }
+      dst = mipData.data() + offset;
+    }
+    levels.push_back(std::span<const unsigned char>(dst, size));
+    offset += size;
+  }
 }
 
 gfx::TextureCache::Info Texture::getInfo() {
+  if (Texture* content = alias) return content->getInfo();
+
   gfx::TextureCache::Info info;
   info.channels = channels;
   info.width = width;
   info.height = height;
   info.data = NULL;
-  switch (info.channels) {
-    case 3:
-      info.format = gfx::BaseTexture::RGB;
+  info.format = format;
+  switch (format) {
+    case gfx::BaseTexture::RGB:
+      info.internalFormat = gfx::BaseTexture::RGB8;
+      break;
+    case gfx::BaseTexture::RGB_S3TC_DXT1:
+      info.internalFormat = gfx::BaseTexture::IF_RGB_S3TC_DXT1;
       break;
-    case 4:
-      info.format = gfx::BaseTexture::RGBA;
+    case gfx::BaseTexture::RGBA_S3TC_DXT5:
+      info.internalFormat = gfx::BaseTexture::IF_RGBA_S3TC_DXT5;
+      break;
+    case gfx::BaseTexture::RGBA_BPTC:
+      info.internalFormat = gfx::BaseTexture::IF_RGBA_BPTC;
       break;
     default:
+      info.internalFormat = gfx::BaseTexture::RGBA8;
       break;
   }
   return info;
 }
 
+unsigned char* Texture::getPixels() {
+  if (Texture* content = alias) return content->getPixels();
+
+  std::scoped_lock l(m);
+  if (handler != Stbi || mipData.empty()) return NULL;
+  return mipData.data();
+}
+
+// a hash match alone could swap one image for another, so the bytes are
+// compared too. the content's file is read again, it doesn't keep it around
+static bool sameContents(Texture* content,
+                         const std::vector<unsigned char>& data) {
+  common::OptionalData other;
+  common::OptionalSpan span =
+      common::FileSystem::singleton()->readFileSpan(content->getName().c_str());
+  if (!span) {
+    other = common::FileSystem::singleton()->readFile(
+        content->getName().c_str());
+    if (other) span = std::span<const unsigned char>(other.value());
+  }
+  return span && span->size() == data.size() &&
+         !memcmp(span->data(), data.data(), data.size());
+}
+
 void Texture::onLoadData(common::OptionalData data) {
   std::scoped_lock l(m);
-  /*icu::UnicodeString ucString(
-      std::filesystem::path(getName()).extension().c_str(), "UTF-8");
-  std::string extension;
-  ucString.toUTF8String(extension);*/
-  std::string extension = "";
+  std::filesystem::path path = getName();
+  levels.clear();
+
+  // files with the same bytes are decoded and uploaded once, whichever
+  // texture got here first holds the data for all of them
+  uint64_t contentHash = std::hash<std::string_view>{}(
+      std::string_view((const char*)data->data(), data->size()));
+  Texture* content =
+      getResourceManager()->findTextureContent(contentHash, this);
+  if (content != this && !sameContents(content, data.value())) {
+    Log::printf(LOG_WARN, "texture %s has the same hash as %s but different "
+                "contents, loading it separately", getName().c_str(),
+                content->getName().c_str());
+    content = this;
+  }
+  alias = content == this ? NULL : content;
+  if (alias) {
+    handler = Unloaded;
+    setCpuBytes(0);
+    return;
+  }
 
-  if (extension == "ktx2") {
+  if (path.extension() == ".ktx2") {
+    ktx2Data = std::move(data.value());
+    if (!ktx2.open(ktx2Data.data(), ktx2Data.size())) {
+      Log::printf(LOG_ERROR, "texture %s is not a KTX2 file we can upload",
+                  getName().c_str());
+      throw std::runtime_error("Texture load failed");
+    }
+
+    const ktx2::Ktx2Header* hdr = ktx2.getHeader();
+    switch (hdr->vkFormat) {
+      case ktx2::VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        format = gfx::BaseTexture::RGB_S3TC_DXT1;
+        channels = 3;
+        break;
+      case ktx2::VK_FORMAT_BC3_UNORM_BLOCK:
+        format = gfx::BaseTexture::RGBA_S3TC_DXT5;
+        channels = 4;
+        break;
+      case ktx2::VK_FORMAT_BC7_UNORM_BLOCK:
+        format = gfx::BaseTexture::RGBA_BPTC;
+        channels = 4;
+        break;
+      default:
+        format = gfx::BaseTexture::RGBA;
+        channels = 4;
+        break;
+    }
+    width = hdr->pixelWidth;
+    height = hdr->pixelHeight;
+    for (uint32_t i = 0; i < hdr->levelCount; i++)
+      levels.push_back(ktx2.getLevel(i));
     handler = Ktx2;
+    setCpuBytes(ktx2Data.size());
   } else {
     handler = Stbi;
 
@@ -97,25 +301,49 @@ void Texture::onLoadData(common::OptionalData data) {
       throw std::runtime_error("Texture load failed");
     }
 
-    textureData = (void*)uc;
+    // anything else never uploads, and draws as the missing texture, but
+    // the pixels are kept for getPixels
+    if (channels == 3 || channels == 4) {
+      format = channels == 4 ? gfx::BaseTexture::RGBA : gfx::BaseTexture::RGB;
+      generateMips(uc);
+    } else {
+      mipData.assign(uc, uc + (size_t)width * height * channels);
+    }
+    stbi_image_free(uc);
+    setCpuBytes(mipData.size());
   }
 }
 
 gfx::BaseTexture* Texture::getTexture() {
-  std::scoped_lock l(m);
-
-  if (texture) {
-    if (dirtyTextureSettings)
-      texture->setFiltering(textureSettings.minFiltering,
-                            textureSettings.maxFiltering);
+  touch();
+  if (Texture* content = alias) {
+    // the gpu texture is shared, so changing the settings here changes them
+    // for every texture with the same contents
+    if (dirtyTextureSettings) {
+      dirtyTextureSettings = false;
+      TextureSettings ts = content->getTextureSettings();
+      if (ts.minFiltering != textureSettings.minFiltering ||
+          ts.maxFiltering != textureSettings.maxFiltering)
+        content->setTextureSettings(textureSettings);
+    }
+    return content->getTexture();
+  }
 
-    m.unlock();
-    return texture.get();
-  } else {
-    if (this == getResourceManager()->getMissingTexture())
-      return NULL;
-    else
-      return getResourceManager()->getMissingTexture()->getTexture();
+  {
+    std::scoped_lock l(m);
+    if (texture) {
+      if (dirtyTextureSettings) {
+        texture->setFiltering(textureSettings.minFiltering,
+                              textureSettings.maxFiltering);
+        dirtyTextureSettings = false;
+      }
+      return texture.get();
+    }
   }
+
+  if (this == getResourceManager()->getMissingTexture())
+    return NULL;
+  else
+    return getResourceManager()->getMissingTexture()->getTexture();
 }
 };  // namespace rdm::resource
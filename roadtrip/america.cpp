@@ -210,7 +210,7 @@ void America::fillLocationInfo() {
         snprintf(txname, 64, "dat6/locations/%i.png", location);
         auto t = getGfxEngine()->getTextureCache()->getOrLoad2d(txname);
         if (!t) rdm::Log::printf(rdm::LOG_ERROR, "No texture %s", txname);
-        info.logo = t ? t.value().second : 0;
+        info.logo = t ? txname : "";
       }
     });
   }
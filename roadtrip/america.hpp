@@ -54,8 +54,8 @@ class America : public rdm::network::Entity {
     std::vector<std::pair<PathType, Location>> connectedLocations;
     glm::ivec2 mapPosition;
 
-    // CLIENT only
-    rdm::gfx::BaseTexture* logo;
+    // CLIENT only, the logo's texture cache path, empty if there is none
+    std::string logo;
   };
 
   std::map<Location, LocationInfo> locationInfo;
@@ -82,9 +82,11 @@ Pawn::Pawn(rdm::network::NetworkManager* manager, rdm::network::EntityId id)
         }
 
         ImGui::Begin("The Sights");
-        if (america->locationInfo[location].logo) {
-          ImGui::Image(america->locationInfo[location].logo->getImTextureId(),
-                       ImVec2(453, 339), {0, 1}, {1, 0});
+        auto logo = getGfxEngine()->getTextureCache()->get(
+            america->locationInfo[location].logo.c_str());
+        if (logo) {
+          ImGui::Image(logo.value().second->getImTextureId(), ImVec2(453, 339),
+                       {0, 1}, {1, 0});
         } else {
           ImGui::Text("Sorry nothing");
         }
@@ -2,16 +2,30 @@
 
 #include <unistd.h>
 
+#include <stdio.h>
+
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <format>
+#include <stdexcept>
 #include <thread>
 
+#ifdef __linux
+#include <errno.h>
+#include <time.h>
+#endif
+
+#include "console.hpp"
 #include "gfx/engine.hpp"
 #include "gfx/gui/ngui.hpp"
 #include "input.hpp"
+#include "json.hpp"
 #include "localization.hpp"
 #include "logging.hpp"
 #include "profiler.hpp"
 #include "settings.hpp"
+#include "world.hpp"
 
 #ifdef __linux
 #include <linux/prctl.h> /* Definition of PR_* constants */
@@ -26,6 +40,13 @@ static size_t schedulerId = 0;
 
 namespace rdm {
 static CVar sched_graph("sched_graph", "0", CVARF_SAVE | CVARF_GLOBAL);
+static CVar sched_framegraph("sched_framegraph", "0",
+                             CVARF_SAVE | CVARF_GLOBAL);
+static CVar sched_fixedstep("sched_fixedstep", "0.0166666666",
+                            CVARF_SAVE | CVARF_GLOBAL);
+static CVar sched_maxsteps("sched_maxsteps", "5", CVARF_SAVE | CVARF_GLOBAL);
+static CVar sched_pacing("sched_pacing", "1", CVARF_SAVE | CVARF_GLOBAL);
+static CVar sched_spinus("sched_spinus", "500", CVARF_SAVE | CVARF_GLOBAL);
 std::map<std::thread::id, std::string> __threadNames = {};
 
 class SchedulerGraphGui : public gfx::gui::NGui {
@@ -45,7 +66,7 @@ class SchedulerGraphGui : public gfx::gui::NGui {
     Scheduler* scheduler = getGame()->getWorld()->getScheduler();
     int yoff = 480;
     for (auto& job : scheduler->jobs) {
-      JobStatistics stats = job->getStats();
+      JobStatistics& stats = job->getStats();
       float frameTime = job->getFrameRate();
       float frameDelta = stats.totalDeltaTime;
       float framePctg = frameDelta / frameTime;
@@ -60,8 +81,10 @@ class SchedulerGraphGui : public gfx::gui::NGui {
       renderer->image(getEngine()->getWhiteTexture(), glm::vec2(200, yoff),
                       glm::vec2(framePctgT * 200.f, szy));
       renderer->setColor(glm::vec3(1.f));
-      renderer->text(glm::ivec2(200, yoff), font, 0, "Dt: %.4f, Fps: %.2f",
-                     frameDelta, 1.0 / frameDelta);
+      renderer->text(glm::ivec2(200, yoff), font, 0,
+                     "Dt: %.4f, Fps: %.2f, Jitter: %.3fms", frameDelta,
+                     1.0 / frameDelta,
+                     sqrt(stats.getDeltaTimeVariance()) * 1000.0);
       yoff -= szy;
     }
   }
@@ -69,17 +92,26 @@ class SchedulerGraphGui : public gfx::gui::NGui {
 
 NGUI_INSTANTIATOR(SchedulerGraphGui);
 
-Scheduler::Scheduler() { this->id = schedulerId++; }
+Scheduler::Scheduler() {
+  this->id = schedulerId++;
+  mode = sched_framegraph.getBool() ? FrameGraphMode : ThreadedMode;
+}
 Scheduler::~Scheduler() { waitToWrapUp(); }
 
 void Scheduler::imguiDebug() {
   for (auto& job : jobs) {
-    JobStatistics stats = job->getStats();
+    JobStatistics& stats = job->getStats();
     ImGui::Text("Job %s", stats.name);
     ImGui::Text("S: %i, T: %0.2f", stats.schedulerId, stats.time);
     ImGui::Text("Total DT: %0.8f", stats.totalDeltaTime);
     ImGui::Text("DT: %0.8f", stats.deltaTime);
     ImGui::Text("Expected DT: %0.8f", job->getFrameRate());
+    ImGui::Text("Jitter: %0.8f, Lateness: %0.8f",
+                sqrt(stats.getDeltaTimeVariance()), stats.lateness);
+    ImGui::Text("P50: %0.8f, P95: %0.8f, P99: %0.8f, Max: %0.8f",
+                stats.histogram.getPercentile(0.5),
+                stats.histogram.getPercentile(0.95),
+                stats.histogram.getPercentile(0.99), stats.histogram.getMax());
     ImGui::Separator();
   }
 }
@@ -89,6 +121,7 @@ void Scheduler::waitToWrapUp() {
     job->stopBlocking();
     if (job->getThread().joinable()) job->getThread().join();
   }
+  if (frameGraph) frameGraph->stop();
 }
 
 SchedulerJob* Scheduler::addJob(SchedulerJob* job) {
@@ -98,7 +131,22 @@ SchedulerJob* Scheduler::addJob(SchedulerJob* job) {
 }
 
 void Scheduler::startAllJobs() {
-  for (int i = 0; i < jobs.size(); i++) jobs[i]->startTask();
+  if (mode == ThreadedMode) {
+    for (int i = 0; i < jobs.size(); i++) jobs[i]->startTask();
+    return;
+  }
+
+  std::vector<SchedulerJob*> phased;
+  for (int i = 0; i < jobs.size(); i++) {
+    if (jobs[i]->getPhase() == SchedulerJob::Unphased)
+      jobs[i]->startTask();
+    else
+      phased.push_back(jobs[i].get());
+  }
+
+  frameGraph.reset(new FrameGraph(this));
+  frameGraph->build(phased);
+  frameGraph->start();
 }
 
 SchedulerJob::SchedulerJob(const char* name, bool stopOnCancel)
@@ -110,20 +158,147 @@ SchedulerJob::SchedulerJob(const char* name, bool stopOnCancel)
 
 SchedulerJob::~SchedulerJob() { stopBlocking(); }
 
+FrameTimeHistogram::FrameTimeHistogram() { reset(); }
+
+void FrameTimeHistogram::reset() {
+  for (int i = 0; i < SCHEDULER_HISTOGRAM_BUCKETS; i++) counts[i] = 0;
+  count = 0;
+  sum = 0.0;
+  min = 0.0;
+  max = 0.0;
+}
+
+size_t FrameTimeHistogram::bucketIndex(uint64_t us) {
+  if (us < 16) return us;
+  int msb = 63 - __builtin_clzll(us);
+  int shift = msb - 3;
+  size_t index = 16 + (shift - 1) * 8 + ((us >> shift) - 8);
+  return std::min(index, (size_t)SCHEDULER_HISTOGRAM_BUCKETS - 1);
+}
+
+double FrameTimeHistogram::bucketValue(size_t index) {
+  if (index < 16) return index / 1000000.0;
+  int shift = (index - 16) / 8 + 1;
+  uint64_t sub = (index - 16) % 8 + 8;
+  // middle of the bucket
+  return ((sub << shift) + ((1ull << shift) >> 1)) / 1000000.0;
+}
+
+void FrameTimeHistogram::record(double dt) {
+  uint64_t us = dt > 0.0 ? (uint64_t)(dt * 1000000.0) : 0;
+  counts[bucketIndex(us)]++;
+  if (count == 0 || dt < min) min = dt;
+  if (count == 0 || dt > max) max = dt;
+  sum += dt;
+  count++;
+}
+
+double FrameTimeHistogram::getPercentile(double p) {
+  if (count == 0) return 0.0;
+  size_t target = std::max((size_t)1, (size_t)ceil(p * count));
+  size_t seen = 0;
+  for (int i = 0; i < SCHEDULER_HISTOGRAM_BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= target) return std::clamp(bucketValue(i), min, max);
+  }
+  return max;
+}
+
+void JobStatistics::resetSamples() {
+  for (int i = 0; i < SCHEDULER_TIME_SAMPLES; i++) deltaTimeSamples[i] = 0.0;
+  deltaTimeHead = 0;
+  deltaTimeSum = 0.0;
+  deltaTimeSquareSum = 0.0;
+  histogram.reset();
+}
+
 void JobStatistics::addDeltaTimeSample(double dt) {
-  for (int i = 0; i < SCHEDULER_TIME_SAMPLES - 1; i++) {
-    deltaTimeSamples[i] = deltaTimeSamples[i + 1];
+  double old = deltaTimeSamples[deltaTimeHead];
+  deltaTimeSamples[deltaTimeHead] = dt;
+  deltaTimeHead = (deltaTimeHead + 1) % SCHEDULER_TIME_SAMPLES;
+  if (deltaTimeHead == 0) {
+    // resum once per window so rounding errors don't pile up
+    deltaTimeSum = 0.0;
+    deltaTimeSquareSum = 0.0;
+    for (int i = 0; i < SCHEDULER_TIME_SAMPLES; i++) {
+      deltaTimeSum += deltaTimeSamples[i];
+      deltaTimeSquareSum += deltaTimeSamples[i] * deltaTimeSamples[i];
+    }
+  } else {
+    deltaTimeSum += dt - old;
+    deltaTimeSquareSum += dt * dt - old * old;
   }
-  // memcpy(deltaTimeSamples, &deltaTimeSamples[1],
-  //      sizeof(double) * (SCHEDULER_TIME_SAMPLES - 1));
-  deltaTimeSamples[SCHEDULER_TIME_SAMPLES - 1] = dt;
+  histogram.record(dt);
 }
 
 double JobStatistics::getAvgDeltaTime() {
-  double avg = 0.0;
-  for (int i = 0; i < SCHEDULER_TIME_SAMPLES; i++) avg += deltaTimeSamples[i];
-  avg /= SCHEDULER_TIME_SAMPLES;
-  return avg;
+  return deltaTimeSum / SCHEDULER_TIME_SAMPLES;
+}
+
+double JobStatistics::getDeltaTimeVariance() {
+  double avg = getAvgDeltaTime();
+  return std::max(0.0, deltaTimeSquareSum / SCHEDULER_TIME_SAMPLES - avg * avg);
+}
+
+FramePacer::FramePacer() {
+  spin = 0.0;
+  oversleep = 0.0;
+  lateness = 0.0;
+  first = true;
+}
+
+static void sleepUntil(std::chrono::steady_clock::time_point until) {
+#ifdef __linux
+  // steady_clock is CLOCK_MONOTONIC on linux
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                until.time_since_epoch())
+                .count();
+  struct timespec ts;
+  ts.tv_sec = ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+#else
+  std::this_thread::sleep_until(until);
+#endif
+}
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+void FramePacer::wait(double frameRate) {
+  using namespace std::chrono;
+  steady_clock::time_point now = steady_clock::now();
+  if (first) {
+    next = now;
+    first = false;
+  }
+
+  next += duration_cast<steady_clock::duration>(duration<double>(frameRate));
+  if (next <= now) {
+    // more than a frame behind, resync instead of running a burst of frames
+    lateness = duration<double>(now - next).count();
+    next = now;
+    return;
+  }
+
+  steady_clock::time_point wakeAt =
+      next - duration_cast<steady_clock::duration>(duration<double>(spin));
+  if (wakeAt > now) {
+    sleepUntil(wakeAt);
+    double late = duration<double>(steady_clock::now() - wakeAt).count();
+    oversleep = oversleep * 0.9 + late * 0.1;
+    double maxSpin = sched_spinus.getFloat() / 1000000.0;
+    spin = std::clamp(oversleep * 2.0 + 0.00002, 0.0, maxSpin);
+  }
+
+  while (steady_clock::now() < next) cpuRelax();
+  lateness = duration<double>(steady_clock::now() - next).count();
 }
 
 void SchedulerJob::task(SchedulerJob* job) {
@@ -139,8 +314,9 @@ void SchedulerJob::task(SchedulerJob* job) {
 #endif
   job->osPid = getpid();
   job->stats.time = 0.0;
-  for (int i = 0; i < SCHEDULER_TIME_SAMPLES; i++)
-    job->stats.deltaTimeSamples[i] = 0.0;
+  job->stats.lateness = 0.0;
+  job->stats.resetSamples();
+  FramePacer pacer;
   bool running = true;
   Log::printf(LOG_DEBUG, "Starting job %s/%i", job->getStats().name,
               job->getStats().schedulerId);
@@ -149,69 +325,35 @@ void SchedulerJob::task(SchedulerJob* job) {
     std::chrono::time_point start = std::chrono::steady_clock::now();
     job->profiler.frame();
 
-    Result r;
-    try {
-      r = job->step();
-    } catch (std::exception& e) {
-      Log::printf(LOG_FATAL,
-                  "Fatal unhandled exception in %s/%i, what() = '%s'",
-                  job->getStats().name, job->getStats().schedulerId, e.what());
-      r = Cancel;
-
-      try {
-        job->error(e);
-      } catch (std::exception& e) {
-        Log::printf(LOG_FATAL,
-                    "Double error in SchedulerJob error handler, what() = '%s'",
-                    e.what());
-      }
-
-      Log::printf(LOG_DEBUG, "Sending quit object to Input queue");
-      InputObject quitObject{.type = InputObject::Quit};
-      Input::singleton()->postEvent(quitObject);
-    }
-
-    switch (r) {
-      case Stepped:
-        break;
-      case Cancel:
-        job->state = Stopped;
-        break;
-    }
-
-    switch (job->state) {
-      case Running:
-      default:
-        break;
-      case StopPlease:
-        if (job->stopOnCancel) {
-          running = false;
-          job->state = Stopped;
-        }
-        break;
-      case Stopped:
-        running = false;
-        job->state = Stopped;
-        break;
-    }
+    running = job->handleResult(job->runStep());
 
     double frameRate = job->getFrameRate();
     std::chrono::time_point end = std::chrono::steady_clock::now();
     std::chrono::duration execution = end - start;
     if (frameRate != 0.0) {  // run as fast as we can if there is no frame rate
       job->profiler.fun("sleep");
-      std::chrono::duration sleep =
-          std::chrono::duration<double>(frameRate) - execution -
-          std::chrono::duration<double>(frameRate * 0.00599999999999);
-      std::chrono::time_point until = end + sleep;
-      if (job->stopOnCancel) {
-        if (job->killMutex.try_lock_until(until)) {
-          running = false;
-        }
+      if (sched_pacing.getBool()) {
+        pacer.wait(frameRate);
+        job->stats.lateness = pacer.getLateness();
+        // stopBlocking unlocks killMutex, we notice it at most a frame late
+        if (job->stopOnCancel && job->killMutex.try_lock()) running = false;
       } else {
-        std::this_thread::sleep_until(until);
+        pacer.reset();
+        std::chrono::duration sleep =
+            std::chrono::duration<double>(frameRate) - execution -
+            std::chrono::duration<double>(frameRate * 0.00599999999999);
+        std::chrono::time_point until = end + sleep;
+        if (job->stopOnCancel) {
+          if (job->killMutex.try_lock_until(until)) {
+            running = false;
+          }
+        } else {
+          std::this_thread::sleep_until(until);
+        }
       }
       job->profiler.end();
+    } else {
+      pacer.reset();
     }
     job->stats.deltaTime = std::chrono::duration<double>(execution).count();
     end = std::chrono::steady_clock::now();
@@ -228,6 +370,52 @@ void SchedulerJob::task(SchedulerJob* job) {
               Lc(RDM_SCHED_JOB_STOPPED, "It hopes to see you soon."));
 }
 
+SchedulerJob::Result SchedulerJob::runStep() {
+  try {
+    return step();
+  } catch (std::exception& e) {
+    Log::printf(LOG_FATAL, "Fatal unhandled exception in %s/%i, what() = '%s'",
+                getStats().name, getStats().schedulerId, e.what());
+
+    try {
+      error(e);
+    } catch (std::exception& e) {
+      Log::printf(LOG_FATAL,
+                  "Double error in SchedulerJob error handler, what() = '%s'",
+                  e.what());
+    }
+
+    Log::printf(LOG_DEBUG, "Sending quit object to Input queue");
+    InputObject quitObject{.type = InputObject::Quit};
+    Input::singleton()->postEvent(quitObject);
+    return Cancel;
+  }
+}
+
+bool SchedulerJob::handleResult(Result r) {
+  switch (r) {
+    case Stepped:
+      break;
+    case Cancel:
+      state = Stopped;
+      break;
+  }
+
+  switch (state) {
+    case Running:
+    default:
+      return true;
+    case StopPlease:
+      if (stopOnCancel) {
+        state = Stopped;
+        return false;
+      }
+      return true;
+    case Stopped:
+      return false;
+  }
+}
+
 void SchedulerJob::startTask() {
   thread = std::thread(&SchedulerJob::task, this);
 }
@@ -242,7 +430,7 @@ void SchedulerJob::stopBlocking() {
     while (state != Stopped) {
       std::this_thread::sleep_for(std::chrono::milliseconds(2));
     }
-    thread.join();
+    if (thread.joinable()) thread.join();
   }
 }
 
@@ -251,4 +439,378 @@ SchedulerJob* Scheduler::getJob(std::string name) {
     if (jobs[i]->getStats().name == name) return jobs[i].get();
   return nullptr;
 }
+
+FrameGraph::FrameGraph(Scheduler* scheduler) {
+  this->scheduler = scheduler;
+  tick = 0;
+  running = false;
+  poolStep = 0.0;
+  poolPending = 0;
+  poolStopping = false;
+}
+
+FrameGraph::~FrameGraph() { stop(); }
+
+void FrameGraph::build(std::vector<SchedulerJob*> jobs) {
+  this->jobs = jobs;
+  stages.clear();
+
+  // stable sort keeps insertion order inside a phase, so the graph is the same
+  // every run
+  std::stable_sort(jobs.begin(), jobs.end(),
+                   [](SchedulerJob* a, SchedulerJob* b) {
+                     return a->getPhase() < b->getPhase();
+                   });
+
+  size_t i = 0;
+  while (i < jobs.size()) {
+    SchedulerJob::Phase phase = jobs[i]->getPhase();
+    std::vector<SchedulerJob*> remaining;
+    while (i < jobs.size() && jobs[i]->getPhase() == phase)
+      remaining.push_back(jobs[i++]);
+
+    while (remaining.size()) {
+      std::vector<SchedulerJob*> stage;
+      for (auto job : remaining) {
+        bool ready = true;
+        for (auto& dependency : job->getDependencies()) {
+          for (auto other : remaining) {
+            if (other != job && dependency == other->getStats().name) {
+              ready = false;
+              break;
+            }
+          }
+          if (!ready) break;
+        }
+        if (ready) stage.push_back(job);
+      }
+
+      if (stage.empty()) {
+        Log::printf(LOG_ERROR,
+                    "Dependency cycle in frame graph phase %i, running "
+                    "remaining jobs in insertion order",
+                    phase);
+        for (auto job : remaining) stages.push_back({job});
+        break;
+      }
+
+      for (auto job : stage)
+        remaining.erase(std::find(remaining.begin(), remaining.end(), job));
+      stages.push_back(stage);
+    }
+  }
+
+  for (auto job : jobs) {
+    for (auto& dependency : job->getDependencies()) {
+      SchedulerJob* other = scheduler->getJob(dependency);
+      if (other && other->getPhase() > job->getPhase())
+        Log::printf(LOG_WARN,
+                    "Job %s depends on %s which runs in a later phase",
+                    job->getStats().name, other->getStats().name);
+    }
+  }
+
+  size_t widest = 0;
+  for (auto& stage : stages) widest = std::max(widest, stage.size());
+
+  std::string order;
+  for (auto& stage : stages) {
+    if (!order.empty()) order += " -> ";
+    for (int j = 0; j < stage.size(); j++) {
+      if (j) order += "|";
+      order += stage[j]->getStats().name;
+    }
+  }
+  Log::printf(LOG_DEBUG, "Frame graph %i: %s", scheduler->getId(),
+              order.c_str());
+
+  for (size_t j = 1; j < widest; j++)
+    workers.push_back(std::thread(&FrameGraph::worker, this));
+}
+
+void FrameGraph::start() {
+  running = true;
+  thread = std::thread(&FrameGraph::task, this);
+}
+
+void FrameGraph::stop() {
+  if (running) {
+    running = false;
+    sleepCondition.notify_all();
+  }
+  if (thread.joinable()) thread.join();
+
+  {
+    std::scoped_lock l(poolMutex);
+    poolStopping = true;
+  }
+  poolWake.notify_all();
+  for (auto& worker : workers)
+    if (worker.joinable()) worker.join();
+  workers.clear();
+}
+
+void FrameGraph::worker() {
+  while (true) {
+    SchedulerJob* job;
+    double step;
+    {
+      std::unique_lock l(poolMutex);
+      poolWake.wait(l, [this] { return poolStopping || poolQueue.size(); });
+      if (poolStopping) return;
+      job = poolQueue.back();
+      poolQueue.pop_back();
+      step = poolStep;
+    }
+
+    stepJob(job, step);
+
+    {
+      std::scoped_lock l(poolMutex);
+      poolPending--;
+    }
+    poolDone.notify_all();
+  }
+}
+
+bool FrameGraph::jobDue(SchedulerJob* job, double step) {
+  // jobs slower than the fixed step run every n-th tick
+  double frameRate = job->getFrameRate();
+  size_t every = 1;
+  if (frameRate > step) every = (size_t)std::round(frameRate / step);
+  return tick % every == 0;
+}
+
+void FrameGraph::stepJob(SchedulerJob* job, double step) {
+  if (job->state == SchedulerJob::Stopped) return;
+
+  double frameRate = job->getFrameRate();
+  double simulated = step;
+  if (frameRate > step) simulated = std::round(frameRate / step) * step;
+
+  std::chrono::time_point start = std::chrono::steady_clock::now();
+  job->profiler.frame();
+  bool jobRunning = job->handleResult(job->runStep());
+  std::chrono::duration execution = std::chrono::steady_clock::now() - start;
+
+  job->stats.deltaTime = std::chrono::duration<double>(execution).count();
+  job->stats.totalDeltaTime = simulated;
+  job->stats.time += simulated;
+  job->stats.addDeltaTimeSample(simulated);
+
+  if (!jobRunning) {
+    job->shutdown();
+    job->state = SchedulerJob::Stopped;
+    Log::printf(LOG_DEBUG, "Task %s/%i stopped. %s", job->getStats().name,
+                job->getStats().schedulerId,
+                Lc(RDM_SCHED_JOB_STOPPED, "It hopes to see you soon."));
+  }
+}
+
+void FrameGraph::runStage(std::vector<SchedulerJob*>& stage, double step) {
+  std::vector<SchedulerJob*> due;
+  for (auto job : stage)
+    if (job->state != SchedulerJob::Stopped && jobDue(job, step))
+      due.push_back(job);
+  if (due.empty()) return;
+
+  if (due.size() > 1) {
+    {
+      std::scoped_lock l(poolMutex);
+      poolStep = step;
+      for (size_t i = due.size() - 1; i > 0; i--) poolQueue.push_back(due[i]);
+      poolPending = due.size() - 1;
+    }
+    poolWake.notify_all();
+  }
+
+  stepJob(due[0], step);
+
+  if (due.size() > 1) {
+    std::unique_lock l(poolMutex);
+    poolDone.wait(l, [this] { return poolPending == 0; });
+  }
+}
+
+void FrameGraph::task() {
+#ifndef NDEBUG
+#ifdef __linux
+  std::string threadName =
+      "FrameGraph/" + std::to_string(scheduler->getId());
+  __threadNames[std::this_thread::get_id()] = threadName;
+  pthread_setname_np(pthread_self(), threadName.c_str());
+#endif
+#endif
+
+  for (auto job : jobs) {
+    job->osPid = getpid();
+    job->stats.time = 0.0;
+    job->stats.lateness = 0.0;
+    job->stats.resetSamples();
+    Log::printf(LOG_DEBUG, "Starting job %s/%i (frame graph)",
+                job->getStats().name, job->getStats().schedulerId);
+    job->startup();
+  }
+
+  double accumulator = 0.0;
+  std::chrono::time_point last = std::chrono::steady_clock::now();
+  while (running) {
+    // a zero or negative step would never advance and jobDue divides by it
+    double step = sched_fixedstep.getFloat();
+    if (!(step >= SCHEDULER_MIN_FIXED_STEP)) step = SCHEDULER_MIN_FIXED_STEP;
+    int maxSteps = std::max(1, sched_maxsteps.getInt());
+
+    std::chrono::time_point now = std::chrono::steady_clock::now();
+    accumulator += std::chrono::duration<double>(now - last).count();
+    last = now;
+
+    int steps = 0;
+    while (accumulator >= step && steps < maxSteps) {
+      for (auto& stage : stages) runStage(stage, step);
+      accumulator -= step;
+      tick++;
+      steps++;
+    }
+    // drop the backlog instead of spiralling when we can't keep up
+    if (steps == maxSteps) accumulator = std::min(accumulator, step);
+
+    bool anyRunning = false;
+    for (auto job : jobs)
+      if (job->state != SchedulerJob::Stopped) anyRunning = true;
+    if (!anyRunning) break;
+
+    std::unique_lock l(sleepMutex);
+    sleepCondition.wait_until(
+        l, last + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::duration<double>(step - accumulator)),
+        [this] { return !running; });
+  }
+
+  for (auto job : jobs) {
+    if (job->state != SchedulerJob::Stopped) {
+      job->shutdown();
+      job->state = SchedulerJob::Stopped;
+    }
+  }
+  running = false;
+}
+
+using json = nlohmann::json;
+
+static std::vector<std::pair<const char*, Scheduler*>> getMetricsSchedulers(
+    Game* game) {
+  std::vector<std::pair<const char*, Scheduler*>> schedulers;
+  if (game->getWorld())
+    schedulers.push_back({"client", game->getWorld()->getScheduler()});
+  if (game->getServerWorld())
+    schedulers.push_back({"server", game->getServerWorld()->getScheduler()});
+  return schedulers;
+}
+
+static json getSchedulerMetrics(Game* game) {
+  json j = json::object();
+  for (auto [world, scheduler] : getMetricsSchedulers(game)) {
+    json jobs = json::array();
+    for (auto& job : scheduler->getJobs()) {
+      JobStatistics& stats = job->getStats();
+      json entry;
+      entry["name"] = stats.name;
+      entry["scheduler"] = stats.schedulerId;
+      entry["frame_rate"] = job->getFrameRate();
+      entry["time"] = stats.time;
+      entry["delta_time"] = stats.deltaTime;
+      entry["avg_delta_time"] = stats.getAvgDeltaTime();
+      entry["jitter"] = sqrt(stats.getDeltaTimeVariance());
+      entry["lateness"] = stats.lateness;
+      entry["count"] = stats.histogram.getCount();
+      entry["sum"] = stats.histogram.getSum();
+      entry["mean"] = stats.histogram.getMean();
+      entry["min"] = stats.histogram.getMin();
+      entry["max"] = stats.histogram.getMax();
+      entry["p50"] = stats.histogram.getPercentile(0.5);
+      entry["p95"] = stats.histogram.getPercentile(0.95);
+      entry["p99"] = stats.histogram.getPercentile(0.99);
+      jobs.push_back(entry);
+    }
+    j[world] = jobs;
+  }
+  return j;
+}
+
+static std::string getSchedulerMetricsPrometheus(json metrics) {
+  std::string out;
+  out +=
+      "# HELP rdm_job_frame_seconds Total frame time of a scheduler job, "
+      "including sleep.\n";
+  out += "# TYPE rdm_job_frame_seconds summary\n";
+  for (auto& [world, jobs] : metrics.items()) {
+    for (auto& job : jobs) {
+      std::string labels =
+          std::format("world=\"{}\",job=\"{}\"", world,
+                      job["name"].get<std::string>());
+      for (auto [quantile, key] :
+           {std::pair{"0.5", "p50"}, {"0.95", "p95"}, {"0.99", "p99"}})
+        out += std::format("rdm_job_frame_seconds{{{},quantile=\"{}\"}} {}\n",
+                           labels, quantile, job[key].get<double>());
+      out += std::format("rdm_job_frame_seconds_sum{{{}}} {}\n", labels,
+                         job["sum"].get<double>());
+      out += std::format("rdm_job_frame_seconds_count{{{}}} {}\n", labels,
+                         job["count"].get<size_t>());
+    }
+  }
+
+  const char* gauges[][2] = {
+      {"max", "Longest frame time of a scheduler job."},
+      {"jitter", "Frame time standard deviation over the sample window."},
+      {"lateness", "How late the job woke up compared to its schedule."},
+  };
+  for (auto& [key, help] : gauges) {
+    out += std::format("# HELP rdm_job_{}_seconds {}\n", key, help);
+    out += std::format("# TYPE rdm_job_{}_seconds gauge\n", key);
+    for (auto& [world, jobs] : metrics.items())
+      for (auto& job : jobs)
+        out += std::format("rdm_job_{}_seconds{{world=\"{}\",job=\"{}\"}} {}\n",
+                           key, world, job["name"].get<std::string>(),
+                           job[key].get<double>());
+  }
+  return out;
+}
+
+static ConsoleCommand sched_metrics(
+    "sched_metrics", "sched_metrics [json/prometheus] [path]",
+    "dumps frame time metrics of every scheduler job, prints to the console if "
+    "no path is given",
+    [](Game* game, ConsoleArgReader reader) {
+      std::string format = reader.next();
+      std::string path = reader.next();
+
+      std::string data;
+      json metrics = getSchedulerMetrics(game);
+      if (format == "json" || format.empty())
+        data = metrics.dump(2);
+      else if (format == "prometheus")
+        data = getSchedulerMetricsPrometheus(metrics);
+      else
+        throw std::runtime_error("argument #1 must be json or prometheus");
+
+      if (path.empty()) {
+        Log::printf(LOG_INFO, "%s", data.c_str());
+        return;
+      }
+
+      FILE* out = fopen(path.c_str(), "w");
+      if (!out) throw std::runtime_error("fopen == NULL");
+      fwrite(data.data(), 1, data.size(), out);
+      fclose(out);
+      Log::printf(LOG_INFO, "Wrote scheduler metrics to %s", path.c_str());
+    });
+
+static ConsoleCommand sched_metrics_reset(
+    "sched_metrics_reset", "sched_metrics_reset",
+    "clears the frame time histograms of every scheduler job",
+    [](Game* game, ConsoleArgReader reader) {
+      for (auto [world, scheduler] : getMetricsSchedulers(game))
+        for (auto& job : scheduler->getJobs())
+          job->getStats().histogram.reset();
+    });
 };  // namespace rdm
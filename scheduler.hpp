@@ -1,15 +1,61 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <stdint.h>
+#include <string>
 #include <thread>
 #include <vector>
 
 #include "profiler.hpp"
 
 #define SCHEDULER_TIME_SAMPLES 64
+#define SCHEDULER_HISTOGRAM_BUCKETS 240
+// smallest sched_fixedstep the frame graph will use, in seconds
+#define SCHEDULER_MIN_FIXED_STEP 0.001
 
 namespace rdm {
+/**
+ * @brief Log-linear histogram of frame times.
+ *
+ * Times are bucketed in microseconds. Below 16us every value gets its own
+ * bucket, above that each power of two is split into 8 linear sub-buckets
+ * (like an HDR histogram), so percentiles are within ~6% of the real value.
+ * Recording is O(1) and the histogram never allocates.
+ */
+class FrameTimeHistogram {
+  uint32_t counts[SCHEDULER_HISTOGRAM_BUCKETS];
+  size_t count;
+  double sum;
+  double min;
+  double max;
+
+  static size_t bucketIndex(uint64_t us);
+  static double bucketValue(size_t index);
+
+ public:
+  FrameTimeHistogram();
+
+  void record(double dt);
+  void reset();
+
+  /**
+   * @brief Gets a percentile of the recorded frame times.
+   *
+   * @param p The percentile, from 0.0 to 1.0.
+   * @return double The frame time in seconds.
+   */
+  double getPercentile(double p);
+  double getMin() { return count ? min : 0.0; }
+  double getMax() { return max; }
+  double getMean() { return count ? sum / count : 0.0; }
+  double getSum() { return sum; }
+  size_t getCount() { return count; }
+};
+
 /**
  * @brief Statistics for a specific job.
  *
@@ -36,14 +82,73 @@ struct JobStatistics {
    */
   double time;
   size_t schedulerId;
+  /**
+   * @brief How late the job woke up compared to its frame schedule, in
+   * seconds.
+   *
+   */
+  double lateness;
 
+  /**
+   * @brief Ring buffer of the last SCHEDULER_TIME_SAMPLES total delta times.
+   * The running sums are updated on insertion, so the average and variance are
+   * O(1).
+   *
+   */
   double deltaTimeSamples[SCHEDULER_TIME_SAMPLES];
+  size_t deltaTimeHead;
+  double deltaTimeSum;
+  double deltaTimeSquareSum;
+  /**
+   * @brief Every total delta time since the job started (or since the last
+   * sched_metrics_reset)
+   *
+   */
+  FrameTimeHistogram histogram;
+
+  void resetSamples();
   void addDeltaTimeSample(double dt);
   double getAvgDeltaTime();
+  /**
+   * @brief Variance of the total delta time over the sample window, in
+   * seconds squared. The square root of this is the frame time jitter.
+   *
+   */
+  double getDeltaTimeVariance();
+};
+
+/**
+ * @brief Paces a job against an absolute frame schedule.
+ *
+ * Sleeps with the OS timer (clock_nanosleep with TIMER_ABSTIME on Linux) until
+ * shortly before the deadline, then spins for the rest. The spin window adapts
+ * to how late the OS timer tends to wake us up.
+ */
+class FramePacer {
+  std::chrono::steady_clock::time_point next;
+  double spin;
+  double oversleep;
+  double lateness;
+  bool first;
+
+ public:
+  FramePacer();
+
+  /**
+   * @brief Waits until the next frame deadline.
+   *
+   * @param frameRate The frame period in seconds.
+   */
+  void wait(double frameRate);
+  void reset() { first = true; }
+
+  double getLateness() { return lateness; }
+  double getSpinWindow() { return spin; }
 };
 
 class SchedulerJob {
   friend class SchedulerGraphGui;
+  friend class FrameGraph;
 
   enum State { Running, StopPlease, Stopped };
 
@@ -59,6 +164,8 @@ class SchedulerJob {
 
   bool stopOnCancel;
 
+  std::vector<std::string> dependencies;
+
  public:
   SchedulerJob(const char* name, bool stopOnCancel = true);
   virtual ~SchedulerJob();
@@ -82,6 +189,33 @@ class SchedulerJob {
     Cancel,
   };
 
+  /**
+   * @brief The phase a job runs in when the scheduler is in FrameGraphMode.
+   *
+   * Phased jobs are stepped in this order on a fixed timestep, unphased jobs
+   * keep their own thread.
+   */
+  enum Phase {
+    Unphased,
+    InputPhase,
+    NetworkReceivePhase,
+    PhysicsPhase,
+    WorldTickPhase,
+    NetworkSendPhase,
+    RenderExtractPhase,
+  };
+
+  virtual Phase getPhase() { return Unphased; }
+
+  /**
+   * @brief Makes this job run after the named job within the same phase.
+   *
+   * Only used in FrameGraphMode. Jobs in a phase with no dependency between
+   * them may be stepped in parallel.
+   */
+  void addDependency(std::string jobName) { dependencies.push_back(jobName); }
+  const std::vector<std::string>& getDependencies() { return dependencies; }
+
   /**
    * @brief The frame rate of a job.
    *
@@ -127,6 +261,14 @@ class SchedulerJob {
 
   static void task(SchedulerJob* job);
 
+ private:
+  // runs step() and handles exceptions thrown out of it
+  Result runStep();
+  // applies a step result to the job state, returns false if the job stopped
+  bool handleResult(Result r);
+
+ public:
+
   void startTask();
 
   std::thread& getThread() { return thread; }
@@ -134,11 +276,71 @@ class SchedulerJob {
   pid_t getOsTid() { return osTid; }
 };
 
+class Scheduler;
+
+/**
+ * @brief Steps phased jobs in a deterministic order on a fixed timestep.
+ *
+ * Jobs are grouped into stages by phase and dependency. Stages run one after
+ * the other; jobs inside a stage run in parallel on a small worker pool, with
+ * the first job of every stage always running on the frame graph thread.
+ */
+class FrameGraph {
+  Scheduler* scheduler;
+  std::vector<SchedulerJob*> jobs;
+  std::vector<std::vector<SchedulerJob*>> stages;
+  size_t tick;
+
+  std::thread thread;
+  std::atomic<bool> running;
+  std::mutex sleepMutex;
+  std::condition_variable sleepCondition;
+
+  std::vector<std::thread> workers;
+  std::mutex poolMutex;
+  std::condition_variable poolWake;
+  std::condition_variable poolDone;
+  std::vector<SchedulerJob*> poolQueue;
+  double poolStep;
+  size_t poolPending;
+  bool poolStopping;
+
+  void task();
+  void worker();
+  void runStage(std::vector<SchedulerJob*>& stage, double step);
+  void stepJob(SchedulerJob* job, double step);
+  bool jobDue(SchedulerJob* job, double step);
+
+ public:
+  FrameGraph(Scheduler* scheduler);
+  ~FrameGraph();
+
+  void build(std::vector<SchedulerJob*> jobs);
+  void start();
+  void stop();
+
+  const std::vector<std::vector<SchedulerJob*>>& getStages() { return stages; }
+};
+
 class Scheduler {
   friend class SchedulerGraphGui;
 
+ public:
+  /**
+   * @brief How jobs are run.
+   *
+   * ThreadedMode runs every job on its own thread at its own frame rate.
+   * FrameGraphMode runs phased jobs in order on a fixed timestep (see
+   * FrameGraph) and leaves unphased jobs on their own threads. Selected by the
+   * sched_framegraph cvar when the scheduler is created.
+   */
+  enum Mode { ThreadedMode, FrameGraphMode };
+
+ private:
   size_t id;
+  Mode mode;
   std::vector<std::unique_ptr<SchedulerJob>> jobs;
+  std::unique_ptr<FrameGraph> frameGraph;
 
  public:
   Scheduler();
@@ -156,6 +358,7 @@ class Scheduler {
   SchedulerJob* currentJob();
 
   size_t getId() { return id; }
+  Mode getMode() { return mode; }
 
   void imguiDebug();
 
@@ -164,5 +367,6 @@ class Scheduler {
   void startAllJobs();
 
   SchedulerJob* getJob(std::string name);
+  const std::vector<std::unique_ptr<SchedulerJob>>& getJobs() { return jobs; }
 };
 };  // namespace rdm
@@ -1,7 +1,14 @@
 #include "signal.hpp"
 
+#include <atomic>
+
 namespace rdm {
-static ClosureId lastClosureId = 0;
+static std::atomic<ClosureId> lastClosureId = 0;
 ClosureId __newClosureId() { return lastClosureId++; }
 
+std::vector<const void*>& __firingSignals() {
+  static thread_local std::vector<const void*> firing;
+  return firing;
+}
+
 }  // namespace rdm
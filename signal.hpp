@@ -2,11 +2,16 @@
 #include <cxxabi.h>
 #include <lua.h>
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <lua.hpp>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include "logging.hpp"
 
@@ -18,33 +23,96 @@ class Script;
 typedef size_t ClosureId;
 
 ClosureId __newClosureId();
+// signals the calling thread is firing right now, innermost last
+std::vector<const void*>& __firingSignals();
 
 /**
  * @brief Signals. These are able to be fired, and will execute signal handlers
  * on the firing thread. These are not related to POSIX signals.
  *
+ * Listeners are stored in a contiguous, immutable snapshot which is replaced
+ * (copy-on-write) whenever a listener is added or removed, so firing never
+ * takes the signal's mutex or copies any listener.
+ *
  * @tparam Args The arguments of the signals. These will be required on
  * Signal::fire and can be retrieved on Signal::listen
  */
 template <typename... Args>
 class Signal {
+ public:
+  typedef std::function<void(Args...)> Function;
+
+ private:
+  struct Listener {
+    ClosureId id;
+    Function function;
+  };
+  typedef std::vector<Listener> ListenerList;
+
+  // only serializes writers, fire reads the current snapshot
   std::mutex m;
+  std::atomic<std::shared_ptr<const ListenerList>> listeners;
+  std::vector<Function> pendingClosures;
+  std::atomic<bool> hasPendingClosures;
+
+  // fires in flight, counted by the parity of the epoch they started in.
+  // removeListener bumps the epoch and waits for the old parity to drain, so
+  // nothing still runs a removed listener once it returns
+  std::atomic<uint64_t> epoch;
+  std::atomic<int> inFlight[2];
+
+  // counts a fire in flight and marks it on this thread's firing stack, both
+  // undone however the fire exits
+  class FiringGuard {
+    Signal* signal;
+    uint64_t e;
+
+   public:
+    FiringGuard(Signal* signal) : signal(signal) {
+      // retried if the epoch moved on in between, so removeListener never
+      // misses a fire that could have loaded the old snapshot
+      for (;;) {
+        e = signal->epoch;
+        signal->inFlight[e & 1]++;
+        if (signal->epoch == e) break;
+        signal->inFlight[e & 1]--;
+      }
+      __firingSignals().push_back(signal);
+    }
+    ~FiringGuard() {
+      __firingSignals().pop_back();
+      signal->inFlight[e & 1]--;
+    }
+    FiringGuard(const FiringGuard&) = delete;
+    FiringGuard& operator=(const FiringGuard&) = delete;
+  };
 
  public:
-  typedef std::function<void(Args...)> Function;
+  Signal() : listeners(std::make_shared<const ListenerList>()) {
+    hasPendingClosures = false;
+    epoch = 0;
+    inFlight[0] = 0;
+    inFlight[1] = 0;
+  }
 
   /**
    * @brief Fires the signal.
    *
    * Will execute listeners on the firing thread, so don't rely on the fact that
-   * you may add listeners from different threads.
+   * you may add listeners from different threads. Listeners added or removed
+   * while firing will take effect on the next fire.
    *
    * @param a The arguments to pass to signal listeners.
    */
   void fire(Args... a) {
-    std::scoped_lock l(m);
-    if (pendingClosures.size() != 0) {
-      for (auto closure : pendingClosures) {
+    if (hasPendingClosures) {
+      std::vector<Function> closures;
+      {
+        std::scoped_lock l(m);
+        closures.swap(pendingClosures);
+        hasPendingClosures = false;
+      }
+      for (auto& closure : closures) {
         try {
           closure(a...);
         } catch (std::exception& e) {
@@ -52,20 +120,30 @@ class Signal {
           Log::printf(LOG_ERROR, "Error calling closure for signal %s, '%s'",
                       abi::__cxa_demangle(typeid(this).name(), 0, 0, &status),
                       e.what());
+        } catch (...) {
+          int status;
+          Log::printf(LOG_ERROR, "Error calling closure for signal %s",
+                      abi::__cxa_demangle(typeid(this).name(), 0, 0, &status));
         }
       }
-      pendingClosures.clear();
     }
 
-    for (auto listener : listeners) {
+    FiringGuard guard(this);
+    std::shared_ptr<const ListenerList> list = listeners.load();
+    for (const Listener& listener : *list) {
       try {
-        listener.second(a...);
+        listener.function(a...);
       } catch (std::exception& e) {
         int status;
         Log::printf(LOG_ERROR, "Error calling listener %i for signal %s, '%s'",
-                    listener.first,
+                    listener.id,
                     abi::__cxa_demangle(typeid(this).name(), 0, 0, &status),
                     e.what());
+      } catch (...) {
+        int status;
+        Log::printf(LOG_ERROR, "Error calling listener %i for signal %s",
+                    listener.id,
+                    abi::__cxa_demangle(typeid(this).name(), 0, 0, &status));
       }
     }
   };
@@ -81,31 +159,180 @@ class Signal {
   ClosureId listen(Function a) {
     std::scoped_lock l(m);
     ClosureId id = __newClosureId();
-    listeners[id] = a;
+    std::shared_ptr<ListenerList> list =
+        std::make_shared<ListenerList>(*listeners.load());
+    list->push_back({id, std::move(a)});
+    listeners.store(std::move(list));
     return id;
   }
 
   void addClosure(Function a) {
     std::scoped_lock l(m);
     pendingClosures.push_back(a);
+    hasPendingClosures = true;
   }
 
+  /**
+   * @brief Removes a listener.
+   *
+   * Waits for fires on other threads that may still be running it, so
+   * whatever the listener captured can be freed afterwards. A listener
+   * removing itself, or anything else called from inside this signal's fire,
+   * doesn't wait.
+   */
   void removeListener(ClosureId id) {
-    std::scoped_lock l(m);
-    auto it = listeners.find(id);
-    if (it != listeners.end())
-      listeners.erase(it);
+    uint64_t e;
+    {
+      std::scoped_lock l(m);
+      std::shared_ptr<const ListenerList> current = listeners.load();
+      auto it = std::find_if(current->begin(), current->end(),
+                             [id](const Listener& l) { return l.id == id; });
+      if (it == current->end())
+        throw std::runtime_error("Removing invalid closure id");
+
+      std::shared_ptr<ListenerList> list = std::make_shared<ListenerList>();
+      list->reserve(current->size() - 1);
+      for (const Listener& listener : *current)
+        if (listener.id != id) list->push_back(listener);
+      listeners.store(std::move(list));
+      e = epoch++;
+    }
+
+    // m is released first, a listener still running may need it to listen
+    // or remove on this signal before its fire can finish
+    std::vector<const void*>& firing = __firingSignals();
+    if (std::find(firing.begin(), firing.end(), this) != firing.end()) return;
+    while (inFlight[e & 1]) std::this_thread::yield();
+  }
+
+  size_t size() { return listeners.load()->size(); }
+};
+
+/**
+ * @brief Single threaded variant of Signal, with no synchronization at all.
+ *
+ * Only use this when every listen, removeListener and fire happens on the same
+ * thread.
+ */
+template <typename... Args>
+class SignalST {
+ public:
+  typedef std::function<void(Args...)> Function;
+
+ private:
+  struct Listener {
+    ClosureId id;
+    Function function;
+    bool removed;
+  };
+
+  std::vector<Listener> listeners;
+  std::vector<Listener> pendingListeners;  // added while firing
+  std::vector<Function> pendingClosures;
+  int firing;
+  bool dirty;  // listeners were removed while firing
+
+ public:
+  SignalST() {
+    firing = 0;
+    dirty = false;
+  }
+
+  void fire(Args... a) {
+    if (pendingClosures.size() != 0) {
+      std::vector<Function> closures;
+      closures.swap(pendingClosures);
+      for (auto& closure : closures) {
+        try {
+          closure(a...);
+        } catch (std::exception& e) {
+          int status;
+          Log::printf(LOG_ERROR, "Error calling closure for signal %s, '%s'",
+                      abi::__cxa_demangle(typeid(this).name(), 0, 0, &status),
+                      e.what());
+        } catch (...) {
+          int status;
+          Log::printf(LOG_ERROR, "Error calling closure for signal %s",
+                      abi::__cxa_demangle(typeid(this).name(), 0, 0, &status));
+        }
+      }
+    }
+
+    firing++;
+    for (size_t i = 0; i < listeners.size(); i++) {
+      const Listener& listener = listeners[i];
+      if (listener.removed) continue;
+      try {
+        listener.function(a...);
+      } catch (std::exception& e) {
+        int status;
+        Log::printf(LOG_ERROR, "Error calling listener %i for signal %s, '%s'",
+                    listener.id,
+                    abi::__cxa_demangle(typeid(this).name(), 0, 0, &status),
+                    e.what());
+      } catch (...) {
+        int status;
+        Log::printf(LOG_ERROR, "Error calling listener %i for signal %s",
+                    listener.id,
+                    abi::__cxa_demangle(typeid(this).name(), 0, 0, &status));
+      }
+    }
+    firing--;
+
+    if (!firing) {
+      if (dirty) {
+        std::erase_if(listeners, [](const Listener& l) { return l.removed; });
+        dirty = false;
+      }
+      if (pendingListeners.size() != 0) {
+        for (auto& listener : pendingListeners)
+          listeners.push_back(std::move(listener));
+        pendingListeners.clear();
+      }
+    }
+  }
+
+  ClosureId listen(Function a) {
+    ClosureId id = __newClosureId();
+    if (firing)
+      pendingListeners.push_back({id, std::move(a), false});
     else
+      listeners.push_back({id, std::move(a), false});
+    return id;
+  }
+
+  void addClosure(Function a) { pendingClosures.push_back(a); }
+
+  void removeListener(ClosureId id) {
+    for (auto it = pendingListeners.begin(); it != pendingListeners.end();
+         it++) {
+      if (it->id == id) {
+        pendingListeners.erase(it);
+        return;
+      }
+    }
+
+    auto it = std::find_if(listeners.begin(), listeners.end(),
+                           [id](const Listener& l) {
+                             return l.id == id && !l.removed;
+                           });
+    if (it == listeners.end())
       throw std::runtime_error("Removing invalid closure id");
+
+    if (firing) {
+      // the function may be the one currently executing, so only flag it
+      it->removed = true;
+      dirty = true;
+    } else {
+      listeners.erase(it);
+    }
   }
 
   size_t size() {
-    std::scoped_lock l(m);
-    return listeners.size();
+    size_t n = pendingListeners.size();
+    for (auto& listener : listeners)
+      if (!listener.removed) n++;
+    return n;
   }
-
- private:
-  std::map<ClosureId, Function> listeners;
-  std::vector<Function> pendingClosures;
 };
 }  // namespace rdm
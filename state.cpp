@@ -234,13 +234,15 @@ GameState::GameState(Game* game) {
         camera.setFOV(30.f + (time * 4.f));
         float distance = 4.0 + time;
         camera.setPosition(glm::vec3(0.0, 0.0, distance));
+        entropyLogoLod.transform = node.worldTransform();
         entropyLogo->render(game->getGfxEngine()->getDevice(), NULL, NULL,
                             [&node](gfx::BaseProgram* program) {
                               program->setParameter(
                                   "model", gfx::DtMat4,
                                   gfx::BaseProgram::Parameter{
                                       .matrix4x4 = node.worldTransform()});
-                            });
+                            },
+                            &entropyLogoLod);
       } break;
     }
   });
@@ -13,6 +13,7 @@ class GameState {
   Game* game;
   float timer;
   resource::Model* entropyLogo;
+  resource::Model::LodState entropyLogoLod;
   rdm::SoundEmitter* emitter;
   std::string waitingMessage;
 
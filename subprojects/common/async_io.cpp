@@ -0,0 +1,290 @@
+#include "async_io.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <unordered_set>
+
+#ifndef DISABLE_URING
+#include <liburing.h>
+#endif
+
+#include "logging.hpp"
+
+// queue depth of the ring, more reads than this are submitted in batches
+#define ASYNC_IO_RING_ENTRIES 256
+// largest single read, bigger files are read in several goes
+#define ASYNC_IO_MAX_READ (1 << 30)
+
+namespace common {
+#ifndef DISABLE_URING
+struct AsyncIO::Uring {
+  struct Request {
+    int fd;
+    std::vector<unsigned char> data;
+    size_t done;
+    std::promise<OptionalBuffer> promise;
+  };
+
+  struct io_uring ring;
+  // guards the submission queue, inFlight and failed. the reaper owns the
+  // completion queue
+  std::mutex mutex;
+  std::thread reaper;
+  // requests the kernel has or may still have, freed by complete
+  std::unordered_set<Request*> inFlight;
+  // the reaper gave up, nothing submitted now would ever complete
+  bool failed = false;
+
+  struct io_uring_sqe* getSqe() {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    while (!sqe) {
+      // ring is full, push what we have to the kernel
+      io_uring_submit(&ring);
+      sqe = io_uring_get_sqe(&ring);
+    }
+    return sqe;
+  }
+
+  // queues the next read of a request, mutex must be held
+  void prepare(Request* request) {
+    inFlight.insert(request);
+    struct io_uring_sqe* sqe = getSqe();
+    size_t remaining = request->data.size() - request->done;
+    io_uring_prep_read(sqe, request->fd, request->data.data() + request->done,
+                       std::min(remaining, (size_t)ASYNC_IO_MAX_READ),
+                       request->done);
+    io_uring_sqe_set_data(sqe, request);
+  }
+
+  void resubmit(Request* request) {
+    std::scoped_lock l(mutex);
+    prepare(request);
+    io_uring_submit(&ring);
+  }
+
+  void complete(Request* request, bool ok) {
+    {
+      std::scoped_lock l(mutex);
+      inFlight.erase(request);
+    }
+    close(request->fd);
+    if (ok) {
+      request->data.resize(request->done);
+      request->promise.set_value(FileBuffer(std::move(request->data)));
+    } else {
+      request->promise.set_value({});
+    }
+    delete request;
+  }
+
+  // fails every read still in flight. their buffers may still be written
+  // to, so they're only freed by stop once the ring is gone
+  void fail() {
+    std::scoped_lock l(mutex);
+    failed = true;
+    for (Request* request : inFlight) request->promise.set_value({});
+  }
+
+  void reaperTask() {
+    bool stopping = false;
+    while (true) {
+      // after the stop nop, keep reaping until the last read is done so
+      // nobody waits forever on its future
+      if (stopping) {
+        std::scoped_lock l(mutex);
+        if (inFlight.empty()) return;
+      }
+
+      struct io_uring_cqe* cqe;
+      int err = io_uring_wait_cqe(&ring, &cqe);
+      if (err == -EINTR) continue;
+      if (err < 0) {
+        rdm::Log::printf(rdm::LOG_ERROR, "io_uring_wait_cqe failed (%s)",
+                         strerror(-err));
+        fail();
+        return;
+      }
+
+      Request* request = (Request*)io_uring_cqe_get_data(cqe);
+      int res = cqe->res;
+      io_uring_cqe_seen(&ring, cqe);
+      if (!request) {  // stop nop from the destructor
+        stopping = true;
+        continue;
+      }
+
+      if (res == -EINTR || res == -EAGAIN) {
+        resubmit(request);
+      } else if (res < 0) {
+        complete(request, false);
+      } else {
+        request->done += res;
+        // res == 0 means the file shrank under us, hand back what we got
+        if (res == 0 || request->done == request->data.size())
+          complete(request, true);
+        else
+          resubmit(request);
+      }
+    }
+  }
+
+  void stop() {
+    {
+      std::scoped_lock l(mutex);
+      struct io_uring_sqe* sqe = getSqe();
+      io_uring_prep_nop(sqe);
+      io_uring_sqe_set_data(sqe, NULL);
+      io_uring_submit(&ring);
+    }
+    reaper.join();
+    io_uring_queue_exit(&ring);
+
+    // only left if the reaper failed, their promises are already set
+    for (Request* request : inFlight) {
+      close(request->fd);
+      delete request;
+    }
+    inFlight.clear();
+  }
+};
+#else
+struct AsyncIO::Uring {};
+#endif
+
+AsyncIO::AsyncIO(int threads, bool allowUring) {
+  stopping = false;
+  uring = NULL;
+  for (int i = 0; i < threads; i++)
+    workers.emplace_back([this] { workerTask(); });
+
+#ifndef DISABLE_URING
+  if (!allowUring) return;
+  uring = new Uring;
+  int err = io_uring_queue_init(ASYNC_IO_RING_ENTRIES, &uring->ring, 0);
+  if (err == 0) {
+    Uring* u = uring;
+    uring->reaper = std::thread([u] { u->reaperTask(); });
+  } else {
+    rdm::Log::printf(rdm::LOG_WARN,
+                     "io_uring_queue_init failed (%s), using thread pool",
+                     strerror(-err));
+    delete uring;
+    uring = NULL;
+  }
+#endif
+}
+
+AsyncIO::~AsyncIO() {
+#ifndef DISABLE_URING
+  if (uring) {
+    uring->stop();
+    delete uring;
+  }
+#endif
+
+  {
+    std::scoped_lock l(queueMutex);
+    stopping = true;
+  }
+  queueCondition.notify_all();
+  for (auto& worker : workers) worker.join();
+}
+
+void AsyncIO::workerTask() {
+  while (true) {
+    std::function<void()> fn;
+    {
+      std::unique_lock l(queueMutex);
+      queueCondition.wait(l, [this] { return stopping || !queue.empty(); });
+      if (queue.empty()) return;
+      fn = std::move(queue.front());
+      queue.pop_front();
+    }
+    fn();
+  }
+}
+
+void AsyncIO::run(std::function<void()> fn) {
+  {
+    std::scoped_lock l(queueMutex);
+    queue.push_back(std::move(fn));
+  }
+  queueCondition.notify_one();
+}
+
+static OptionalBuffer readPath(const std::string& path) {
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp) return {};
+  fseek(fp, 0, SEEK_END);
+  size_t sz = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  std::vector<unsigned char> v(sz);
+  v.resize(fread(v.data(), 1, sz, fp));
+  fclose(fp);
+  return FileBuffer(std::move(v));
+}
+
+std::vector<std::future<OptionalBuffer>> AsyncIO::readPaths(
+    const std::vector<std::string>& paths) {
+  std::vector<std::future<OptionalBuffer>> futures;
+
+#ifndef DISABLE_URING
+  if (uring) {
+    std::vector<Uring::Request*> requests;
+    for (auto& path : paths) {
+      std::promise<OptionalBuffer> promise;
+      futures.push_back(promise.get_future());
+
+      int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      struct stat st;
+      if (fd == -1 || fstat(fd, &st) == -1) {
+        if (fd != -1) close(fd);
+        promise.set_value({});
+        continue;
+      }
+      if (st.st_size == 0) {
+        close(fd);
+        promise.set_value(FileBuffer(std::vector<unsigned char>()));
+        continue;
+      }
+
+      Uring::Request* request = new Uring::Request;
+      request->fd = fd;
+      request->data.resize(st.st_size);
+      request->done = 0;
+      request->promise = std::move(promise);
+      requests.push_back(request);
+    }
+
+    // one submit for the whole batch
+    if (!requests.empty()) {
+      std::scoped_lock l(uring->mutex);
+      if (uring->failed) {
+        for (auto request : requests) {
+          close(request->fd);
+          request->promise.set_value({});
+          delete request;
+        }
+        return futures;
+      }
+      for (auto request : requests) uring->prepare(request);
+      io_uring_submit(&uring->ring);
+    }
+    return futures;
+  }
+#endif
+
+  for (auto& path : paths) {
+    auto task = std::make_shared<std::packaged_task<OptionalBuffer()>>(
+        [path] { return readPath(path); });
+    futures.push_back(task->get_future());
+    run([task] { (*task)(); });
+  }
+  return futures;
+}
+}  // namespace common
@@ -0,0 +1,88 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace common {
+/**
+ * @brief The contents of a file read by FileSystem::readFileAsync.
+ *
+ * Either owns the bytes, or points into memory owned by the FileSystemAPI
+ * (e.g. a mapped pak) that stays valid for as long as the api is registered.
+ */
+class FileBuffer {
+  std::vector<unsigned char> storage;
+  std::span<const unsigned char> view;
+
+ public:
+  FileBuffer(std::span<const unsigned char> view) : view(view) {}
+  FileBuffer(std::vector<unsigned char> data)
+      : storage(std::move(data)), view(storage) {}
+  // moving the vector keeps its buffer, so view stays valid
+  FileBuffer(FileBuffer&& other) = default;
+  FileBuffer& operator=(FileBuffer&& other) = default;
+  FileBuffer(const FileBuffer&) = delete;
+  FileBuffer& operator=(const FileBuffer&) = delete;
+
+  // the bytes as a vector, moved out when the buffer owns them
+  std::vector<unsigned char> take() {
+    if (!storage.empty() && storage.data() == view.data()) {
+      view = {};
+      return std::move(storage);
+    }
+    return std::vector<unsigned char>(view.begin(), view.end());
+  }
+
+  std::span<const unsigned char> span() const { return view; }
+  const unsigned char* data() const { return view.data(); }
+  size_t size() const { return view.size(); }
+};
+
+typedef std::optional<FileBuffer> OptionalBuffer;
+
+/**
+ * @brief Background reads for FileSystem::readFileAsync.
+ *
+ * Real files are read through a single io_uring where the kernel supports
+ * it, so one thread can keep many reads in flight. Everything else (and
+ * everything, without io_uring) runs on a small thread pool.
+ */
+class AsyncIO {
+  std::vector<std::thread> workers;
+  std::mutex queueMutex;
+  std::condition_variable queueCondition;
+  std::deque<std::function<void()>> queue;
+  bool stopping;
+
+  void workerTask();
+
+  // io_uring state, kept out of the header so users don't need liburing.
+  // NULL if io_uring isn't available
+  struct Uring;
+  Uring* uring;
+
+ public:
+  // allowUring false always uses the thread pool
+  AsyncIO(int threads = 4, bool allowUring = true);
+  ~AsyncIO();
+
+  bool usingUring() { return uring != NULL; }
+
+  void run(std::function<void()> fn);
+
+  /**
+   * @brief Reads whole files by OS path.
+   *
+   * All reads are submitted together.
+   */
+  std::vector<std::future<OptionalBuffer>> readPaths(
+      const std::vector<std::string>& paths);
+};
+}  // namespace common
@@ -4,15 +4,20 @@
 
 #ifdef __linux
 #include <linux/limits.h>
+#include <sys/inotify.h>
 #else
 #include <limits.h>
 #endif
 
+#include <dirent.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <cstdlib>
+#include <thread>
 
 #include "logging.hpp"
 
@@ -24,6 +29,22 @@ FileSystem* FileSystem::singleton() {
 }
 
 FileSystem::FileSystem() {
+  cacheGeneration = 0;
+  generation = 0;
+  caching = false;
+  inotifyFd = -1;
+#ifdef __linux
+  inotifyFd = inotify_init1(IN_CLOEXEC);
+  if (inotifyFd != -1) {
+    caching = true;
+    std::thread([this] { watchTask(); }).detach();
+  } else {
+    rdm::Log::printf(rdm::LOG_WARN,
+                     "inotify_init1 failed (%s), path lookups won't be cached",
+                     strerror(errno));
+  }
+#endif
+
 #ifndef NDEBUG
   addApi(new DataFolderAPI("../subprojects/rdm4001/data/"), "data_rdm4001");
 #else
@@ -38,8 +59,106 @@ void FileSystem::addApi(FileSystemAPI* fapi, std::string uri, int precedence,
   FSApiInfo& info = fsApis[uri];
   info.precedence = precedence;
   info.api = std::unique_ptr<FileSystemAPI>(fapi);
+
+  sortedApis.clear();
+  for (auto& api : fsApis) sortedApis.push_back(&api.second);
+  std::stable_sort(sortedApis.begin(), sortedApis.end(),
+                   [](FSApiInfo* a, FSApiInfo* b) {
+                     return a->precedence > b->precedence;
+                   });
+
+  if (std::optional<std::string> dir = fapi->getRealPath("")) watch(*dir);
+  invalidateCache();
 };
 
+// "a/b/" -> "a", "a" -> "."
+static std::string parentDir(std::string dir) {
+  while (dir.size() > 1 && dir.back() == '/') dir.pop_back();
+  size_t slash = dir.rfind('/');
+  if (slash == std::string::npos) return ".";
+  return dir.substr(0, slash == 0 ? 1 : slash);
+}
+
+void FileSystem::watch(std::string dir, bool recursive) {
+#ifdef __linux
+  if (!caching) return;
+
+  int wd = inotify_add_watch(inotifyFd, dir.c_str(),
+                             IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                 IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                 IN_ONLYDIR);
+  if (wd == -1) {
+    if (errno == ENOTDIR) return;  // a file, nothing to watch
+    if (errno == ENOENT) {
+      // watchTask starts watching it once the parent says it was created
+      std::string parent = parentDir(dir);
+      if (parent != dir) watch(parent, false);
+      return;
+    }
+    // a change we can't see could make a cached lookup wrong
+    rdm::Log::printf(rdm::LOG_WARN,
+                     "Could not watch %s (%s), path lookups won't be cached",
+                     dir.c_str(), strerror(errno));
+    caching = false;
+    return;
+  }
+
+  {
+    std::scoped_lock l(watchMutex);
+    watchDirs[wd] = dir;
+  }
+
+  if (!recursive) return;
+  DIR* d = opendir(dir.c_str());
+  if (!d) return;
+  if (dir.back() != '/') dir += "/";
+  struct dirent* dp;
+  while ((dp = readdir(d)) != NULL) {
+    if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
+      continue;
+    if (dp->d_type == DT_DIR || dp->d_type == DT_UNKNOWN)
+      watch(dir + dp->d_name);
+  }
+  closedir(d);
+#endif
+}
+
+void FileSystem::watchTask() {
+#ifdef __linux
+  alignas(struct inotify_event) char buf[4096];
+  while (true) {
+    ssize_t len = read(inotifyFd, buf, sizeof(buf));
+    if (len <= 0) {
+      if (errno == EINTR) continue;
+      caching = false;
+      return;
+    }
+
+    generation++;
+    for (char* ptr = buf; ptr < buf + len;) {
+      struct inotify_event* event = (struct inotify_event*)ptr;
+      // lost events may include new directories we never started watching
+      if (event->mask & IN_Q_OVERFLOW) caching = false;
+      if ((event->mask & IN_ISDIR) &&
+          (event->mask & (IN_CREATE | IN_MOVED_TO)) && event->len) {
+        std::string dir;
+        {
+          std::scoped_lock l(watchMutex);
+          dir = watchDirs[event->wd];
+        }
+        if (dir.back() != '/') dir += "/";
+        watch(dir + event->name);
+      }
+      if (event->mask & IN_IGNORED) {
+        std::scoped_lock l(watchMutex);
+        watchDirs.erase(event->wd);
+      }
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+  }
+#endif
+}
+
 FileSystemAPI* FileSystem::getOwningApi(const char* _path) {
   std::string path(_path);
   auto urisep = path.find("://");
@@ -52,18 +171,33 @@ FileSystemAPI* FileSystem::getOwningApi(const char* _path) {
       rdm::Log::printf(rdm::LOG_WARN, "Could not find URI %s", uri.c_str());
     }
   } else {
-    std::vector<FSApiInfo*> infos;
-    for (auto& api : fsApis) {
-      if (api.second.api->generalFSApi()) infos.push_back(&api.second);
+    uint64_t gen = generation;
+    if (caching) {
+      std::shared_lock l(resolveMutex);
+      if (cacheGeneration == gen) {
+        auto it = resolveCache.find(path);
+        if (it != resolveCache.end()) return it->second;
+      }
     }
-    std::sort(infos.begin(), infos.end(), [](FSApiInfo* a, FSApiInfo* b) {
-      return a->precedence > b->precedence;
-    });
-    for (auto info : infos) {
-      if (info->api->getFileExists(_path)) {
-        return info->api.get();
+
+    FileSystemAPI* owner = NULL;
+    for (auto info : sortedApis) {
+      if (info->api->generalFSApi() && info->api->getFileExists(_path)) {
+        owner = info->api.get();
+        break;
+      }
+    }
+
+    // don't cache if something changed while we were looking
+    if (caching && gen == generation) {
+      std::unique_lock l(resolveMutex);
+      if (cacheGeneration != gen) {
+        resolveCache.clear();
+        cacheGeneration = gen;
       }
+      resolveCache[path] = owner;
     }
+    return owner;
   }
   return NULL;
 }
@@ -84,6 +218,78 @@ OptionalData FileSystem::readFile(const char* path) {
   return {};
 }
 
+OptionalSpan FileSystem::readFileSpan(const char* path) {
+  if (FileSystemAPI* api = getOwningApi(path))
+    return api->getFileSpan(sanitizePath(path).c_str());
+
+  return {};
+}
+
+std::optional<std::string> FileSystem::getRealPath(const char* path) {
+  if (FileSystemAPI* api = getOwningApi(path))
+    return api->getRealPath(sanitizePath(path).c_str());
+
+  return {};
+}
+
+AsyncIO* FileSystem::getAsyncIO() {
+  std::call_once(asyncOnce, [this] { async.reset(new AsyncIO()); });
+  return async.get();
+}
+
+std::future<OptionalBuffer> FileSystem::readFileAsync(const char* path) {
+  std::vector<std::future<OptionalBuffer>> futures =
+      readFilesAsync({std::string(path)});
+  return std::move(futures[0]);
+}
+
+std::vector<std::future<OptionalBuffer>> FileSystem::readFilesAsync(
+    const std::vector<std::string>& paths) {
+  AsyncIO* io = getAsyncIO();
+  std::vector<std::future<OptionalBuffer>> futures(paths.size());
+
+  // real files are collected so they go to the kernel in one submission
+  std::vector<std::string> realPaths;
+  std::vector<size_t> realIdx;
+  for (size_t i = 0; i < paths.size(); i++) {
+    const char* path = paths[i].c_str();
+    FileSystemAPI* api = getOwningApi(path);
+    std::string sanitized = sanitizePath(path);
+
+    if (!api) {
+      std::promise<OptionalBuffer> promise;
+      futures[i] = promise.get_future();
+      promise.set_value({});
+    } else if (OptionalSpan span = api->getFileSpan(sanitized.c_str())) {
+      std::promise<OptionalBuffer> promise;
+      futures[i] = promise.get_future();
+      promise.set_value(FileBuffer(span.value()));
+    } else if (std::optional<std::string> real =
+                   api->getRealPath(sanitized.c_str())) {
+      realPaths.push_back(real.value());
+      realIdx.push_back(i);
+    } else {
+      auto task = std::make_shared<std::packaged_task<OptionalBuffer()>>(
+          [api, sanitized]() -> OptionalBuffer {
+            OptionalData data = api->getFileData(sanitized.c_str());
+            if (!data) return {};
+            return FileBuffer(std::move(data.value()));
+          });
+      futures[i] = task->get_future();
+      io->run([task] { (*task)(); });
+    }
+  }
+
+  if (!realPaths.empty()) {
+    std::vector<std::future<OptionalBuffer>> realFutures =
+        io->readPaths(realPaths);
+    for (size_t i = 0; i < realIdx.size(); i++)
+      futures[realIdx[i]] = std::move(realFutures[i]);
+  }
+
+  return futures;
+}
+
 std::optional<FileIO*> FileSystem::getFileIO(const char* path,
                                              const char* mode) {
   if (FileSystemAPI* api = getOwningApi(path))
@@ -187,10 +393,7 @@ void DataFolderAPI::checkProperDir(const char* path) {
 bool DataFolderAPI::getFileExists(const char* path) {
   checkProperDir(path);
 
-  FILE* fp = fopen((basedir + path).c_str(), "r");
-  bool ex = fp;
-  if (fp) fclose(fp);
-  return ex;
+  return access((basedir + path).c_str(), F_OK) == 0;
 }
 
 OptionalData DataFolderAPI::getFileData(const char* path) {
@@ -210,6 +413,12 @@ OptionalData DataFolderAPI::getFileData(const char* path) {
   }
 }
 
+std::optional<std::string> DataFolderAPI::getRealPath(const char* path) {
+  checkProperDir(path);
+
+  return basedir + path;
+}
+
 std::optional<FileIO*> DataFolderAPI::getFileIO(const char* path,
                                                 const char* mode) {
   checkProperDir(path);
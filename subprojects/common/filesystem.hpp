@@ -1,12 +1,24 @@
 #pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <future>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "async_io.hpp"
+
 namespace common {
 typedef std::optional<std::vector<unsigned char>> OptionalData;
+typedef std::optional<std::span<const unsigned char>> OptionalSpan;
 
 class FileIO {
  public:
@@ -54,6 +66,14 @@ class FileSystemAPI {
       return {};
     }
   }
+  // zero copy view of a file, valid for as long as the api is registered.
+  // apis that can't provide one return nothing, use getFileData then
+  virtual OptionalSpan getFileSpan(const char* path) { return {}; }
+  // path that can be handed to the OS (open, mmap), if the api is backed by
+  // real files
+  virtual std::optional<std::string> getRealPath(const char* path) {
+    return {};
+  }
   virtual std::optional<FileIO*> getFileIO(const char* path,
                                            const char* mode) = 0;
 };
@@ -85,6 +105,7 @@ class DataFolderAPI : public FileSystemAPI {
 
   virtual bool getFileExists(const char* path);
   virtual OptionalData getFileData(const char* path);
+  virtual std::optional<std::string> getRealPath(const char* path);
   virtual std::optional<FileIO*> getFileIO(const char* path, const char* mode);
 };
 
@@ -96,6 +117,30 @@ class FileSystem {
   };
 
   std::map<std::string, FSApiInfo> fsApis;
+  // every api, highest precedence first. rebuilt by addApi
+  std::vector<FSApiInfo*> sortedApis;
+
+  // path -> owning api (NULL if nobody has it). only used while every real
+  // directory behind an api is watched, so files appearing or disappearing
+  // bump generation and drop the cache
+  std::shared_mutex resolveMutex;
+  std::unordered_map<std::string, FileSystemAPI*> resolveCache;
+  uint64_t cacheGeneration;
+  std::atomic<uint64_t> generation;
+  std::atomic<bool> caching;
+
+  // created on the first async read
+  std::once_flag asyncOnce;
+  std::unique_ptr<AsyncIO> async;
+
+  int inotifyFd;
+  std::mutex watchMutex;
+  std::unordered_map<int, std::string> watchDirs;
+
+  // a dir that doesn't exist yet has its nearest existing parent watched
+  // instead, without recursing, so it's picked up when it's created
+  void watch(std::string dir, bool recursive = true);
+  void watchTask();
 
   FileSystemAPI* getOwningApi(const char* path);
   std::string sanitizePath(const char* path);
@@ -107,8 +152,30 @@ class FileSystem {
   // higher numbers take precedence
   void addApi(FileSystemAPI* api, std::string uri, int precedence = 0,
               bool exclusive = false);
+  // forget cached path lookups, call if an api changes what it owns
+  void invalidateCache() { generation++; }
 
   OptionalData readFile(const char* path);
+  // like readFile but without copying, returns nothing if the owning api
+  // can't hand out a view (e.g. compressed or not memory mapped)
+  OptionalSpan readFileSpan(const char* path);
+  std::optional<std::string> getRealPath(const char* path);
   std::optional<FileIO*> getFileIO(const char* path, const char* mode);
+
+  AsyncIO* getAsyncIO();
+  /**
+   * @brief Reads a file without blocking the caller.
+   *
+   * Memory mapped files complete immediately without a copy, real files are
+   * read through io_uring (or the AsyncIO thread pool), anything else is read
+   * through its api on the thread pool. The future holds nothing if the file
+   * couldn't be read.
+   */
+  std::future<OptionalBuffer> readFileAsync(const char* path);
+  /**
+   * @brief Like readFileAsync, but real files are submitted as one batch.
+   */
+  std::vector<std::future<OptionalBuffer>> readFilesAsync(
+      const std::vector<std::string>& paths);
 };
 }  // namespace common
@@ -0,0 +1,132 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <span>
+
+namespace ktx2 {
+// the subset of VkFormat that texture_baker writes and the engine reads
+enum VkFormat {
+  VK_FORMAT_R8G8B8A8_UNORM = 37,
+  VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131,
+  VK_FORMAT_BC3_UNORM_BLOCK = 137,
+  VK_FORMAT_BC7_UNORM_BLOCK = 145,
+};
+
+static const unsigned char KTX2_IDENTIFIER[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+#define KTX2_SUPERCOMPRESSION_NONE 0
+
+/**
+ * KTX 2.0 containers as described by the Khronos spec. Only single layer,
+ * single face 2D textures without supercompression are supported, which is
+ * everything texture_baker writes.
+ */
+struct __attribute__((packed)) Ktx2Header {
+  unsigned char identifier[12];
+  uint32_t vkFormat;
+  uint32_t typeSize;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t layerCount;
+  uint32_t faceCount;
+  uint32_t levelCount;
+  uint32_t supercompressionScheme;
+
+  uint32_t dfdByteOffset;
+  uint32_t dfdByteLength;
+  uint32_t kvdByteOffset;
+  uint32_t kvdByteLength;
+  uint64_t sgdByteOffset;
+  uint64_t sgdByteLength;
+};
+
+// follows the header, one per level with level 0 (the largest) first
+struct __attribute__((packed)) Ktx2Level {
+  uint64_t byteOffset;
+  uint64_t byteLength;
+  uint64_t uncompressedByteLength;
+};
+
+// bytes per 4x4 block (or per texel, for uncompressed formats), 0 if unknown
+static inline size_t formatBlockSize(uint32_t vkFormat) {
+  switch (vkFormat) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+      return 4;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+      return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+static inline bool formatCompressed(uint32_t vkFormat) {
+  return vkFormat != VK_FORMAT_R8G8B8A8_UNORM;
+}
+
+static inline size_t levelSize(uint32_t vkFormat, uint32_t width,
+                               uint32_t height) {
+  if (!formatCompressed(vkFormat))
+    return (size_t)width * height * formatBlockSize(vkFormat);
+  return (size_t)((width + 3) / 4) * ((height + 3) / 4) *
+         formatBlockSize(vkFormat);
+}
+
+/**
+ * A bounds checked view of a KTX2 file.
+ */
+class Ktx2File {
+  const unsigned char* data;
+  size_t size;
+  const Ktx2Header* header;
+
+ public:
+  Ktx2File() : data(NULL), size(0), header(NULL) {}
+
+  // returns false if the data isn't a KTX2 file the engine can upload
+  bool open(const unsigned char* data, size_t size) {
+    this->data = data;
+    this->size = size;
+    header = NULL;
+    if (size < sizeof(Ktx2Header)) return false;
+
+    const Ktx2Header* hdr = (const Ktx2Header*)data;
+    if (memcmp(hdr->identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) ||
+        formatBlockSize(hdr->vkFormat) == 0 || hdr->pixelWidth == 0 ||
+        hdr->pixelHeight == 0 || hdr->pixelDepth != 0 ||
+        hdr->layerCount > 1 || hdr->faceCount != 1 || hdr->levelCount == 0 ||
+        hdr->levelCount > 32 ||
+        hdr->supercompressionScheme != KTX2_SUPERCOMPRESSION_NONE)
+      return false;
+    if (size - sizeof(Ktx2Header) < hdr->levelCount * sizeof(Ktx2Level))
+      return false;
+
+    const Ktx2Level* levels = (const Ktx2Level*)(data + sizeof(Ktx2Header));
+    for (uint32_t i = 0; i < hdr->levelCount; i++) {
+      uint32_t width = std::max(hdr->pixelWidth >> i, 1u);
+      uint32_t height = std::max(hdr->pixelHeight >> i, 1u);
+      if (levels[i].byteOffset > size ||
+          levels[i].byteLength > size - levels[i].byteOffset ||
+          levels[i].byteLength != levelSize(hdr->vkFormat, width, height))
+        return false;
+    }
+
+    header = hdr;
+    return true;
+  }
+
+  const Ktx2Header* getHeader() { return header; }
+
+  std::span<const unsigned char> getLevel(uint32_t level) {
+    const Ktx2Level* levels = (const Ktx2Level*)(data + sizeof(Ktx2Header));
+    return std::span<const unsigned char>(data + levels[level].byteOffset,
+                                          levels[level].byteLength);
+  }
+};
+}  // namespace ktx2
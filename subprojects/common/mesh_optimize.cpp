@@ -0,0 +1,532 @@
+#include "mesh_optimize.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace model {
+// see https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+#define CACHE_SIZE 32
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+static float vertexScore(int cachePosition, uint32_t remaining) {
+  if (remaining == 0) return -1.f;  // nothing left to draw with it
+
+  float score = 0.f;
+  if (cachePosition >= 0) {
+    // the last triangle's vertices get a fixed score, so the next triangle
+    // doesn't just share an edge with it and strip along
+    if (cachePosition < 3) {
+      score = LAST_TRIANGLE_SCORE;
+    } else {
+      float scaler = 1.f / (CACHE_SIZE - 3);
+      score = powf(1.f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+    }
+  }
+  // favour vertices with few triangles left, so they get finished off
+  score += VALENCE_BOOST_SCALE * powf(remaining, -VALENCE_BOOST_POWER);
+  return score;
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t indexCount,
+                         size_t vertexCount) {
+  size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0) return;
+
+  // triangles using each vertex, as one flat array
+  std::vector<uint32_t> remaining(vertexCount, 0);
+  for (size_t i = 0; i < indexCount; i++) remaining[indices[i]]++;
+  std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; v++)
+    firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+  std::vector<uint32_t> vertexTriangles(indexCount);
+  {
+    std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indexCount; i++)
+      vertexTriangles[fill[indices[i]]++] = i / 3;
+  }
+
+  std::vector<int> cachePosition(vertexCount, -1);
+  std::vector<float> score(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++)
+    score[v] = vertexScore(-1, remaining[v]);
+
+  std::vector<bool> emitted(triangleCount, false);
+
+  std::vector<uint32_t> output;
+  output.reserve(indexCount);
+  // three extra slots for the vertices pushed out by a new triangle
+  uint32_t cache[CACHE_SIZE + 3];
+  int cacheCount = 0;
+
+  int64_t best = -1;
+  size_t scanCursor = 0;
+  for (size_t n = 0; n < triangleCount; n++) {
+    if (best < 0) {
+      // nothing in the cache is worth drawing, start somewhere new
+      while (emitted[scanCursor]) scanCursor++;
+      best = scanCursor;
+    }
+
+    const uint32_t* tri = indices + best * 3;
+    output.insert(output.end(), tri, tri + 3);
+    emitted[best] = true;
+
+    // take the triangle out of its vertices' lists
+    for (int i = 0; i < 3; i++) {
+      uint32_t v = tri[i];
+      uint32_t* list = vertexTriangles.data() + firstTriangle[v];
+      uint32_t* end = list + remaining[v];
+      std::swap(*std::find(list, end, (uint32_t)best), *(end - 1));
+      remaining[v]--;
+    }
+
+    // move its vertices to the front of the cache
+    uint32_t newCache[CACHE_SIZE + 3];
+    int newCount = 0;
+    for (int i = 0; i < 3; i++) newCache[newCount++] = tri[i];
+    for (int i = 0; i < cacheCount; i++) {
+      uint32_t v = cache[i];
+      if (v != tri[0] && v != tri[1] && v != tri[2]) newCache[newCount++] = v;
+    }
+    memcpy(cache, newCache, newCount * sizeof(uint32_t));
+    cacheCount = newCount;
+
+    // rescore everything that was in the cache, including anything that just
+    // fell out of it, and pick the best triangle touching it
+    for (int i = 0; i < cacheCount; i++) {
+      uint32_t v = cache[i];
+      cachePosition[v] = i < CACHE_SIZE ? i : -1;
+      score[v] = vertexScore(cachePosition[v], remaining[v]);
+    }
+    best = -1;
+    float bestScore = -1.f;
+    for (int i = 0; i < cacheCount; i++) {
+      uint32_t v = cache[i];
+      for (uint32_t j = 0; j < remaining[v]; j++) {
+        uint32_t t = vertexTriangles[firstTriangle[v] + j];
+        float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] +
+                  score[indices[t * 3 + 2]];
+        if (s > bestScore) {
+          bestScore = s;
+          best = t;
+        }
+      }
+    }
+    cacheCount = std::min(cacheCount, CACHE_SIZE);
+  }
+
+  memcpy(indices, output.data(), indexCount * sizeof(uint32_t));
+}
+
+// the FIFO cache size clusters are split for, smaller than CACHE_SIZE since a
+// hard boundary only needs to be cold for a typical GPU
+#define OVERDRAW_CACHE_SIZE 16
+
+void optimizeOverdraw(uint32_t* indices, size_t indexCount,
+                      const float* positions, size_t stride,
+                      size_t vertexCount) {
+  size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0) return;
+
+  auto position = [&](uint32_t v) {
+    return (const float*)((const unsigned char*)positions + v * stride);
+  };
+
+  // clusters start on triangles that miss the cache on all three vertices,
+  // so moving them around doesn't cost any extra transforms
+  std::vector<size_t> clusters;
+  std::vector<uint32_t> timestamps(vertexCount, 0);
+  uint32_t time = OVERDRAW_CACHE_SIZE + 1;
+  for (size_t t = 0; t < triangleCount; t++) {
+    int misses = 0;
+    for (int i = 0; i < 3; i++) {
+      uint32_t v = indices[t * 3 + i];
+      if (time - timestamps[v] > OVERDRAW_CACHE_SIZE) {
+        timestamps[v] = time++;
+        misses++;
+      }
+    }
+    if (misses == 3 || t == 0) clusters.push_back(t);
+  }
+  clusters.push_back(triangleCount);
+
+  float meshCentre[3] = {0.f, 0.f, 0.f};
+  for (size_t i = 0; i < indexCount; i++)
+    for (int c = 0; c < 3; c++)
+      meshCentre[c] += position(indices[i])[c] / indexCount;
+
+  struct Cluster {
+    size_t first;
+    size_t count;
+    float sortKey;
+  };
+  std::vector<Cluster> sorted;
+  for (size_t i = 0; i + 1 < clusters.size(); i++) {
+    float centre[3] = {0.f, 0.f, 0.f};
+    float normal[3] = {0.f, 0.f, 0.f};
+    float totalArea = 0.f;
+    for (size_t t = clusters[i]; t < clusters[i + 1]; t++) {
+      const float* a = position(indices[t * 3]);
+      const float* b = position(indices[t * 3 + 1]);
+      const float* c = position(indices[t * 3 + 2]);
+      float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+      // the cross product is area weighted already
+      float n[3] = {ab[1] * ac[2] - ab[2] * ac[1],
+                    ab[2] * ac[0] - ab[0] * ac[2],
+                    ab[0] * ac[1] - ab[1] * ac[0]};
+      float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (int k = 0; k < 3; k++) {
+        centre[k] += (a[k] + b[k] + c[k]) / 3.f * area;
+        normal[k] += n[k];
+      }
+      totalArea += area;
+    }
+
+    float key = 0.f;
+    float normalLength = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] +
+                               normal[2] * normal[2]);
+    if (totalArea > 0.f && normalLength > 0.f)
+      for (int k = 0; k < 3; k++)
+        key += (centre[k] / totalArea - meshCentre[k]) * normal[k] /
+               normalLength;
+    sorted.push_back(
+        Cluster{clusters[i], clusters[i + 1] - clusters[i], key});
+  }
+
+  std::stable_sort(
+      sorted.begin(), sorted.end(),
+      [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+  std::vector<uint32_t> output;
+  output.reserve(indexCount);
+  for (const Cluster& cluster : sorted)
+    output.insert(output.end(), indices + cluster.first * 3,
+                  indices + (cluster.first + cluster.count) * 3);
+  memcpy(indices, output.data(), triangleCount * 3 * sizeof(uint32_t));
+}
+
+size_t optimizeVertexFetch(uint32_t* indices, size_t indexCount,
+                           size_t vertexCount, std::vector<uint32_t>& remap) {
+  remap.assign(vertexCount, MESH_NO_VERTEX);
+  uint32_t next = 0;
+  for (size_t i = 0; i < indexCount; i++) {
+    uint32_t& v = remap[indices[i]];
+    if (v == MESH_NO_VERTEX) v = next++;
+    indices[i] = v;
+  }
+  return next;
+}
+
+float vertexCacheACMR(const uint32_t* indices, size_t indexCount,
+                      size_t vertexCount, size_t cacheSize) {
+  if (indexCount < 3) return 0.f;
+  std::vector<uint32_t> timestamps(vertexCount, 0);
+  uint32_t time = cacheSize + 1;
+  size_t misses = 0;
+  for (size_t i = 0; i < indexCount; i++) {
+    if (time - timestamps[indices[i]] > cacheSize) {
+      timestamps[indices[i]] = time++;
+      misses++;
+    }
+  }
+  return (float)misses / (indexCount / 3);
+}
+
+void joinIdenticalVertices(uint32_t* indices, size_t indexCount,
+                           const void* vertices, size_t vertexCount,
+                           size_t vertexSize) {
+  const unsigned char* bytes = (const unsigned char*)vertices;
+  auto hash = [&](uint32_t v) {
+    // FNV-1a
+    size_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < vertexSize; i++) {
+      h ^= bytes[v * vertexSize + i];
+      h *= 1099511628211ull;
+    }
+    return h;
+  };
+  auto equal = [&](uint32_t a, uint32_t b) {
+    return memcmp(bytes + a * vertexSize, bytes + b * vertexSize,
+                  vertexSize) == 0;
+  };
+  std::unordered_map<uint32_t, uint32_t, decltype(hash), decltype(equal)>
+      first(vertexCount, hash, equal);
+  for (size_t i = 0; i < indexCount; i++)
+    indices[i] = first.emplace(indices[i], indices[i]).first->second;
+}
+
+// symmetric 4x4 error quadric, Q(p) = p'Ap + 2b'p + c
+struct Quadric {
+  double a00, a11, a22, a10, a20, a21;
+  double b0, b1, b2;
+  double c;
+
+  void addPlane(const double n[3], double d, double weight) {
+    a00 += weight * n[0] * n[0];
+    a11 += weight * n[1] * n[1];
+    a22 += weight * n[2] * n[2];
+    a10 += weight * n[1] * n[0];
+    a20 += weight * n[2] * n[0];
+    a21 += weight * n[2] * n[1];
+    b0 += weight * n[0] * d;
+    b1 += weight * n[1] * d;
+    b2 += weight * n[2] * d;
+    c += weight * d * d;
+  }
+
+  void add(const Quadric& q) {
+    a00 += q.a00;
+    a11 += q.a11;
+    a22 += q.a22;
+    a10 += q.a10;
+    a20 += q.a20;
+    a21 += q.a21;
+    b0 += q.b0;
+    b1 += q.b1;
+    b2 += q.b2;
+    c += q.c;
+  }
+
+  double error(const float* p) const {
+    double x = p[0], y = p[1], z = p[2];
+    double e = a00 * x * x + a11 * y * y + a22 * z * z +
+               2.0 * (a10 * x * y + a20 * x * z + a21 * y * z) +
+               2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return e < 0.0 ? 0.0 : e;
+  }
+};
+
+static void triangleNormal(const float* a, const float* b, const float* c,
+                           double n[3]) {
+  double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  double ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+  n[0] = ab[1] * ac[2] - ab[2] * ac[1];
+  n[1] = ab[2] * ac[0] - ab[0] * ac[2];
+  n[2] = ab[0] * ac[1] - ab[1] * ac[0];
+}
+
+size_t simplifyMesh(uint32_t* destination, const uint32_t* indices,
+                    size_t indexCount, const float* positions, size_t stride,
+                    size_t vertexCount, size_t targetIndexCount,
+                    float targetError) {
+  std::vector<uint32_t> current(indices, indices + indexCount);
+
+  // work in a unit box, so errors are relative to the mesh
+  std::vector<float> position(vertexCount * 3);
+  float boundsMin[3] = {INFINITY, INFINITY, INFINITY};
+  float boundsMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for (size_t v = 0; v < vertexCount; v++) {
+    const float* p =
+        (const float*)((const unsigned char*)positions + v * stride);
+    for (int k = 0; k < 3; k++) {
+      position[v * 3 + k] = p[k];
+      boundsMin[k] = std::min(boundsMin[k], p[k]);
+      boundsMax[k] = std::max(boundsMax[k], p[k]);
+    }
+  }
+  float extent = 0.f;
+  for (int k = 0; k < 3; k++)
+    extent = std::max(extent, boundsMax[k] - boundsMin[k]);
+  if (extent > 0.f && indexCount > targetIndexCount) {
+    for (size_t v = 0; v < vertexCount; v++)
+      for (int k = 0; k < 3; k++)
+        position[v * 3 + k] = (position[v * 3 + k] - boundsMin[k]) / extent;
+  } else {
+    memcpy(destination, indices, indexCount * sizeof(uint32_t));
+    return indexCount;
+  }
+  auto pos = [&](uint32_t v) { return position.data() + v * 3; };
+
+  // an edge that isn't shared by exactly two triangles is a border, a seam
+  // or something non manifold. its vertices stay where they are
+  std::vector<bool> locked(vertexCount, false);
+  {
+    std::unordered_map<uint64_t, int> edges;
+    for (size_t i = 0; i < indexCount; i += 3) {
+      for (int e = 0; e < 3; e++) {
+        uint64_t a = indices[i + e], b = indices[i + (e + 1) % 3];
+        edges[std::min(a, b) << 32 | std::max(a, b)]++;
+      }
+    }
+    for (auto& [edge, count] : edges) {
+      if (count != 2) {
+        locked[edge >> 32] = true;
+        locked[edge & 0xffffffff] = true;
+      }
+    }
+  }
+
+  std::vector<Quadric> quadrics(vertexCount, Quadric{});
+  for (size_t i = 0; i < indexCount; i += 3) {
+    double n[3];
+    triangleNormal(pos(indices[i]), pos(indices[i + 1]), pos(indices[i + 2]),
+                   n);
+    double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length == 0.0) continue;
+    for (int k = 0; k < 3; k++) n[k] /= length;
+    const float* a = pos(indices[i]);
+    double d = -(n[0] * a[0] + n[1] * a[1] + n[2] * a[2]);
+    for (int k = 0; k < 3; k++)
+      quadrics[indices[i + k]].addPlane(n, d, length * 0.5);
+  }
+
+  struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+  };
+  double maxCost = (double)targetError * targetError;
+  std::vector<uint32_t> firstTriangle(vertexCount + 1);
+  std::vector<uint32_t> vertexTriangles;
+  std::vector<Collapse> collapses;
+  std::vector<bool> touched(vertexCount);
+  std::vector<uint32_t> remap(vertexCount);
+
+  // each pass collapses edges whose neighbourhoods don't overlap, so the
+  // flip checks against the pass's starting state stay valid
+  while (current.size() > targetIndexCount) {
+    std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+    for (uint32_t v : current) firstTriangle[v + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+      firstTriangle[v + 1] += firstTriangle[v];
+    vertexTriangles.resize(current.size());
+    {
+      std::vector<uint32_t> fill(firstTriangle.begin(),
+                                 firstTriangle.end() - 1);
+      for (size_t i = 0; i < current.size(); i++)
+        vertexTriangles[fill[current[i]]++] = i / 3;
+    }
+
+    collapses.clear();
+    for (size_t i = 0; i < current.size(); i += 3) {
+      for (int e = 0; e < 3; e++) {
+        uint32_t a = current[i + e], b = current[i + (e + 1) % 3];
+        // the triangle on the other side has the same edge the other way
+        // round, only take it once
+        if (a > b) continue;
+        for (int dir = 0; dir < 2; dir++, std::swap(a, b)) {
+          if (locked[a]) continue;
+          double cost = quadrics[a].error(pos(b)) + quadrics[b].error(pos(b));
+          if (cost <= maxCost) collapses.push_back(Collapse{a, b, cost});
+        }
+      }
+    }
+    if (collapses.empty()) break;
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse& a, const Collapse& b) {
+                return a.cost < b.cost;
+              });
+
+    for (size_t v = 0; v < vertexCount; v++) remap[v] = v;
+    std::fill(touched.begin(), touched.end(), false);
+    size_t goal = (current.size() - targetIndexCount) / 3;
+    size_t removed = 0;
+    for (const Collapse& collapse : collapses) {
+      if (removed >= goal) break;
+      if (touched[collapse.from] || touched[collapse.to]) continue;
+
+      // moving from onto to mustn't flip any triangle that survives
+      bool flips = false;
+      size_t dropped = 0;
+      for (uint32_t j = firstTriangle[collapse.from];
+           j < firstTriangle[collapse.from + 1] && !flips; j++) {
+        const uint32_t* tri = current.data() + vertexTriangles[j] * 3;
+        if (tri[0] == collapse.to || tri[1] == collapse.to ||
+            tri[2] == collapse.to) {
+          dropped++;
+          continue;
+        }
+        const float* before[3];
+        const float* after[3];
+        for (int k = 0; k < 3; k++) {
+          before[k] = pos(tri[k]);
+          after[k] = tri[k] == collapse.from ? pos(collapse.to) : before[k];
+        }
+        double nb[3], na[3];
+        triangleNormal(before[0], before[1], before[2], nb);
+        triangleNormal(after[0], after[1], after[2], na);
+        double dot = nb[0] * na[0] + nb[1] * na[1] + nb[2] * na[2];
+        double lb = sqrt(nb[0] * nb[0] + nb[1] * nb[1] + nb[2] * nb[2]);
+        double la = sqrt(na[0] * na[0] + na[1] * na[1] + na[2] * na[2]);
+        if (dot <= 0.25 * lb * la) flips = true;
+      }
+      if (flips) continue;
+
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to].add(quadrics[collapse.from]);
+      for (uint32_t j = firstTriangle[collapse.from];
+           j < firstTriangle[collapse.from + 1]; j++) {
+        const uint32_t* tri = current.data() + vertexTriangles[j] * 3;
+        for (int k = 0; k < 3; k++) touched[tri[k]] = true;
+      }
+      removed += dropped;
+    }
+    if (removed == 0) break;
+
+    size_t out = 0;
+    for (size_t i = 0; i < current.size(); i += 3) {
+      uint32_t a = remap[current[i]], b = remap[current[i + 1]],
+               c = remap[current[i + 2]];
+      if (a == b || b == c || a == c) continue;
+      current[out++] = a;
+      current[out++] = b;
+      current[out++] = c;
+    }
+    current.resize(out);
+  }
+
+  memcpy(destination, current.data(), current.size() * sizeof(uint32_t));
+  return current.size();
+}
+
+// levels below this many triangles aren't worth another draw's worth of
+// bookkeeping
+#define MESH_LOD_MIN_TRIANGLES 32
+// error allowed for the first simplified level, doubled for each after it
+#define MESH_LOD_ERROR 0.01f
+
+size_t optimizeMesh(std::vector<uint32_t>& indices, const void* vertices,
+                    size_t vertexCount, size_t vertexSize, int maxLods,
+                    std::vector<MeshLod>& lods, std::vector<uint32_t>& remap) {
+  const float* positions = (const float*)vertices;
+  joinIdenticalVertices(indices.data(), indices.size(), vertices, vertexCount,
+                        vertexSize);
+
+  std::vector<std::vector<uint32_t>> levels;
+  levels.push_back(indices);
+  float error = MESH_LOD_ERROR;
+  for (int i = 1; i < maxLods; i++, error *= 2.f) {
+    const std::vector<uint32_t>& previous = levels.back();
+    size_t target = previous.size() / 6 * 3;
+    if (target < MESH_LOD_MIN_TRIANGLES * 3) break;
+    std::vector<uint32_t> level(previous.size());
+    level.resize(simplifyMesh(level.data(), previous.data(), previous.size(),
+                              positions, vertexSize, vertexCount, target,
+                              error));
+    // not enough of a saving to be worth switching to
+    if (level.size() > previous.size() * 3 / 4) break;
+    levels.push_back(std::move(level));
+  }
+
+  indices.clear();
+  lods.clear();
+  for (std::vector<uint32_t>& level : levels) {
+    optimizeVertexCache(level.data(), level.size(), vertexCount);
+    optimizeOverdraw(level.data(), level.size(), positions, vertexSize,
+                     vertexCount);
+    lods.push_back(MeshLod{indices.size(), level.size()});
+    indices.insert(indices.end(), level.begin(), level.end());
+  }
+  // coarser levels only use vertices the first one does, so the first one
+  // decides the order
+  return optimizeVertexFetch(indices.data(), indices.size(), vertexCount,
+                             remap);
+}
+}  // namespace model
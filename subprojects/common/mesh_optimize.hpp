@@ -0,0 +1,105 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace model {
+#define MESH_NO_VERTEX 0xffffffff
+
+/**
+ * Triangle list optimizations run when a model is imported or baked, in this
+ * order:
+ *
+ * optimizeVertexCache reorders triangles so vertices are reused while they're
+ * still in the post transform cache (Tom Forsyth's linear speed vertex cache
+ * optimization).
+ *
+ * optimizeOverdraw splits the result into clusters where the cache was cold
+ * anyway, and draws the clusters facing away from the mesh centre first, so
+ * more of the hidden surfaces fail the depth test.
+ *
+ * optimizeVertexFetch numbers vertices in the order they are first used, so
+ * vertex fetches walk memory linearly. Vertices that aren't referenced are
+ * dropped.
+ */
+void optimizeVertexCache(uint32_t* indices, size_t indexCount,
+                         size_t vertexCount);
+
+// positions are 3 floats, stride bytes apart
+void optimizeOverdraw(uint32_t* indices, size_t indexCount,
+                      const float* positions, size_t stride,
+                      size_t vertexCount);
+
+/**
+ * @brief Rewrites indices in first use order.
+ *
+ * remap[old vertex] gets the new index, or MESH_NO_VERTEX for vertices no
+ * triangle uses. Returns the number of vertices left.
+ */
+size_t optimizeVertexFetch(uint32_t* indices, size_t indexCount,
+                           size_t vertexCount, std::vector<uint32_t>& remap);
+
+// moves vertices to where optimizeVertexFetch remapped them
+template <typename T>
+std::vector<T> remapVertices(const std::vector<T>& vertices,
+                             const std::vector<uint32_t>& remap,
+                             size_t newCount) {
+  std::vector<T> out(newCount);
+  for (size_t i = 0; i < vertices.size(); i++)
+    if (remap[i] != MESH_NO_VERTEX) out[remap[i]] = vertices[i];
+  return out;
+}
+
+// average cache misses per triangle for a FIFO cache of cacheSize, for
+// reporting. 3 is the worst case, 0.5 is about as good as it gets
+float vertexCacheACMR(const uint32_t* indices, size_t indexCount,
+                      size_t vertexCount, size_t cacheSize = 16);
+
+// rewrites indices so vertices with identical bytes share one index
+void joinIdenticalVertices(uint32_t* indices, size_t indexCount,
+                           const void* vertices, size_t vertexCount,
+                           size_t vertexSize);
+
+/**
+ * @brief Simplifies a triangle list by collapsing edges.
+ *
+ * Each collapse moves one vertex onto the other end of an edge, cheapest
+ * first by quadric error, so no new vertices are made and every level of
+ * detail can share the original vertex buffer. Vertices on open borders and
+ * attribute seams (which look like borders, since the wedges on either side
+ * are separate vertices) never move.
+ *
+ * Stops at targetIndexCount, or when the next collapse would move the surface
+ * further than targetError, relative to the size of the mesh. Writes to
+ * destination, which must hold indexCount indices, and returns how many it
+ * wrote.
+ */
+size_t simplifyMesh(uint32_t* destination, const uint32_t* indices,
+                    size_t indexCount, const float* positions, size_t stride,
+                    size_t vertexCount, size_t targetIndexCount,
+                    float targetError);
+
+#define MESH_MAX_LODS 4
+
+struct MeshLod {
+  size_t firstIndex;
+  size_t numIndices;
+};
+
+/**
+ * @brief Everything a mesh goes through when it's imported or baked.
+ *
+ * Joins identical vertices, generates up to maxLods levels of detail (each
+ * about half the triangles of the last, fewer if the mesh won't simplify
+ * well), optimizes every level for the vertex cache and overdraw, and finally
+ * the shared vertices for fetch order.
+ *
+ * Vertices must start with their position as 3 floats. indices comes back
+ * with every level back to back, finest first, as described by lods. Returns
+ * the new vertex count, move the vertices with remapVertices.
+ */
+size_t optimizeMesh(std::vector<uint32_t>& indices, const void* vertices,
+                    size_t vertexCount, size_t vertexSize, int maxLods,
+                    std::vector<MeshLod>& lods, std::vector<uint32_t>& remap);
+}  // namespace model
@@ -0,0 +1,489 @@
+#include <assimp/material.h>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <assimp/Importer.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mesh_optimize.hpp"
+#include "model_file.hpp"
+
+// bakes a model into the .rmdl format read by resource::Model. the import and
+// every conversion here has to match what resource::Model does with a model
+// it imports through assimp at runtime
+
+struct BakeBone {
+  int id;
+  aiMatrix4x4 offset;
+};
+
+struct Baker {
+  const aiScene* scene;
+  double sampleRate;
+
+  std::vector<char> strings;
+  std::map<std::string, uint32_t> stringOffsets;
+
+  std::vector<model::ModelMesh> meshes;
+  std::vector<uint8_t> vertices;
+  std::vector<uint8_t> indices;
+  std::vector<model::ModelMaterial> materials;
+  std::vector<model::ModelTexture> textures;
+  std::vector<uint8_t> textureData;
+  std::vector<model::ModelNode> nodes;
+  std::vector<model::ModelBone> bones;
+  std::vector<model::ModelAnimation> animations;
+  std::vector<model::ModelChannel> channels;
+  std::vector<model::ModelKeyVec3> translations;
+  std::vector<model::ModelKeyQuat> rotations;
+  std::vector<model::ModelKeyVec3> scales;
+  std::vector<model::ModelLod> lods;
+
+  std::map<std::string, BakeBone> boneInfo;
+  int boneCount;
+  bool skinned;
+  // triangle weighted, for the summary
+  double acmrBefore;
+  double acmrAfter;
+  size_t numTriangles;
+  size_t lodTriangles[MESH_MAX_LODS];
+  float boundsMin[3];
+  float boundsMax[3];
+};
+
+static uint32_t addString(Baker* baker, const std::string& s) {
+  auto it = baker->stringOffsets.find(s);
+  if (it != baker->stringOffsets.end()) return it->second;
+  uint32_t offset = baker->strings.size();
+  baker->strings.insert(baker->strings.end(), s.begin(), s.end());
+  baker->strings.push_back('\0');
+  baker->stringOffsets[s] = offset;
+  return offset;
+}
+
+// assimp matrices are row major, glm wants column major
+static void copyMatrix(float* out, const aiMatrix4x4& m) {
+  for (int row = 0; row < 4; row++)
+    for (int col = 0; col < 4; col++) out[col * 4 + row] = m[row][col];
+}
+
+static void bakeNode(Baker* baker, aiNode* node, int parent) {
+  model::ModelNode out;
+  out.name = addString(baker, node->mName.C_Str());
+  out.parent = parent;
+  copyMatrix(out.transform, node->mTransformation);
+  int index = baker->nodes.size();
+  baker->nodes.push_back(out);
+  for (int i = 0; i < node->mNumChildren; i++)
+    bakeNode(baker, node->mChildren[i], index);
+}
+
+static void bakeMaterials(Baker* baker) {
+  const aiScene* scene = baker->scene;
+  for (int i = 0; i < scene->mNumMaterials; i++) {
+    aiMaterial* material = scene->mMaterials[i];
+    model::ModelMaterial out;
+    out.name = addString(baker, material->GetName().C_Str());
+    out.texturePath = MODEL_NONE;
+    out.embeddedTexture = MODEL_NONE;
+
+    if (aiGetMaterialFloat(material, AI_MATKEY_ROUGHNESS_FACTOR,
+                           &out.roughness) != AI_SUCCESS)
+      out.roughness = 1.f;
+    if (aiGetMaterialFloat(material, AI_MATKEY_METALLIC_FACTOR,
+                           &out.metallic) != AI_SUCCESS)
+      out.metallic = 0.f;
+    if (aiGetMaterialFloat(material, AI_MATKEY_SPECULAR_FACTOR,
+                           &out.specular) != AI_SUCCESS)
+      out.specular = 0.f;
+
+    aiColor4D color;
+    aiGetMaterialColor(material, AI_MATKEY_COLOR_DIFFUSE, &color);
+    out.albedo[0] = color.r;
+    out.albedo[1] = color.g;
+    out.albedo[2] = color.b;
+
+    out.hasAlbedo = material->GetTextureCount(aiTextureType_DIFFUSE) != 0;
+    if (out.hasAlbedo) {
+      aiString path;
+      material->GetTexture(aiTextureType_DIFFUSE, 0, &path);
+      if (path.C_Str()[0] == '*')
+        out.embeddedTexture = atoi(path.C_Str() + 1);
+      else
+        out.texturePath = addString(baker, path.C_Str());
+    }
+    baker->materials.push_back(out);
+  }
+
+  for (int i = 0; i < scene->mNumTextures; i++) {
+    aiTexture* texture = scene->mTextures[i];
+    model::ModelTexture out;
+    out.width = texture->mWidth;
+    out.height = texture->mHeight;
+    out.dataOffset = baker->textureData.size();
+    size_t size = texture->mHeight == 0
+                      ? texture->mWidth
+                      : (size_t)texture->mWidth * texture->mHeight * 4;
+    const uint8_t* data = (const uint8_t*)texture->pcData;
+    baker->textureData.insert(baker->textureData.end(), data, data + size);
+    baker->textures.push_back(out);
+  }
+}
+
+static void bakeBones(Baker* baker) {
+  const aiScene* scene = baker->scene;
+  for (int i = 0; i < scene->mNumMeshes; i++) {
+    aiMesh* mesh = scene->mMeshes[i];
+    if (!mesh->HasBones()) continue;
+    baker->skinned = true;
+    for (int j = 0; j < mesh->mNumBones; j++) {
+      aiBone* bone = mesh->mBones[j];
+      std::string boneName = bone->mName.C_Str();
+      if (baker->boneInfo.find(boneName) != baker->boneInfo.end()) continue;
+      baker->boneInfo[boneName] = {baker->boneCount++, bone->mOffsetMatrix};
+    }
+  }
+
+  // animated nodes without a bone still get one, like at runtime
+  if (baker->skinned) {
+    for (int i = 0; i < scene->mNumAnimations; i++) {
+      aiAnimation* anim = scene->mAnimations[i];
+      for (int j = 0; j < anim->mNumChannels; j++) {
+        std::string name = anim->mChannels[j]->mNodeName.C_Str();
+        if (baker->boneInfo.find(name) == baker->boneInfo.end())
+          baker->boneInfo[name] = {baker->boneCount++, aiMatrix4x4()};
+      }
+    }
+  }
+
+  for (auto& [name, info] : baker->boneInfo) {
+    model::ModelBone out;
+    out.name = addString(baker, name);
+    out.id = info.id;
+    copyMatrix(out.offset, info.offset);
+    baker->bones.push_back(out);
+  }
+}
+
+static void bakeMeshes(Baker* baker) {
+  const aiScene* scene = baker->scene;
+  for (int i = 0; i < 3; i++) {
+    baker->boundsMin[i] = 0.f;
+    baker->boundsMax[i] = 0.f;
+  }
+
+  // like at runtime, only meshes with bones use the skinned layout
+  for (int m = 0; m < scene->mNumMeshes; m++) {
+    aiMesh* mesh = scene->mMeshes[m];
+    model::ModelMesh out;
+    out.name = addString(baker, mesh->mName.C_Str());
+    out.material = mesh->mMaterialIndex;
+    out.skinned = mesh->HasBones();
+    out.numVertices = mesh->mNumVertices;
+    out.vertexOffset = baker->vertices.size();
+
+    std::vector<uint32_t> indices;
+    for (int i = 0; i < mesh->mNumFaces; i++) {
+      aiFace& face = mesh->mFaces[i];
+      indices.insert(indices.end(), face.mIndices,
+                     face.mIndices + face.mNumIndices);
+    }
+
+    std::vector<model::ModelVertexSkinned> verts(mesh->mNumVertices);
+    std::vector<float> weights(mesh->mNumVertices * MODEL_MAX_WEIGHTS, 0.f);
+    for (int i = 0; i < mesh->mNumVertices; i++) {
+      model::ModelVertexSkinned& v = verts[i];
+      aiVector3D p = mesh->mVertices[i];
+      aiVector3D n = mesh->mNormals ? mesh->mNormals[i] : aiVector3D();
+      aiVector3D uv = mesh->mTextureCoords[0] ? mesh->mTextureCoords[0][i]
+                                              : aiVector3D();
+      v.position[0] = p.x;
+      v.position[1] = p.y;
+      v.position[2] = p.z;
+      v.normal = model::packNormal(n.x, n.y, n.z);
+      v.uv[0] = model::packHalf(uv.x);
+      v.uv[1] = model::packHalf(1.0 - uv.y);
+      memset(v.boneIds, MODEL_NO_BONE, sizeof(v.boneIds));
+      memset(v.boneWeights, 0, sizeof(v.boneWeights));
+
+      float pos[3] = {p.x, p.y, p.z};
+      for (int j = 0; j < 3; j++) {
+        baker->boundsMin[j] = std::min(baker->boundsMin[j], pos[j]);
+        baker->boundsMax[j] = std::max(baker->boundsMax[j], pos[j]);
+      }
+    }
+
+    for (int i = 0; i < mesh->mNumBones; i++) {
+      aiBone* bone = mesh->mBones[i];
+      // ids past the bone uniform block fall back to the bind pose anyway
+      int boneId = std::min(baker->boneInfo[bone->mName.C_Str()].id,
+                            MODEL_NO_BONE - 1);
+      for (int j = 0; j < bone->mNumWeights; j++) {
+        aiVertexWeight weight = bone->mWeights[j];
+        if (weight.mWeight == 0.0) continue;
+        model::ModelVertexSkinned& v = verts[weight.mVertexId];
+        for (int z = 0; z < MODEL_MAX_WEIGHTS; z++) {
+          if (v.boneIds[z] == MODEL_NO_BONE) {
+            v.boneIds[z] = boneId;
+            weights[weight.mVertexId * MODEL_MAX_WEIGHTS + z] = weight.mWeight;
+            break;
+          }
+        }
+      }
+    }
+    for (int i = 0; i < mesh->mNumVertices; i++)
+      model::packWeights(&weights[i * MODEL_MAX_WEIGHTS], verts[i].boneWeights);
+
+    std::vector<model::MeshLod> lods = {{0, indices.size()}};
+    if (!verts.empty()) {
+      size_t triangles = indices.size() / 3;
+      baker->acmrBefore += model::vertexCacheACMR(
+                               indices.data(), indices.size(), verts.size()) *
+                           triangles;
+      std::vector<uint32_t> remap;
+      size_t count = model::optimizeMesh(
+          indices, verts.data(), verts.size(),
+          sizeof(model::ModelVertexSkinned), MESH_MAX_LODS, lods, remap);
+      verts = model::remapVertices(verts, remap, count);
+      baker->acmrAfter +=
+          model::vertexCacheACMR(indices.data(), lods[0].numIndices, count) *
+          triangles;
+      baker->numTriangles += triangles;
+    }
+    out.numVertices = verts.size();
+    out.numIndices = indices.size();
+    out.firstLod = baker->lods.size();
+    out.numLods = lods.size();
+    for (int i = 0; i < lods.size(); i++) {
+      baker->lods.push_back(
+          model::ModelLod{lods[i].firstIndex, lods[i].numIndices});
+      baker->lodTriangles[i] += lods[i].numIndices / 3;
+    }
+
+    out.indexSize = verts.size() <= UINT16_MAX ? 2 : 4;
+    baker->indices.resize((baker->indices.size() + 3) / 4 * 4, 0);
+    out.indexOffset = baker->indices.size();
+    for (uint32_t index : indices) {
+      const uint8_t* b = (const uint8_t*)&index;
+      // little endian, the low half is the 16 bit index
+      baker->indices.insert(baker->indices.end(), b, b + out.indexSize);
+    }
+    out.reserved = 0;
+
+    // the unskinned layout is a prefix of the skinned one
+    size_t vertexSize = out.skinned ? sizeof(model::ModelVertexSkinned)
+                                    : sizeof(model::ModelVertex);
+    for (auto& v : verts) {
+      const uint8_t* b = (const uint8_t*)&v;
+      baker->vertices.insert(baker->vertices.end(), b, b + vertexSize);
+    }
+    baker->meshes.push_back(out);
+  }
+}
+
+template <typename Key, typename Value>
+static Value sampleKeys(const Key* keys, unsigned int count, double t) {
+  if (count == 1 || t <= keys[0].mTime) return keys[0].mValue;
+  for (unsigned int i = 0; i + 1 < count; i++) {
+    if (t < keys[i + 1].mTime) {
+      float fac = (t - keys[i].mTime) / (keys[i + 1].mTime - keys[i].mTime);
+      Value out;
+      Assimp::Interpolator<Value>()(out, keys[i].mValue, keys[i + 1].mValue,
+                                    fac);
+      return out;
+    }
+  }
+  return keys[count - 1].mValue;
+}
+
+static void addVec3Keys(std::vector<model::ModelKeyVec3>& out,
+                        const aiVectorKey* keys, unsigned int count,
+                        const std::vector<double>& times) {
+  if (times.empty() || count == 1) {
+    for (unsigned int i = 0; i < count; i++)
+      out.push_back({keys[i].mTime,
+                     {keys[i].mValue.x, keys[i].mValue.y, keys[i].mValue.z}});
+    return;
+  }
+  for (double t : times) {
+    aiVector3D v = sampleKeys<aiVectorKey, aiVector3D>(keys, count, t);
+    out.push_back({t, {v.x, v.y, v.z}});
+  }
+}
+
+static void addQuatKeys(std::vector<model::ModelKeyQuat>& out,
+                        const aiQuatKey* keys, unsigned int count,
+                        const std::vector<double>& times) {
+  if (times.empty() || count == 1) {
+    for (unsigned int i = 0; i < count; i++) {
+      aiQuaternion q = keys[i].mValue;
+      out.push_back({keys[i].mTime, {q.w, q.x, q.y, q.z}});
+    }
+    return;
+  }
+  for (double t : times) {
+    aiQuaternion q = sampleKeys<aiQuatKey, aiQuaternion>(keys, count, t);
+    q.Normalize();
+    out.push_back({t, {q.w, q.x, q.y, q.z}});
+  }
+}
+
+static void bakeAnimations(Baker* baker) {
+  const aiScene* scene = baker->scene;
+  for (int i = 0; i < scene->mNumAnimations; i++) {
+    aiAnimation* anim = scene->mAnimations[i];
+    model::ModelAnimation out;
+    out.name = addString(baker, anim->mName.C_Str());
+    out.firstChannel = baker->channels.size();
+    out.numChannels = anim->mNumChannels;
+    out.reserved = 0;
+    out.tps = anim->mTicksPerSecond;
+    out.duration = anim->mDuration;
+
+    // resample on a uniform grid, so every channel has its keys at the same
+    // times. a rate of 0 keeps the keys as authored
+    std::vector<double> times;
+    if (baker->sampleRate > 0.0 && anim->mDuration > 0.0) {
+      double tps = anim->mTicksPerSecond > 0.0 ? anim->mTicksPerSecond : 25.0;
+      double step = tps / baker->sampleRate;
+      for (double t = 0.0; t < anim->mDuration; t += step) times.push_back(t);
+      times.push_back(anim->mDuration);
+    }
+
+    for (int j = 0; j < anim->mNumChannels; j++) {
+      aiNodeAnim* nodeAnim = anim->mChannels[j];
+      model::ModelChannel channel;
+      channel.node = addString(baker, nodeAnim->mNodeName.C_Str());
+
+      channel.firstTranslation = baker->translations.size();
+      addVec3Keys(baker->translations, nodeAnim->mPositionKeys,
+                  nodeAnim->mNumPositionKeys, times);
+      channel.numTranslations =
+          baker->translations.size() - channel.firstTranslation;
+
+      channel.firstRotation = baker->rotations.size();
+      addQuatKeys(baker->rotations, nodeAnim->mRotationKeys,
+                  nodeAnim->mNumRotationKeys, times);
+      channel.numRotations = baker->rotations.size() - channel.firstRotation;
+
+      channel.firstScale = baker->scales.size();
+      addVec3Keys(baker->scales, nodeAnim->mScalingKeys,
+                  nodeAnim->mNumScalingKeys, times);
+      channel.numScales = baker->scales.size() - channel.firstScale;
+
+      baker->channels.push_back(channel);
+    }
+    baker->animations.push_back(out);
+  }
+}
+
+static model::ModelSection writeSection(FILE* output, const void* data,
+                                        size_t size) {
+  static const uint8_t zero[MODEL_SECTION_ALIGNMENT] = {};
+  size_t offset = ftell(output);
+  size_t aligned = (offset + MODEL_SECTION_ALIGNMENT - 1) /
+                   MODEL_SECTION_ALIGNMENT * MODEL_SECTION_ALIGNMENT;
+  fwrite(zero, aligned - offset, 1, output);
+  if (size) fwrite(data, size, 1, output);
+  return {aligned, size};
+}
+
+template <typename T>
+static model::ModelSection writeSection(FILE* output,
+                                        const std::vector<T>& data) {
+  return writeSection(output, data.data(), data.size() * sizeof(T));
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3 && argc != 4) {
+    fprintf(stderr, "model_baker <input model> <output.rmdl> [sample rate]\n");
+    fprintf(stderr,
+            "animations are resampled to sample rate keys per second "
+            "(default 30, 0 keeps the original keys)\n");
+    return 1;
+  }
+
+  Baker baker;
+  baker.sampleRate = argc == 4 ? atof(argv[3]) : 30.0;
+  baker.boneCount = 0;
+  baker.skinned = false;
+  baker.acmrBefore = 0.0;
+  baker.acmrAfter = 0.0;
+  baker.numTriangles = 0;
+  memset(baker.lodTriangles, 0, sizeof(baker.lodTriangles));
+
+  Assimp::Importer importer;
+  baker.scene =
+      importer.ReadFile(argv[1], aiProcess_Triangulate | aiProcess_FlipUVs);
+  if (!baker.scene || baker.scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+      !baker.scene->mRootNode) {
+    fprintf(stderr, "Assimp import error: %s\n", importer.GetErrorString());
+    return 1;
+  }
+
+  addString(&baker, "");
+  bakeNode(&baker, baker.scene->mRootNode, -1);
+  bakeMaterials(&baker);
+  bakeBones(&baker);
+  bakeMeshes(&baker);
+  bakeAnimations(&baker);
+
+  FILE* output = fopen(argv[2], "wb");
+  if (!output) {
+    fprintf(stderr, "Could not open %s (%s)\n", argv[2], strerror(errno));
+    return 1;
+  }
+
+  model::ModelHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.ident[0] = MODEL_HEADER_0;
+  hdr.ident[1] = MODEL_HEADER_1;
+  hdr.ident[2] = MODEL_HEADER_2;
+  hdr.ident[3] = MODEL_HEADER_3;
+  hdr.version = MODEL_VERSION;
+  hdr.flags = baker.skinned ? model::MODEL_FLAG_SKINNED : 0;
+  memcpy(hdr.boundsMin, baker.boundsMin, sizeof(hdr.boundsMin));
+  memcpy(hdr.boundsMax, baker.boundsMax, sizeof(hdr.boundsMax));
+
+  fwrite(&hdr, sizeof(hdr), 1, output);
+  hdr.strings = writeSection(output, baker.strings);
+  hdr.meshes = writeSection(output, baker.meshes);
+  hdr.vertices = writeSection(output, baker.vertices);
+  hdr.indices = writeSection(output, baker.indices);
+  hdr.materials = writeSection(output, baker.materials);
+  hdr.textures = writeSection(output, baker.textures);
+  hdr.textureData = writeSection(output, baker.textureData);
+  hdr.nodes = writeSection(output, baker.nodes);
+  hdr.bones = writeSection(output, baker.bones);
+  hdr.animations = writeSection(output, baker.animations);
+  hdr.channels = writeSection(output, baker.channels);
+  hdr.translations = writeSection(output, baker.translations);
+  hdr.rotations = writeSection(output, baker.rotations);
+  hdr.scales = writeSection(output, baker.scales);
+  hdr.lods = writeSection(output, baker.lods);
+
+  fseek(output, 0, SEEK_SET);
+  fwrite(&hdr, sizeof(hdr), 1, output);
+  fclose(output);
+
+  printf("%zu meshes, %zu vertex bytes, %zu index bytes, %zu bones, "
+         "%zu animations\n",
+         baker.meshes.size(), baker.vertices.size(), baker.indices.size(),
+         baker.bones.size(), baker.animations.size());
+  if (baker.numTriangles)
+    printf("vertex cache ACMR %.3f -> %.3f\n",
+           baker.acmrBefore / baker.numTriangles,
+           baker.acmrAfter / baker.numTriangles);
+  printf("triangles per level of detail:");
+  for (size_t triangles : baker.lodTriangles)
+    if (triangles) printf(" %zu", triangles);
+  printf("\n");
+  return 0;
+}
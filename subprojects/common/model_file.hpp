@@ -0,0 +1,298 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <optional>
+#include <span>
+
+namespace model {
+#define MODEL_HEADER_0 'R'
+#define MODEL_HEADER_1 'M'
+#define MODEL_HEADER_2 'D'
+#define MODEL_HEADER_3 'L'
+#define MODEL_VERSION 3
+// every section starts on this boundary so it can be used in place
+#define MODEL_SECTION_ALIGNMENT 16
+#define MODEL_NONE 0xffffffff
+
+#define MODEL_MAX_WEIGHTS 4
+// bone id for an unused weight slot, the shader skips it
+#define MODEL_NO_BONE 255
+
+enum ModelFlags {
+  MODEL_FLAG_SKINNED = 1 << 0,
+};
+
+/**
+ * Baked models (.rmdl) are written by model_baker. Vertex and index blobs are
+ * laid out exactly as the renderer uploads them, so loading is a bounds check
+ * and a few buffer uploads straight out of the file.
+ *
+ * Strings are NUL terminated and referenced by byte offset into the strings
+ * section. Matrices are 16 floats, column major.
+ */
+struct __attribute__((packed)) ModelSection {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct __attribute__((packed)) ModelHeader {
+  char ident[4];
+  uint32_t version;
+  uint32_t flags;
+  uint32_t reserved;
+  float boundsMin[3];
+  float boundsMax[3];
+
+  ModelSection strings;
+  ModelSection meshes;      // ModelMesh
+  ModelSection vertices;    // ModelVertex or ModelVertexSkinned, per mesh
+  ModelSection indices;     // uint16_t or uint32_t, per mesh
+  ModelSection materials;   // ModelMaterial
+  ModelSection textures;    // ModelTexture
+  ModelSection textureData;
+  ModelSection nodes;       // ModelNode
+  ModelSection bones;       // ModelBone
+  ModelSection animations;  // ModelAnimation
+  ModelSection channels;    // ModelChannel
+  ModelSection translations;  // ModelKeyVec3
+  ModelSection rotations;     // ModelKeyQuat
+  ModelSection scales;        // ModelKeyVec3
+  ModelSection lods;          // ModelLod
+};
+
+/**
+ * The vertex layouts resource::Model uploads, for baked and imported models
+ * alike. Normals are signed normalized 10:10:10:2 (packNormal) and uvs are
+ * half floats (packHalf), both of which the vertex fetch expands so the
+ * shaders still see a vec3 and a vec2.
+ */
+struct __attribute__((packed)) ModelVertex {
+  float position[3];
+  uint32_t normal;
+  uint16_t uv[2];
+};
+
+struct __attribute__((packed)) ModelVertexSkinned {
+  float position[3];
+  uint32_t normal;
+  uint16_t uv[2];
+  uint8_t boneIds[MODEL_MAX_WEIGHTS];      // MODEL_NO_BONE if unused
+  uint8_t boneWeights[MODEL_MAX_WEIGHTS];  // unorm, sum to 255
+};
+
+struct __attribute__((packed)) ModelMesh {
+  uint32_t name;
+  uint32_t material;
+  uint32_t skinned;
+  uint32_t numVertices;
+  // byte offset into the vertices section
+  uint64_t vertexOffset;
+  // byte offset into the indices section, 4 byte aligned
+  uint64_t indexOffset;
+  // every level of detail's indices, back to back
+  uint64_t numIndices;
+  uint32_t indexSize;  // 2 or 4
+  // levels of detail in the lods section, finest first
+  uint32_t firstLod;
+  uint32_t numLods;
+  uint32_t reserved;
+};
+
+// all levels of detail of a mesh share its vertices
+struct __attribute__((packed)) ModelLod {
+  // element offset from the mesh's indexOffset
+  uint64_t firstIndex;
+  uint64_t numIndices;
+};
+
+struct __attribute__((packed)) ModelMaterial {
+  uint32_t name;
+  // path relative to the model's directory, MODEL_NONE if there isn't one
+  uint32_t texturePath;
+  // index into the textures section, MODEL_NONE if there isn't one
+  uint32_t embeddedTexture;
+  uint32_t hasAlbedo;
+  float albedo[3];
+  float roughness;
+  float metallic;
+  float specular;
+};
+
+struct __attribute__((packed)) ModelTexture {
+  // like aiTexture, a height of 0 means the data is a compressed image
+  // (png, jpg...) of width bytes, otherwise it's width * height RGBA texels
+  uint32_t width;
+  uint32_t height;
+  uint64_t dataOffset;
+};
+
+// nodes are stored depth first, so a parent always comes before its children
+struct __attribute__((packed)) ModelNode {
+  uint32_t name;
+  int32_t parent;
+  float transform[16];
+};
+
+struct __attribute__((packed)) ModelBone {
+  uint32_t name;
+  int32_t id;
+  float offset[16];
+};
+
+struct __attribute__((packed)) ModelAnimation {
+  uint32_t name;
+  uint32_t firstChannel;
+  uint32_t numChannels;
+  uint32_t reserved;
+  double tps;
+  double duration;
+};
+
+// key ranges are element offsets into the key sections
+struct __attribute__((packed)) ModelChannel {
+  uint32_t node;
+  uint32_t numTranslations;
+  uint32_t numRotations;
+  uint32_t numScales;
+  uint64_t firstTranslation;
+  uint64_t firstRotation;
+  uint64_t firstScale;
+};
+
+struct __attribute__((packed)) ModelKeyVec3 {
+  double time;
+  float value[3];
+};
+
+struct __attribute__((packed)) ModelKeyQuat {
+  double time;
+  float value[4];  // w, x, y, z
+};
+
+inline uint32_t packNormal(float x, float y, float z) {
+  auto component = [](float v) -> uint32_t {
+    v = v < -1.f ? -1.f : (v > 1.f ? 1.f : v);
+    return (uint32_t)lroundf(v * 511.f) & 0x3ff;
+  };
+  return component(x) | (component(y) << 10) | (component(z) << 20);
+}
+
+// IEEE half, rounded to nearest even
+inline uint16_t packHalf(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff)  // inf, nan
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  if (exponent >= 31) return sign | 0x7c00;
+  if (exponent <= 0) {
+    if (exponent < -10) return sign;
+    mantissa |= 0x800000;  // subnormal, shift the implicit bit in
+    int shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t midpoint = 1u << (shift - 1);
+    if (rest > midpoint || (rest == midpoint && (half & 1))) half++;
+    return sign | half;
+  }
+  uint32_t half = (exponent << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1fff;
+  // a carry out of the mantissa bumps the exponent, which is still correct
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+  return sign | half;
+}
+
+// quantizes weights to unorm bytes that still add up to exactly 255
+inline void packWeights(const float weights[MODEL_MAX_WEIGHTS],
+                        uint8_t out[MODEL_MAX_WEIGHTS]) {
+  float total = 0.f;
+  for (int i = 0; i < MODEL_MAX_WEIGHTS; i++) total += weights[i];
+  if (total <= 0.f) {
+    memset(out, 0, MODEL_MAX_WEIGHTS);
+    return;
+  }
+  int sum = 0;
+  int largest = 0;
+  for (int i = 0; i < MODEL_MAX_WEIGHTS; i++) {
+    out[i] = (uint8_t)lroundf(weights[i] / total * 255.f);
+    sum += out[i];
+    if (weights[i] > weights[largest]) largest = i;
+  }
+  out[largest] += 255 - sum;
+}
+
+/**
+ * A bounds checked view of a baked model.
+ */
+class ModelFile {
+  const unsigned char* data;
+  size_t size;
+  const ModelHeader* header;
+
+  bool check(const ModelSection& section, size_t elementSize) {
+    return section.offset <= size && section.size <= size - section.offset &&
+           section.size % elementSize == 0;
+  }
+
+ public:
+  ModelFile() : data(NULL), size(0), header(NULL) {}
+
+  // returns false if the data isn't a baked model this version can read
+  bool open(const unsigned char* data, size_t size) {
+    this->data = data;
+    this->size = size;
+    header = NULL;
+    if (size < sizeof(ModelHeader)) return false;
+
+    const ModelHeader* hdr = (const ModelHeader*)data;
+    if (hdr->ident[0] != MODEL_HEADER_0 || hdr->ident[1] != MODEL_HEADER_1 ||
+        hdr->ident[2] != MODEL_HEADER_2 || hdr->ident[3] != MODEL_HEADER_3 ||
+        hdr->version != MODEL_VERSION)
+      return false;
+
+    if (!check(hdr->strings, 1) || !check(hdr->meshes, sizeof(ModelMesh)) ||
+        !check(hdr->vertices, 4) || !check(hdr->indices, 2) ||
+        !check(hdr->materials, sizeof(ModelMaterial)) ||
+        !check(hdr->textures, sizeof(ModelTexture)) ||
+        !check(hdr->textureData, 1) || !check(hdr->nodes, sizeof(ModelNode)) ||
+        !check(hdr->bones, sizeof(ModelBone)) ||
+        !check(hdr->animations, sizeof(ModelAnimation)) ||
+        !check(hdr->channels, sizeof(ModelChannel)) ||
+        !check(hdr->translations, sizeof(ModelKeyVec3)) ||
+        !check(hdr->rotations, sizeof(ModelKeyQuat)) ||
+        !check(hdr->scales, sizeof(ModelKeyVec3)) ||
+        !check(hdr->lods, sizeof(ModelLod)))
+      return false;
+    // strings are only ever read up to their NUL
+    if (hdr->strings.size == 0 ||
+        data[hdr->strings.offset + hdr->strings.size - 1] != '\0')
+      return false;
+
+    header = hdr;
+    return true;
+  }
+
+  const ModelHeader* getHeader() { return header; }
+
+  template <typename T>
+  std::span<const T> get(const ModelSection& section) {
+    return std::span<const T>((const T*)(data + section.offset),
+                              section.size / sizeof(T));
+  }
+
+  const unsigned char* getBytes(const ModelSection& section) {
+    return data + section.offset;
+  }
+
+  // NULL for MODEL_NONE or an offset outside the strings section
+  const char* getString(uint32_t offset) {
+    if (offset == MODEL_NONE || offset >= header->strings.size) return NULL;
+    return (const char*)data + header->strings.offset + offset;
+  }
+};
+}  // namespace model
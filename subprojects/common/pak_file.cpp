@@ -1,53 +1,481 @@
 #include "pak_file.hpp"
 
+#include <fcntl.h>
 #include <linux/limits.h>
+#include <lzma.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef DISABLE_ZSTD
+#include <zstd.h>
+#endif
 
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
 
 #include "filesystem.hpp"
 #include "logging.hpp"
 namespace pak {
+bool compressionSupported(CompressionType type) {
+  switch (type) {
+    case None:
+    case Lzma:
+      return true;
+    case Zstd:
+#ifdef DISABLE_ZSTD
+      return false;
+#else
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+static bool compressChunk(CompressionType type, const uint8_t* in,
+                          size_t size, std::vector<uint8_t>& out) {
+  switch (type) {
+    case Lzma: {
+      out.resize(lzma_stream_buffer_bound(size));
+      size_t outPos = 0;
+      if (lzma_easy_buffer_encode(6, LZMA_CHECK_CRC32, NULL, in, size,
+                                  out.data(), &outPos,
+                                  out.size()) != LZMA_OK)
+        return false;
+      out.resize(outPos);
+      return true;
+    }
+#ifndef DISABLE_ZSTD
+    case Zstd: {
+      out.resize(ZSTD_compressBound(size));
+      size_t r = ZSTD_compress(out.data(), out.size(), in, size, 19);
+      if (ZSTD_isError(r)) return false;
+      out.resize(r);
+      return true;
+    }
+#endif
+    default:
+      return false;
+  }
+}
+
+bool decompressChunk(CompressionType type, const uint8_t* in, size_t inSize,
+                     uint8_t* out, size_t outSize) {
+  switch (type) {
+    case Lzma: {
+      uint64_t memlimit = UINT64_MAX;
+      size_t inPos = 0;
+      size_t outPos = 0;
+      if (lzma_stream_buffer_decode(&memlimit, 0, NULL, in, &inPos, inSize,
+                                    out, &outPos, outSize) != LZMA_OK)
+        return false;
+      return outPos == outSize;
+    }
+#ifndef DISABLE_ZSTD
+    case Zstd: {
+      size_t r = ZSTD_decompress(out, outSize, in, inSize);
+      return !ZSTD_isError(r) && r == outSize;
+    }
+#endif
+    default:
+      return false;
+  }
+}
+
+static size_t chunkUncompressedSize(const PakChunkHeader& header,
+                                    uint32_t index) {
+  return std::min((uint64_t)header.chunkSize,
+                  header.uncompressedSize - (uint64_t)index * header.chunkSize);
+}
+
+bool compressChunked(CompressionType type, const uint8_t* in, size_t size,
+                     std::vector<uint8_t>& out, size_t chunkSize) {
+  PakChunkHeader header;
+  header.uncompressedSize = size;
+  header.chunkSize = chunkSize;
+  header.numChunks = (size + chunkSize - 1) / chunkSize;
+
+  std::vector<PakChunk> table(header.numChunks);
+  std::vector<std::vector<uint8_t>> compressed(header.numChunks);
+  size_t offset = sizeof(PakChunkHeader) + sizeof(PakChunk) * header.numChunks;
+  for (uint32_t i = 0; i < header.numChunks; i++) {
+    if (!compressChunk(type, in + (size_t)i * chunkSize,
+                       chunkUncompressedSize(header, i), compressed[i]))
+      return false;
+    table[i].offset = offset;
+    table[i].size = compressed[i].size();
+    offset += compressed[i].size();
+  }
+
+  out.resize(offset);
+  memcpy(out.data(), &header, sizeof(header));
+  memcpy(out.data() + sizeof(header), table.data(),
+         sizeof(PakChunk) * table.size());
+  for (uint32_t i = 0; i < header.numChunks; i++)
+    memcpy(out.data() + table[i].offset, compressed[i].data(),
+           compressed[i].size());
+  return true;
+}
+
+// chunked entries smaller than this are decompressed on the calling thread,
+// handing them to the pool costs more than it saves
+#define PAK_PARALLEL_MIN_CHUNKS 4
+
+// cores - 1 threads shared by every parallelFor, started on first use and
+// kept for the life of the process, so reads don't start threads of their own
+// and loads decompressing on many workers never run more than the cores
+class ChunkPool {
+  std::mutex m;
+  std::condition_variable condition;
+  std::deque<std::function<void()>> queue;
+  size_t workers;
+
+  ChunkPool() {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    workers = cores - 1;
+    for (size_t i = 0; i < workers; i++)
+      std::thread([this] { workerTask(); }).detach();
+  }
+
+  void workerTask() {
+    while (true) {
+      std::function<void()> fn;
+      {
+        std::unique_lock l(m);
+        condition.wait(l, [this] { return !queue.empty(); });
+        fn = std::move(queue.front());
+        queue.pop_front();
+      }
+      fn();
+    }
+  }
+
+ public:
+  static ChunkPool* singleton() {
+    static ChunkPool* pool = new ChunkPool();
+    return pool;
+  }
+
+  size_t size() { return workers; }
+
+  void run(std::function<void()> fn) {
+    {
+      std::scoped_lock l(m);
+      queue.push_back(std::move(fn));
+    }
+    condition.notify_one();
+  }
+};
+
+// runs fn(0..count-1) on the calling thread and the pool, and returns once
+// every index is done. fn must not throw
+static void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+  ChunkPool* pool = ChunkPool::singleton();
+  if (count < PAK_PARALLEL_MIN_CHUNKS || pool->size() == 0) {
+    for (size_t i = 0; i < count; i++) fn(i);
+    return;
+  }
+
+  // shared with helpers that may only start once we've returned, they find
+  // nothing left and never touch fn
+  struct Batch {
+    std::atomic<size_t> next;
+    std::atomic<size_t> done;
+    std::mutex m;
+    std::condition_variable finished;
+    size_t count;
+    const std::function<void(size_t)>* fn;
+  };
+  std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+  batch->next = 0;
+  batch->done = 0;
+  batch->count = count;
+  batch->fn = &fn;
+
+  auto work = [batch] {
+    size_t i;
+    while ((i = batch->next++) < batch->count) {
+      (*batch->fn)(i);
+      if (++batch->done == batch->count) {
+        std::scoped_lock l(batch->m);
+        batch->finished.notify_all();
+      }
+    }
+  };
+  size_t helpers = std::min(count - 1, pool->size());
+  for (size_t i = 0; i < helpers; i++) pool->run(work);
+  work();
+
+  std::unique_lock l(batch->m);
+  batch->finished.wait(l, [&] { return batch->done == count; });
+}
+
+PakFile::PakFile(common::FileIO* io) {
+  this->io = io;
+  mapping = NULL;
+  mappingSize = 0;
+  entries = NULL;
+  numEntries = 0;
+  strings = NULL;
+  stringsSize = 0;
+  index = NULL;
+  indexSize = 0;
+  init();
+}
+
+PakFile::PakFile(const char* path) {
+  io = NULL;
+  entries = NULL;
+  numEntries = 0;
+  strings = NULL;
+  stringsSize = 0;
+  index = NULL;
+  indexSize = 0;
+  mapping = NULL;
+  mappingSize = 0;
+
+  std::optional<std::string> realPath =
+      common::FileSystem::singleton()->getRealPath(path);
+  if (!realPath || !map(realPath->c_str()))
+    io = common::FileSystem::singleton()->getFileIO(path, "rb").value();
+  init();
+}
+
+PakFile::~PakFile() {
+  if (mapping) munmap((void*)mapping, mappingSize);
+}
+
+bool PakFile::map(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  // the mapping keeps the file alive
+  if (addr == MAP_FAILED) {
+    rdm::Log::printf(rdm::LOG_WARN, "Could not mmap %s, using FileIO", path);
+    return false;
+  }
+
+  mapping = (const unsigned char*)addr;
+  mappingSize = st.st_size;
+  return true;
+}
+
+void PakFile::readAt(size_t offset, void* out, size_t size) {
+  if (mapping) {
+    if (offset > mappingSize || size > mappingSize - offset)
+      throw std::runtime_error("Pak read out of bounds");
+    memcpy(out, mapping + offset, size);
+  } else {
+    std::scoped_lock l(m);
+    io->seek(offset, SEEK_SET);
+    io->read(out, size);
+  }
+}
+
+const uint8_t* PakFile::getRaw(size_t offset, size_t size,
+                               std::vector<uint8_t>& scratch) {
+  if (mapping) return mapping + offset;
+  scratch.resize(size);
+  readAt(offset, scratch.data(), size);
+  return scratch.data();
+}
+
+void PakFile::readChunkTable(const PakFileEntry* entry,
+                             PakChunkHeader& header,
+                             std::vector<PakChunk>& chunks) {
+  if (entry->dataSize < sizeof(PakChunkHeader))
+    throw std::runtime_error("Pak chunk table out of bounds");
+  readAt(entry->dataOffset, &header, sizeof(header));
+
+  size_t tableSize = (size_t)header.numChunks * sizeof(PakChunk);
+  if (header.chunkSize == 0 ||
+      header.numChunks != (header.uncompressedSize + header.chunkSize - 1) /
+                              header.chunkSize ||
+      tableSize > entry->dataSize - sizeof(header))
+    throw std::runtime_error("Invalid pak chunk table");
+
+  chunks.resize(header.numChunks);
+  readAt(entry->dataOffset + sizeof(header), chunks.data(), tableSize);
+  for (auto& chunk : chunks) {
+    if (chunk.offset > entry->dataSize ||
+        chunk.size > entry->dataSize - chunk.offset)
+      throw std::runtime_error("Pak chunk out of bounds");
+  }
+}
+
+void PakFile::decompressChunks(CompressionType type, size_t offset,
+                               const PakChunkHeader& header,
+                               const std::vector<PakChunk>& chunks,
+                               uint32_t first, uint32_t last, uint8_t* out) {
+  std::atomic<bool> failed(false);
+  parallelFor(last - first + 1, [&](size_t n) {
+    uint32_t i = first + n;
+    std::vector<uint8_t> scratch;
+    const uint8_t* raw =
+        getRaw(offset + chunks[i].offset, chunks[i].size, scratch);
+    if (!decompressChunk(type, raw, chunks[i].size,
+                         out + (size_t)n * header.chunkSize,
+                         chunkUncompressedSize(header, i)))
+      failed = true;
+  });
+  if (failed) throw std::runtime_error("Pak chunk decompression failed");
+}
+
+uint64_t hashBytes(const void* data, size_t size) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+void buildIndex(const PakFileEntry* entries, size_t count, const char* strings,
+                std::vector<PakIndexSlot>& index) {
+  // keep the load factor at or under 0.5 so probes stay short
+  size_t size = 1;
+  while (size < count * 2) size <<= 1;
+  index.assign(size, PakIndexSlot{0, 0});
+
+  for (size_t i = 0; i < count; i++) {
+    const char* name = strings + entries[i].nameStringIdx;
+    uint64_t hash = hashBytes(name, strlen(name));
+    size_t slot = hash & (size - 1);
+    while (index[slot].entry) slot = (slot + 1) & (size - 1);
+    index[slot].hash = hash;
+    index[slot].entry = i + 1;
+  }
+}
+
+template <typename T>
+void PakFile::loadTable(const T*& ptr, std::vector<T>& owned, size_t offset,
+                        size_t count) {
+  if (count > SIZE_MAX / sizeof(T))
+    throw std::runtime_error("Pak table out of bounds");
+  if (mapping) {
+    if (offset > mappingSize || count * sizeof(T) > mappingSize - offset)
+      throw std::runtime_error("Pak table out of bounds");
+    ptr = (const T*)(mapping + offset);
+  } else {
+    owned.resize(count);
+    readAt(offset, owned.data(), count * sizeof(T));
+    ptr = owned.data();
+  }
+}
+
 void PakFile::init() {
-  if (!io) {
+  if (!io && !mapping) {
     throw std::runtime_error("No pakfile io");
   }
 
-  PakFileHeader hdr;
-  io->read(&hdr, sizeof(hdr));
+  char ident[4];
+  readAt(0, ident, sizeof(ident));
 
-  if (hdr.ident[0] != PAKF_HEADER_0 || hdr.ident[1] != PAKF_HEADER_1 ||
-      hdr.ident[2] != PAKF_HEADER_2 || hdr.ident[3] != PAKF_HEADER_3) {
+  if (ident[0] != PAKF_HEADER_0 || ident[1] != PAKF_HEADER_1 ||
+      ident[2] != PAKF_HEADER_2) {
     throw std::runtime_error("Invalid pak header");
   }
 
-  pakEntries.resize(hdr.numPakEntries);
-  io->seek(hdr.pakEntriesOffset, SEEK_SET);
-  io->read(pakEntries.data(), hdr.numPakEntries * sizeof(PakFileEntry));
+  switch (ident[3]) {
+    case PAKF_HEADER_3:
+      initLegacy();
+      break;
+    case PAKF_HEADER_3_VERSIONED:
+      initVersioned();
+      break;
+    default:
+      throw std::runtime_error("Invalid pak header");
+  }
 
-  std::vector<PakFileString> pakStrings;
+  for (size_t i = 0; i < numEntries; i++) {
+    const PakFileEntry& entry = entries[i];
+    if (mapping && (entry.dataOffset > mappingSize ||
+                    entry.dataSize > mappingSize - entry.dataOffset))
+      throw std::runtime_error("Pak entry out of bounds");
+    if (entry.nameStringIdx >= stringsSize)
+      throw std::runtime_error("Pak entry name out of bounds");
+  }
+
+  isGeneral = false;
+}
+
+void PakFile::initVersioned() {
+  PakFileHeaderV2 hdr;
+  readAt(0, &hdr, sizeof(hdr));
+  if (hdr.version != PAK_VERSION)
+    throw std::runtime_error("Unsupported pak version");
 
-  pakStrings.resize(hdr.numStrings);
-  io->seek(hdr.stringsOffset, SEEK_SET);
-  io->read(pakStrings.data(), hdr.numStrings * sizeof(PakFileString));
+  loadTable(entries, ownedEntries, hdr.pakEntriesOffset, hdr.numPakEntries);
+  numEntries = hdr.numPakEntries;
+  loadTable(strings, ownedStrings, hdr.stringsOffset, hdr.stringsSize);
+  stringsSize = hdr.stringsSize;
+  loadTable(index, ownedIndex, hdr.indexOffset, hdr.indexSize);
+  indexSize = hdr.indexSize;
 
-  for (int i = 0; i < pakStrings.size(); i++) {
-    char buf[PATH_MAX];
-    memset(buf, 0, sizeof(buf));
-    io->seek(pakStrings[i].stringOffset, SEEK_SET);
-    io->read(buf, std::min((size_t)PATH_MAX - 1, pakStrings[i].stringSize));
-    std::string str(buf);
-    pakStringsMap[i] = str;
+  if (stringsSize == 0 || strings[stringsSize - 1] != '\0')
+    throw std::runtime_error("Pak strings are not terminated");
+  if (indexSize & (indexSize - 1) || indexSize < numEntries)
+    throw std::runtime_error("Invalid pak index");
+  for (size_t i = 0; i < indexSize; i++)
+    if (index[i].entry > numEntries)
+      throw std::runtime_error("Invalid pak index");
+}
+
+void PakFile::initLegacy() {
+  PakFileHeader hdr;
+  readAt(0, &hdr, sizeof(hdr));
+
+  const PakFileEntry* fileEntries;
+  loadTable(fileEntries, ownedEntries, hdr.pakEntriesOffset,
+            hdr.numPakEntries);
+  if (fileEntries != ownedEntries.data())
+    ownedEntries.assign(fileEntries, fileEntries + hdr.numPakEntries);
+
+  std::vector<PakFileString> pakStrings;
+  const PakFileString* fileStrings;
+  loadTable(fileStrings, pakStrings, hdr.stringsOffset, hdr.numStrings);
+
+  // flatten the strings into one blob and point the entries at it
+  std::vector<uint64_t> stringOffsets(hdr.numStrings);
+  for (size_t i = 0; i < hdr.numStrings; i++) {
+    size_t size = std::min((size_t)PATH_MAX - 1, fileStrings[i].stringSize);
+    stringOffsets[i] = ownedStrings.size();
+    ownedStrings.resize(ownedStrings.size() + size + 1);
+    readAt(fileStrings[i].stringOffset, &ownedStrings[stringOffsets[i]], size);
+    ownedStrings.back() = '\0';
   }
+  ownedStrings.push_back('\0');  // so an empty pak still has a blob
 
-  for (int i = 0; i < pakEntries.size(); i++) {
-    PakFileEntry& entry = pakEntries[i];
-    fileNameMap[pakStringsMap[entry.nameStringIdx]] = i;
+  for (auto& entry : ownedEntries) {
+    if (entry.nameStringIdx >= hdr.numStrings)
+      throw std::runtime_error("Pak entry name out of bounds");
+    entry.nameStringIdx = stringOffsets[entry.nameStringIdx];
   }
 
-  isGeneral = false;
+  entries = ownedEntries.data();
+  numEntries = ownedEntries.size();
+  strings = ownedStrings.data();
+  stringsSize = ownedStrings.size();
+  buildIndex(entries, numEntries, strings, ownedIndex);
+  index = ownedIndex.data();
+  indexSize = ownedIndex.size();
 }
 
 PakFileIO::PakFileIO(PakFile* file, size_t offset, size_t size,
@@ -57,6 +485,7 @@ PakFileIO::PakFileIO(PakFile* file, size_t offset, size_t size,
   this->cursor = 0;
   this->io = io;
   this->file = file;
+  this->data = file->mapping ? file->mapping + offset : NULL;
 }
 
 size_t PakFileIO::seek(size_t pos, int whence) {
@@ -68,7 +497,7 @@ size_t PakFileIO::seek(size_t pos, int whence) {
       cursor = std::min(size, cursor + pos);
       break;
     case SEEK_END:
-      cursor = std::max((size_t)0, size - cursor);
+      cursor = std::min(size, size + pos);
       break;
   }
   return cursor;
@@ -79,23 +508,151 @@ size_t PakFileIO::fileSize() { return size; }
 size_t PakFileIO::tell() { return cursor; }
 
 size_t PakFileIO::read(void* out, size_t size) {
-  std::scoped_lock l(file->m);
-
   size_t sz = std::min(size, this->size - cursor);
-  io->seek(offset + cursor, SEEK_SET);
-  return io->read(out, sz);
+  if (data) {
+    memcpy(out, data + cursor, sz);
+  } else {
+    std::scoped_lock l(file->m);
+    io->seek(offset + cursor, SEEK_SET);
+    sz = io->read(out, sz);
+  }
+  cursor += sz;
+  return sz;
+}
+
+PakCompressedFileIO::PakCompressedFileIO(PakFile* file,
+                                         const PakFileEntry* entry) {
+  this->file = file;
+  this->type = entry->type;
+  this->offset = entry->dataOffset;
+  this->cursor = 0;
+  file->readChunkTable(entry, header, chunks);
+}
+
+size_t PakCompressedFileIO::seek(size_t pos, int whence) {
+  size_t size = header.uncompressedSize;
+  switch (whence) {
+    case SEEK_SET:
+      cursor = std::min(size, pos);
+      break;
+    case SEEK_CUR:
+      cursor = std::min(size, cursor + pos);
+      break;
+    case SEEK_END:
+      cursor = std::min(size, size + pos);
+      break;
+  }
+  return cursor;
+}
+
+size_t PakCompressedFileIO::fileSize() { return header.uncompressedSize; }
+
+size_t PakCompressedFileIO::tell() { return cursor; }
+
+std::vector<uint8_t>& PakCompressedFileIO::getChunk(uint32_t index) {
+  for (auto it = cache.begin(); it != cache.end(); it++) {
+    if (it->index == index) {
+      cache.splice(cache.begin(), cache, it);
+      return cache.front().data;
+    }
+  }
+
+  if (cache.size() >= PAK_CHUNK_CACHE) cache.pop_back();
+  CachedChunk chunk;
+  chunk.index = index;
+  chunk.data.resize(chunkUncompressedSize(header, index));
+  file->decompressChunks(type, offset, header, chunks, index, index,
+                         chunk.data.data());
+  cache.push_front(std::move(chunk));
+  return cache.front().data;
+}
+
+size_t PakCompressedFileIO::read(void* out, size_t size) {
+  size_t sz = std::min(size, (size_t)header.uncompressedSize - cursor);
+  uint8_t* dst = (uint8_t*)out;
+  size_t done = 0;
+  while (done < sz) {
+    size_t pos = cursor + done;
+    uint32_t index = pos / header.chunkSize;
+    size_t inChunk = pos % header.chunkSize;
+
+    // runs of whole chunks are decoded in parallel straight into out
+    uint32_t last = index;
+    size_t run = 0;
+    if (inChunk == 0) {
+      while (last < header.numChunks &&
+             run + chunkUncompressedSize(header, last) <= sz - done) {
+        run += chunkUncompressedSize(header, last);
+        last++;
+      }
+    }
+    if (run) {
+      file->decompressChunks(type, offset, header, chunks, index, last - 1,
+                             dst + done);
+      done += run;
+      continue;
+    }
+
+    std::vector<uint8_t>& chunk = getChunk(index);
+    size_t n = std::min(chunk.size() - inChunk, sz - done);
+    memcpy(dst + done, chunk.data() + inChunk, n);
+    done += n;
+  }
+  cursor += sz;
+  return sz;
+}
+
+const PakFileEntry* PakFile::getEntry(const char* path) {
+  uint64_t hash = hashBytes(path, strlen(path));
+  for (size_t i = 0; i < indexSize; i++) {
+    const PakIndexSlot& slot = index[(hash + i) & (indexSize - 1)];
+    if (!slot.entry) return NULL;
+    if (slot.hash != hash) continue;
+    const PakFileEntry* entry = &entries[slot.entry - 1];
+    if (strcmp(strings + entry->nameStringIdx, path) == 0) return entry;
+  }
+  return NULL;
+}
+
+bool PakFile::getFileExists(const char* path) { return getEntry(path); }
+
+common::OptionalData PakFile::getFileData(const char* path) {
+  if (common::OptionalSpan span = getFileSpan(path))
+    return std::vector<unsigned char>(span->begin(), span->end());
+
+  const PakFileEntry* entry = getEntry(path);
+  if (entry && entry->type != None && compressionSupported(entry->type)) {
+    PakChunkHeader header;
+    std::vector<PakChunk> chunks;
+    readChunkTable(entry, header, chunks);
+
+    std::vector<unsigned char> data(header.uncompressedSize);
+    if (header.numChunks)
+      decompressChunks(entry->type, entry->dataOffset, header, chunks, 0,
+                       header.numChunks - 1, data.data());
+    return data;
+  }
+  return common::FileSystemAPI::getFileData(path);
+}
+
+common::OptionalSpan PakFile::getFileSpan(const char* path) {
+  const PakFileEntry* entry = getEntry(path);
+  if (!entry || !mapping || entry->type != None) return {};
+  return std::span<const unsigned char>(mapping + entry->dataOffset,
+                                        entry->dataSize);
 }
 
 std::optional<common::FileIO*> PakFile::getFileIO(const char* path,
                                                   const char* mode) {
   assert(mode[0] == 'r');
 
-  if (fileNameMap.find(path) != fileNameMap.end()) {
-    PakFileEntry& entry = pakEntries[fileNameMap[path]];
-    switch (entry.type) {
+  if (const PakFileEntry* entry = getEntry(path)) {
+    switch (entry->type) {
       case None:
-        return new PakFileIO(this, entry.dataOffset, entry.dataSize, io);
+        return new PakFileIO(this, entry->dataOffset, entry->dataSize, io);
       default:
+        if (compressionSupported(entry->type))
+          return new PakCompressedFileIO(this, entry);
         rdm::Log::printf(rdm::LOG_ERROR, "Unsupported compression");
         return {};
     }
@@ -1,5 +1,9 @@
 #pragma once
-#include <unordered_map>
+#include <stdint.h>
+
+#include <list>
+#include <mutex>
+#include <vector>
 
 #include "filesystem.hpp"
 namespace pak {
@@ -7,6 +11,14 @@ namespace pak {
 #define PAKF_HEADER_1 'A'
 #define PAKF_HEADER_2 'K'
 #define PAKF_HEADER_3 'R'
+// versioned paks end their ident with this and carry a version number
+#define PAKF_HEADER_3_VERSIONED 'V'
+#define PAK_VERSION 2
+
+// uncompressed bytes per chunk of a compressed entry
+#define PAK_CHUNK_SIZE (256 * 1024)
+// decompressed chunks kept around by each PakCompressedFileIO
+#define PAK_CHUNK_CACHE 4
 
 struct __attribute__((packed)) PakFileHeader {
   char ident[4];
@@ -35,12 +47,69 @@ struct __attribute__((packed)) PakFileString {
   uint64_t stringOffset;
 };
 
+/**
+ * Header of versioned paks. In these PakFileEntry::nameStringIdx is a byte
+ * offset into the strings blob, which holds NUL terminated paths. The index
+ * is an open addressing table of indexSize (a power of two) slots keyed by
+ * hashBytes of the path, probed linearly.
+ */
+struct __attribute__((packed)) PakFileHeaderV2 {
+  char ident[4];
+  uint32_t version;
+  uint64_t pakEntriesOffset;
+  uint64_t numPakEntries;
+  uint64_t stringsOffset;
+  uint64_t stringsSize;
+  uint64_t indexOffset;
+  uint64_t indexSize;
+};
+
+struct __attribute__((packed)) PakIndexSlot {
+  uint64_t hash;
+  // entry index + 1, 0 if the slot is empty
+  uint64_t entry;
+};
+
+// FNV-1a, used for the path index and by pak_file_creator for dedup
+uint64_t hashBytes(const void* data, size_t size);
+// builds the path index for entries whose names are offsets into strings
+void buildIndex(const PakFileEntry* entries, size_t count, const char* strings,
+                std::vector<PakIndexSlot>& index);
+
+/**
+ * Compressed entries are split into chunks that can be decompressed on their
+ * own (one zstd frame or xz stream each). The entry data starts with this
+ * header, followed by numChunks PakChunks and then the chunk data. Offsets are
+ * relative to the start of the entry data.
+ */
+struct __attribute__((packed)) PakChunkHeader {
+  uint64_t uncompressedSize;
+  uint32_t chunkSize;
+  uint32_t numChunks;
+};
+
+struct __attribute__((packed)) PakChunk {
+  uint64_t offset;
+  uint64_t size;
+};
+
+bool compressionSupported(CompressionType type);
+// builds the chunked representation described above, returns false if the
+// compressor failed
+bool compressChunked(CompressionType type, const uint8_t* in, size_t size,
+                     std::vector<uint8_t>& out,
+                     size_t chunkSize = PAK_CHUNK_SIZE);
+bool decompressChunk(CompressionType type, const uint8_t* in, size_t inSize,
+                     uint8_t* out, size_t outSize);
+
 class PakFile;
 class PakFileIO : public common::FileIO {
   friend class PakFile;
 
   PakFile* file;
   common::FileIO* io;
+  // points into the pak mapping, reads are a memcpy and need no lock
+  const unsigned char* data;
 
   size_t offset;
   size_t size;
@@ -56,32 +125,110 @@ class PakFileIO : public common::FileIO {
   virtual size_t read(void* out, size_t size);
 };
 
+class PakCompressedFileIO : public common::FileIO {
+  friend class PakFile;
+
+  struct CachedChunk {
+    uint32_t index;
+    std::vector<uint8_t> data;
+  };
+
+  PakFile* file;
+  CompressionType type;
+  size_t offset;
+  PakChunkHeader header;
+  std::vector<PakChunk> chunks;
+  size_t cursor;
+  // most recently used at the front
+  std::list<CachedChunk> cache;
+
+  PakCompressedFileIO(PakFile* file, const PakFileEntry* entry);
+
+  std::vector<uint8_t>& getChunk(uint32_t index);
+
+ private:
+  virtual size_t seek(size_t pos, int whence);
+  virtual size_t fileSize();
+  virtual size_t tell();
+
+  virtual size_t read(void* out, size_t size);
+};
+
+/**
+ * @brief A read only archive created by pak_file_creator.
+ *
+ * If the pak lives on a real file it is mmap'd and every read is served
+ * straight from the mapping, so concurrent PakFileIOs don't contend. Paks
+ * opened from a FileIO (e.g. nested in another pak) fall back to seeking the
+ * shared FileIO under a lock.
+ *
+ * Versioned paks store their directory (entries, string blob and path hash
+ * index) so that a mapped pak uses it in place. Legacy paks get the same
+ * tables built in memory when they are opened.
+ */
 class PakFile : public common::FileSystemAPI {
-  common::FileIO* io;
+  friend class PakFileIO;
+  friend class PakCompressedFileIO;
 
-  std::vector<PakFileEntry> pakEntries;
-  std::unordered_map<int, std::string> pakStringsMap;
-  std::unordered_map<std::string, int> fileNameMap;
+  common::FileIO* io;
+  const unsigned char* mapping;
+  size_t mappingSize;
+
+  // point into the mapping for versioned paks, otherwise into the owned
+  // vectors below
+  const PakFileEntry* entries;
+  size_t numEntries;
+  const char* strings;
+  size_t stringsSize;
+  const PakIndexSlot* index;
+  size_t indexSize;
+
+  std::vector<PakFileEntry> ownedEntries;
+  std::vector<char> ownedStrings;
+  std::vector<PakIndexSlot> ownedIndex;
   bool isGeneral;
 
   void init();
+  void initLegacy();
+  void initVersioned();
+  // points ptr at a table in the mapping, or reads it into owned
+  template <typename T>
+  void loadTable(const T*& ptr, std::vector<T>& owned, size_t offset,
+                 size_t count);
+  bool map(const char* path);
+  void readAt(size_t offset, void* out, size_t size);
+  // pointer to raw pak bytes, either into the mapping or copied into scratch
+  const uint8_t* getRaw(size_t offset, size_t size,
+                        std::vector<uint8_t>& scratch);
+  // decompresses chunks [first, last] of a compressed entry into out, in
+  // parallel when there is more than one
+  void decompressChunks(CompressionType type, size_t offset,
+                        const PakChunkHeader& header,
+                        const std::vector<PakChunk>& chunks, uint32_t first,
+                        uint32_t last, uint8_t* out);
+  void readChunkTable(const PakFileEntry* entry, PakChunkHeader& header,
+                      std::vector<PakChunk>& chunks);
+  const PakFileEntry* getEntry(const char* path);
 
  public:
-  PakFile(common::FileIO* io) {
-    this->io = io;
-    init();
-  }
-  PakFile(const char* path) {
-    io = common::FileSystem::singleton()->getFileIO(path, "rb").value();
-    init();
-  }
+  PakFile(common::FileIO* io);
+  PakFile(const char* path);
+  ~PakFile();
 
   virtual bool generalFSApi() { return isGeneral; }
+  virtual bool getFileExists(const char* path);
+  virtual common::OptionalData getFileData(const char* path);
+  virtual common::OptionalSpan getFileSpan(const char* path);
   virtual std::optional<common::FileIO*> getFileIO(const char* path,
                                                    const char* mode);
 
-  void setGeneralFs(bool f) { isGeneral = f; }
+  void setGeneralFs(bool f) {
+    isGeneral = f;
+    common::FileSystem::singleton()->invalidateCache();
+  }
+  bool isMapped() { return mapping != NULL; }
 
+  // guards io, only used when the pak isn't mapped
   std::mutex m;
 };
 }  // namespace pak
@@ -1,100 +1,60 @@
 #include <dirent.h>
-#include <lzma.h>
 #include <string.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
+#include <map>
 #include <mutex>
-#include <sstream>
-#include <thread>
+#include <string>
+#include <vector>
 
 #include "pak_file.hpp"
 
+// entry data starts on this boundary so mmap'd readers get aligned blobs
+#define PAK_DATA_ALIGNMENT 64
+
 struct PakTmpEntry {
-  pak::PakFileEntry entry;
+  std::string path;
+  std::vector<uint8_t> data;
+  pak::CompressionType type;
+  uint64_t hash;
+  bool ready;
+  bool failed;
 };
 
-struct Fm {
-  FILE* f;
-  std::string path;
+struct PakBlob {
+  uint64_t dataOffset;
+  uint64_t dataSize;
+  pak::CompressionType type;
 };
 
 struct PakTmp {
   FILE* output;
   std::vector<pak::PakFileEntry> entries;
-  std::vector<pak::PakFileString> stringEntries;
-  std::vector<Fm> toProcess;
-  std::mutex m;
+  std::vector<PakTmpEntry> toProcess;
   std::string rootDir;
-};
-
-static bool compress_lzma(uint8_t* inData, size_t inDataSize, uint8_t** outData,
-                          int* outDataSize) {
-  lzma_stream strm = LZMA_STREAM_INIT;
-  lzma_ret ret = lzma_easy_encoder(&strm, 6, LZMA_CHECK_CRC32);
-  if (ret != LZMA_OK) throw std::runtime_error("lzma_easy_encoder != LZMA_OK");
-  uint8_t inbuf[BUFSIZ];
-  uint8_t outbuf[BUFSIZ];
-  strm.next_in = inbuf;
-  strm.avail_in = sizeof(inbuf);
-  strm.next_out = outbuf;
-  strm.avail_out = sizeof(outbuf);
-  size_t dataBufSize = BUFSIZ;
-  uint8_t* dataBuf = (uint8_t*)malloc(dataBufSize);
-  size_t writeCount = 0;
-  size_t readCount = 0;
-  while (true) {
-    lzma_action action = LZMA_RUN;
-    if (strm.avail_in == 0 && readCount < inDataSize) {
-      strm.next_in = inbuf;
-      size_t toRead = std::min(inDataSize - readCount, (size_t)BUFSIZ);
-      memcpy(inbuf, inData + readCount, toRead);
-      strm.avail_in = toRead;
-      readCount += toRead;
-
-      if (readCount >= inDataSize) {
-        action = LZMA_FINISH;
-      }
-    }
-
-    lzma_ret ret = lzma_code(&strm, action);
-    if (strm.avail_out == 0 || ret == LZMA_STREAM_END) {
-      size_t write_size = sizeof(outbuf) - strm.avail_out;
-      if (dataBufSize < writeCount + write_size) {
-        dataBufSize *= 2;
-        dataBuf = (uint8_t*)realloc(dataBuf, dataBufSize);
-      }
-      memcpy(dataBuf + writeCount, outbuf, write_size);
-      writeCount += write_size;
+  pak::CompressionType compression;
 
-      strm.next_out = outbuf;
-      strm.avail_out = sizeof(outbuf);
-    }
-
-    if (ret == LZMA_STREAM_END) break;
-    switch (ret) {
-      case LZMA_OK:
-        break;
-      case LZMA_MEM_ERROR:
-        fprintf(stderr, "Memory allocation failed\n");
-        free(dataBuf);
-        return false;
-      case LZMA_DATA_ERROR:
-        fprintf(stderr, "File size limits exceeded\n");
-        free(dataBuf);
-        return false;
-      default:
-        // fprintf(stderr, "Compression failure\n");
-        free(dataBuf);
-        return false;
-    }
-  }
-
-  *outData = dataBuf;
-  *outDataSize = writeCount;
+  // guards the ready flags and nextWrite
+  std::mutex m;
+  // held by whichever thread is writing finished entries
+  std::mutex writer;
+  size_t nextWrite;
+
+  // (hash, size) -> every distinct blob written with that key
+  std::map<std::pair<uint64_t, uint64_t>, std::vector<PakBlob>> blobs;
+  size_t dedupedFiles;
+  size_t dedupedBytes;
+};
 
-  lzma_end(&strm);
-  return true;
+// pads the output with zeros up to the next multiple of alignment
+static size_t align(FILE* output, size_t alignment) {
+  static const uint8_t zero[PAK_DATA_ALIGNMENT] = {};
+  size_t offset = ftell(output);
+  size_t aligned = (offset + alignment - 1) / alignment * alignment;
+  fwrite(zero, aligned - offset, 1, output);
+  return aligned;
 }
 
 void recurse_directory(DIR* dir, std::string path, PakTmp* tmp) {
@@ -105,20 +65,10 @@ void recurse_directory(DIR* dir, std::string path, PakTmp* tmp) {
     if (strcmp(dp->d_name, ".") != 0 && strcmp(dp->d_name, "..") != 0) {
       DIR* _dir = opendir((tmp->rootDir + _path).c_str());
       if (!_dir) {
-        FILE* file = fopen((tmp->rootDir + _path).c_str(), "rb");
-        if (!file) {
-          printf("Failed opening %s\n", (tmp->rootDir + _path).c_str());
-          continue;
-        }
-        fseek(file, 0, SEEK_END);
-        if (ftell(file) == 0) {
-          fclose(file);
-          continue;
-        }
-        fseek(file, 0, SEEK_SET);
-        Fm f;
-        f.f = file;
+        PakTmpEntry f;
         f.path = _path;
+        f.ready = false;
+        f.failed = false;
         tmp->toProcess.push_back(f);
       } else {
         _path += "/";
@@ -129,32 +79,158 @@ void recurse_directory(DIR* dir, std::string path, PakTmp* tmp) {
   closedir(dir);
 }
 
-struct Progress {
-  int count;
-  int max;
-  bool done;
-  std::mutex m;
-};
+// reads and compresses one file, runs on the omp threads
+static void processEntry(PakTmp* tmp, PakTmpEntry& f) {
+  FILE* file = fopen((tmp->rootDir + f.path).c_str(), "rb");
+  if (!file) {
+    printf("Failed opening %s\n", (tmp->rootDir + f.path).c_str());
+    f.failed = true;
+    return;
+  }
+
+  fseek(file, 0, SEEK_END);
+  size_t size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  std::vector<uint8_t> data(size);
+  if (size == 0 || fread(data.data(), size, 1, file) != 1) {
+    f.failed = true;  // empty files were never packed
+    fclose(file);
+    return;
+  }
+  fclose(file);
+
+  // only keep the compressed version if it's actually smaller
+  std::vector<uint8_t> dataOut;
+  if (tmp->compression != pak::None &&
+      pak::compressChunked(tmp->compression, data.data(), data.size(),
+                           dataOut) &&
+      dataOut.size() < data.size()) {
+    f.type = tmp->compression;
+    f.data = std::move(dataOut);
+  } else {
+    f.type = pak::None;
+    f.data = std::move(data);
+  }
+  f.hash = pak::hashBytes(f.data.data(), f.data.size());
+}
+
+static bool sameBlob(FILE* output, const PakBlob& blob,
+                     const std::vector<uint8_t>& data) {
+  std::vector<uint8_t> old(blob.dataSize);
+  fseek(output, blob.dataOffset, SEEK_SET);
+  bool same = fread(old.data(), old.size(), 1, output) == 1 && old == data;
+  fseek(output, 0, SEEK_END);
+  return same;
+}
+
+static void writeEntry(PakTmp* tmp, PakTmpEntry& f) {
+  if (!f.failed) {
+    pak::PakFileEntry entry;
+    entry.nameStringIdx = 0;  // filled in once the string blob is laid out
+    entry.licenseStringIdx = 0;
+
+    std::vector<PakBlob>& candidates = tmp->blobs[{f.hash, f.data.size()}];
+    auto it = std::find_if(
+        candidates.begin(), candidates.end(), [&](const PakBlob& blob) {
+          return blob.type == f.type && sameBlob(tmp->output, blob, f.data);
+        });
+    if (it != candidates.end()) {
+      entry.dataOffset = it->dataOffset;
+      entry.dataSize = it->dataSize;
+      entry.type = it->type;
+      tmp->dedupedFiles++;
+      tmp->dedupedBytes += f.data.size();
+    } else {
+      entry.dataOffset = align(tmp->output, PAK_DATA_ALIGNMENT);
+      entry.dataSize = f.data.size();
+      entry.type = f.type;
+      fwrite(f.data.data(), f.data.size(), 1, tmp->output);
+      candidates.push_back({entry.dataOffset, entry.dataSize, entry.type});
+    }
+    tmp->entries.push_back(entry);
+  }
+
+  // free it as soon as it's on disk
+  std::vector<uint8_t>().swap(f.data);
+
+  size_t count = tmp->nextWrite + 1;
+  size_t max = tmp->toProcess.size();
+  if (count * 100 / max != tmp->nextWrite * 100 / max || count == max)
+    printf("%0.2f%%\n", ((float)count / (float)max) * 100.f);
+}
+
+// writes finished entries in path order. whoever gets the writer lock drains
+// as far as it can, then rechecks in case something became ready while it
+// was still holding the lock
+static void drain(PakTmp* tmp) {
+  while (true) {
+    if (!tmp->writer.try_lock()) return;
+    while (true) {
+      PakTmpEntry* f;
+      {
+        std::scoped_lock l(tmp->m);
+        if (tmp->nextWrite == tmp->toProcess.size() ||
+            !tmp->toProcess[tmp->nextWrite].ready)
+          break;
+        f = &tmp->toProcess[tmp->nextWrite];
+      }
+      writeEntry(tmp, *f);
+      std::scoped_lock l(tmp->m);
+      tmp->nextWrite++;
+    }
+    tmp->writer.unlock();
+
+    std::scoped_lock l(tmp->m);
+    if (tmp->nextWrite == tmp->toProcess.size() ||
+        !tmp->toProcess[tmp->nextWrite].ready)
+      return;
+  }
+}
 
 int main(int argc, char** argv) {
-  if (argc != 3) {
-    fprintf(stderr, "pak_file_creator <output file> <directory>\n");
+  if (argc != 3 && argc != 4) {
+    fprintf(stderr,
+            "pak_file_creator <output file> <directory> [none/zstd/lzma]\n");
     return 1;
   }
 
+  pak::CompressionType compression = pak::None;
+  if (argc == 4) {
+    if (strcmp(argv[3], "zstd") == 0)
+      compression = pak::Zstd;
+    else if (strcmp(argv[3], "lzma") == 0)
+      compression = pak::Lzma;
+    else if (strcmp(argv[3], "none") != 0) {
+      fprintf(stderr, "unknown compression %s\n", argv[3]);
+      return 1;
+    }
+
+    if (!pak::compressionSupported(compression)) {
+      fprintf(stderr, "%s support was not compiled in\n", argv[3]);
+      return 1;
+    }
+  }
+
   PakTmp* tmp = new PakTmp;
   tmp->rootDir = std::string(argv[2]) + "/";
-  tmp->output = fopen(argv[1], "wb");
+  tmp->compression = compression;
+  tmp->nextWrite = 0;
+  tmp->dedupedFiles = 0;
+  tmp->dedupedBytes = 0;
+  // w+ so duplicate candidates can be read back and compared
+  tmp->output = fopen(argv[1], "w+b");
 
   if (!tmp->output) {
     fprintf(stderr, "Could not open %s (%s)", argv[1], strerror(errno));
+    return 1;
   }
 
-  pak::PakFileHeader hdr;
+  pak::PakFileHeaderV2 hdr;
   hdr.ident[0] = PAKF_HEADER_0;
   hdr.ident[1] = PAKF_HEADER_1;
   hdr.ident[2] = PAKF_HEADER_2;
-  hdr.ident[3] = PAKF_HEADER_3;
+  hdr.ident[3] = PAKF_HEADER_3_VERSIONED;
+  hdr.version = PAK_VERSION;
 
   fseek(tmp->output, 0x1000, SEEK_SET);
 
@@ -165,112 +241,65 @@ int main(int argc, char** argv) {
   }
 
   recurse_directory(root, "", tmp);
-  printf("%i files to pack", tmp->toProcess.size());
-
-  Progress p;
-  p.count = 0;
-  p.max = tmp->toProcess.size();
-  p.done = false;
-
-  std::thread pbar([&p] {
-    int oldCount = 0;
-    while (true) {
-      if (p.count != oldCount) {
-        printf("%0.2f%%\n", ((float)p.count / (float)p.max) * 100.f);
-        oldCount = p.count;
-      }
-
-      if (p.done) break;
-
-      std::this_thread::yield();
-    }
-  });
-#pragma omp parallel for
-  for (auto& f : tmp->toProcess) {
-    pak::PakFileEntry entry;
-    pak::PakFileString stringEntry;
-
-    fseek(f.f, 0, SEEK_END);
-    entry.dataSize = ftell(f.f);
-    fseek(f.f, 0, SEEK_SET);
-
-    void* data = malloc(entry.dataSize);
-    fread(data, entry.dataSize, 1, f.f);
-
-    // determine best compression
-
-    uint8_t* dataOut;
-    int dataOutSize;
-
-#ifdef COMPRESS_LZMA
-    if (compress_lzma((uint8_t*)data, entry.dataSize, &dataOut, &dataOutSize)) {
-      entry.type = pak::Lzma;
-      {
-        std::scoped_lock l(tmp->m);
-        entry.dataOffset = ftell(tmp->output);
-        fwrite(dataOut, dataOutSize, 1, tmp->output);
-
-        stringEntry.stringSize = f.path.size();
-        stringEntry.stringOffset = ftell(tmp->output);
-        fwrite(f.path.c_str(), stringEntry.stringSize, 1, tmp->output);
-
-        entry.nameStringIdx = tmp->stringEntries.size();
-        tmp->stringEntries.push_back(stringEntry);
-        tmp->entries.push_back(entry);
-
-        fflush(tmp->output);
-      }
-      free(dataOut);
-      entry.dataSize = dataOutSize;
-    } else {
-#endif
-      entry.type = pak::None;
-      {
-        std::scoped_lock l(tmp->m);
-        entry.dataOffset = ftell(tmp->output);
-        fwrite(data, entry.dataSize, 1, tmp->output);
-
-        stringEntry.stringSize = f.path.size();
-        stringEntry.stringOffset = ftell(tmp->output);
-        fwrite(f.path.c_str(), stringEntry.stringSize, 1, tmp->output);
-
-        entry.nameStringIdx = tmp->stringEntries.size();
-        tmp->stringEntries.push_back(stringEntry);
-        tmp->entries.push_back(entry);
-
-        fflush(tmp->output);
-      }
-#ifdef COMPRESS_LZMA
-    }
-#endif
-
+  // readdir order depends on the file system, sort so the same tree always
+  // gives the same pak
+  std::sort(tmp->toProcess.begin(), tmp->toProcess.end(),
+            [](const PakTmpEntry& a, const PakTmpEntry& b) {
+              return a.path < b.path;
+            });
+  printf("%zu files to pack\n", tmp->toProcess.size());
+
+  long count = tmp->toProcess.size();
+#pragma omp parallel for schedule(dynamic)
+  for (long i = 0; i < count; i++) {
+    processEntry(tmp, tmp->toProcess[i]);
     {
-      std::scoped_lock l(p.m);
-      p.count++;
+      std::scoped_lock l(tmp->m);
+      tmp->toProcess[i].ready = true;
     }
+    drain(tmp);
+  }
+  drain(tmp);
 
-    free(data);
+  printf("DONE (%zu files, %zu duplicates, %zu bytes saved)\n",
+         tmp->entries.size(), tmp->dedupedFiles, tmp->dedupedBytes);
+
+  // the directory goes at the end: a blob of NUL terminated paths, the
+  // entries, then the path hash index. tables are 8 byte aligned so they can
+  // be used straight out of the mapping
+  std::vector<char> strings;
+  size_t entryIdx = 0;
+  for (auto& f : tmp->toProcess) {
+    if (f.failed) continue;
+    tmp->entries[entryIdx++].nameStringIdx = strings.size();
+    strings.insert(strings.end(), f.path.begin(), f.path.end());
+    strings.push_back('\0');
   }
+  strings.push_back('\0');  // so an empty pak still has a blob
 
-  printf("DONE (%i, %i)\n", p.count, p.max);
-  p.done = true;
-  pbar.join();
+  std::vector<pak::PakIndexSlot> index;
+  pak::buildIndex(tmp->entries.data(), tmp->entries.size(), strings.data(),
+                  index);
 
-  hdr.numStrings = tmp->stringEntries.size();
+  // past the header area even if no data was written
+  fseek(tmp->output, 0, SEEK_END);
+  if (ftell(tmp->output) < 0x1000) fseek(tmp->output, 0x1000, SEEK_SET);
   hdr.stringsOffset = ftell(tmp->output);
-  for (int i = 0; i < tmp->stringEntries.size(); i++) {
-    fwrite(&tmp->stringEntries[i], sizeof(pak::PakFileString), 1, tmp->output);
-  }
+  hdr.stringsSize = strings.size();
+  fwrite(strings.data(), strings.size(), 1, tmp->output);
 
   hdr.numPakEntries = tmp->entries.size();
-  hdr.pakEntriesOffset = ftell(tmp->output);
-  for (int i = 0; i < tmp->entries.size(); i++) {
-    fwrite(&tmp->entries[i], sizeof(pak::PakFileEntry), 1, tmp->output);
-  }
+  hdr.pakEntriesOffset = align(tmp->output, 8);
+  fwrite(tmp->entries.data(), sizeof(pak::PakFileEntry), tmp->entries.size(),
+         tmp->output);
+
+  hdr.indexSize = index.size();
+  hdr.indexOffset = align(tmp->output, 8);
+  fwrite(index.data(), sizeof(pak::PakIndexSlot), index.size(), tmp->output);
 
   fseek(tmp->output, 0x0, SEEK_SET);
 
-  fwrite(&hdr, sizeof(pak::PakFileHeader), 1, tmp->output);
+  fwrite(&hdr, sizeof(pak::PakFileHeaderV2), 1, tmp->output);
 
   fclose(tmp->output);
 
@@ -0,0 +1,337 @@
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+
+#include "async_io.hpp"
+#include "mesh_optimize.hpp"
+#include "network/statistics.hpp"
+#include "pak_file.hpp"
+#include "scheduler.hpp"
+#include "testgame.hpp"
+#include "testsystem.hpp"
+namespace test {
+class NetworkStatisticsTest : public Test {
+ public:
+  NetworkStatisticsTest() : Test("Network Statistics", Base) {}
+
+  virtual Result run(TestGame* game) {
+    rdm::network::NetworkStatistics statistics;
+    statistics.record(rdm::network::NetworkStatistics::PacketCategory,
+                      rdm::network::NetworkStatistics::Incoming, "Test", 10);
+    statistics.frame();
+    statistics.record(rdm::network::NetworkStatistics::PacketCategory,
+                      rdm::network::NetworkStatistics::Incoming, "Test", 5);
+
+    auto histograms = statistics.getHistograms(
+        rdm::network::NetworkStatistics::PacketCategory,
+        rdm::network::NetworkStatistics::Incoming);
+    auto& histogram = histograms["Test"];
+    if (histogram.totalBytes != 15 || histogram.windowCount() != 2 ||
+        histogram.peakBytes() != 10)
+      return Failed;
+
+    for (int i = 0; i < NETWORK_STATISTICS_FRAMES; i++) statistics.frame();
+    histograms = statistics.getHistograms(
+        rdm::network::NetworkStatistics::PacketCategory,
+        rdm::network::NetworkStatistics::Incoming);
+    if (histograms["Test"].windowBytes() != 0) return Failed;
+    if (histograms["Test"].totalBytes != 15) return Failed;
+
+    return Success;
+  }
+};
+
+TEST_ADD(NetworkStatisticsTest);
+
+class FrameTimeHistogramTest : public Test {
+ public:
+  FrameTimeHistogramTest() : Test("Frame Time Histogram", Base) {}
+
+  virtual Result run(TestGame* game) {
+    rdm::FrameTimeHistogram histogram;
+    for (int i = 1; i <= 1000; i++) histogram.record(i / 100000.0);
+
+    if (histogram.getCount() != 1000) return Failed;
+    if (histogram.getMin() != 0.00001 || histogram.getMax() != 0.01)
+      return Failed;
+    // buckets are within ~6% of the real value
+    if (fabs(histogram.getPercentile(0.5) - 0.005) > 0.005 * 0.07)
+      return Failed;
+    if (fabs(histogram.getPercentile(0.99) - 0.0099) > 0.0099 * 0.07)
+      return Failed;
+
+    rdm::JobStatistics stats;
+    stats.resetSamples();
+    for (int i = 0; i < SCHEDULER_TIME_SAMPLES * 3 + 5; i++)
+      stats.addDeltaTimeSample(i % 2 ? 0.01 : 0.02);
+    if (fabs(stats.getAvgDeltaTime() - 0.015) > 0.0001) return Failed;
+    if (fabs(stats.getDeltaTimeVariance() - 0.000025) > 0.000001)
+      return Failed;
+
+    return Success;
+  }
+};
+
+TEST_ADD(FrameTimeHistogramTest);
+
+class AsyncIOTest : public Test {
+ public:
+  AsyncIOTest() : Test("Async IO", Base) {}
+
+  virtual Result run(TestGame* game) {
+    std::filesystem::path dir =
+        std::filesystem::temp_directory_path() / "rdm_async_io_test";
+    std::filesystem::create_directories(dir);
+
+    std::vector<std::string> contents = {"hello", "", std::string(70000, 'x')};
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < contents.size(); i++) {
+      paths.push_back((dir / std::to_string(i)).string());
+      std::ofstream(paths.back(), std::ios::binary) << contents[i];
+    }
+    paths.push_back((dir / "missing").string());
+
+    // io_uring where the kernel has it, and the thread pool
+    Result result = read(common::AsyncIO(2, true), paths, contents);
+    if (result == Success)
+      result = read(common::AsyncIO(2, false), paths, contents);
+
+    std::filesystem::remove_all(dir);
+    return result;
+  }
+
+ private:
+  Result read(common::AsyncIO&& io, const std::vector<std::string>& paths,
+              const std::vector<std::string>& contents) {
+    auto futures = io.readPaths(paths);
+    if (futures.size() != paths.size()) return Failed;
+    for (size_t i = 0; i < contents.size(); i++) {
+      common::OptionalBuffer buffer = futures[i].get();
+      if (!buffer) return Failed;
+      std::vector<unsigned char> data = buffer->take();
+      if (std::string(data.begin(), data.end()) != contents[i]) return Failed;
+    }
+    if (futures.back().get()) return Failed;
+    return Success;
+  }
+};
+
+TEST_ADD(AsyncIOTest);
+
+class PakFileTest : public Test {
+ public:
+  PakFileTest() : Test("Pak File", Base) {}
+
+  // a pak that never touches the disk
+  class MemoryIO : public common::FileIO {
+    const std::vector<unsigned char>& data;
+    size_t cursor;
+
+   public:
+    MemoryIO(const std::vector<unsigned char>& data) : data(data) {
+      cursor = 0;
+    }
+
+    virtual size_t seek(size_t pos, int whence) {
+      if (whence == SEEK_CUR) pos += cursor;
+      if (whence == SEEK_END) pos += data.size();
+      cursor = std::min(pos, data.size());
+      return cursor;
+    }
+    virtual size_t fileSize() { return data.size(); }
+    virtual size_t tell() { return cursor; }
+    virtual size_t read(void* out, size_t size) {
+      size = std::min(size, data.size() - cursor);
+      memcpy(out, data.data() + cursor, size);
+      cursor += size;
+      return size;
+    }
+  };
+
+  virtual Result run(TestGame* game) {
+    // enough paths that the index has to probe past collisions, a chunked
+    // entry, and two names sharing the same data like deduped files do
+    std::map<std::string, std::string> files;
+    for (int i = 0; i < 100; i++)
+      files["dir/file" + std::to_string(i)] = "contents " + std::to_string(i);
+    std::string big;
+    for (int i = 0; i < 10000; i++) big += std::to_string(i * 7919 % 1000);
+    files["big.bin"] = big;
+    files["same.txt"] = files["dir/file0"];
+
+    std::vector<unsigned char> pak(sizeof(pak::PakFileHeaderV2));
+    std::vector<pak::PakFileEntry> entries;
+    std::vector<char> strings;
+    std::map<std::string, size_t> offsets;
+    for (auto& [path, contents] : files) {
+      pak::PakFileEntry entry = {};
+      entry.nameStringIdx = strings.size();
+      strings.insert(strings.end(), path.begin(), path.end());
+      strings.push_back('\0');
+
+      std::vector<uint8_t> data(contents.begin(), contents.end());
+      entry.type = pak::None;
+      if (path == "big.bin") {
+        std::vector<uint8_t> compressed;
+        if (!pak::compressChunked(pak::Lzma, data.data(), data.size(),
+                                  compressed, 1024))
+          return Failed;
+        data = compressed;
+        entry.type = pak::Lzma;
+      }
+      auto it = offsets.find(contents);
+      if (it != offsets.end() && entry.type == pak::None) {
+        entry.dataOffset = it->second;
+      } else {
+        entry.dataOffset = pak.size();
+        offsets[contents] = pak.size();
+        pak.insert(pak.end(), data.begin(), data.end());
+      }
+      entry.dataSize = data.size();
+      entries.push_back(entry);
+    }
+    strings.push_back('\0');
+
+    std::vector<pak::PakIndexSlot> index;
+    pak::buildIndex(entries.data(), entries.size(), strings.data(), index);
+
+    pak::PakFileHeaderV2 hdr;
+    hdr.ident[0] = PAKF_HEADER_0;
+    hdr.ident[1] = PAKF_HEADER_1;
+    hdr.ident[2] = PAKF_HEADER_2;
+    hdr.ident[3] = PAKF_HEADER_3_VERSIONED;
+    hdr.version = PAK_VERSION;
+    hdr.stringsOffset = pak.size();
+    hdr.stringsSize = strings.size();
+    pak.insert(pak.end(), strings.begin(), strings.end());
+    hdr.pakEntriesOffset = pak.size();
+    hdr.numPakEntries = entries.size();
+    pak.insert(pak.end(), (unsigned char*)entries.data(),
+               (unsigned char*)(entries.data() + entries.size()));
+    hdr.indexOffset = pak.size();
+    hdr.indexSize = index.size();
+    pak.insert(pak.end(), (unsigned char*)index.data(),
+               (unsigned char*)(index.data() + index.size()));
+    memcpy(pak.data(), &hdr, sizeof(hdr));
+
+    MemoryIO io(pak);
+    pak::PakFile file(&io);
+    for (auto& [path, contents] : files) {
+      common::OptionalData data = file.getFileData(path.c_str());
+      if (!data || std::string(data->begin(), data->end()) != contents)
+        return Failed;
+    }
+
+    for (const char* missing :
+         {"", "missing", "dir", "dir/", "dir/file100", "dir/file0/",
+          "Big.bin", "big.bin2", "/same.txt"})
+      if (file.getFileExists(missing) || file.getFileData(missing))
+        return Failed;
+
+    return Success;
+  }
+};
+
+TEST_ADD(PakFileTest);
+
+class MeshOptimizeTest : public Test {
+ public:
+  MeshOptimizeTest() : Test("Mesh Optimize", Base) {}
+
+  // triangles rotated so the smallest index is first, which keeps the
+  // winding, then sorted so the order they're drawn in doesn't matter
+  static std::vector<std::array<uint32_t, 3>> triangleSet(
+      const std::vector<uint32_t>& indices) {
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      std::array<uint32_t, 3> t = {indices[i], indices[i + 1], indices[i + 2]};
+      std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+      triangles.push_back(t);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+  }
+
+  virtual Result run(TestGame* game) {
+    // a bumpy grid, with its triangles shuffled so the cache has work to do
+    const int size = 32;
+    std::vector<float> positions;
+    for (int y = 0; y <= size; y++)
+      for (int x = 0; x <= size; x++)
+        positions.insert(positions.end(),
+                         {(float)x, (float)((x * 7 + y * 3) % 5) * 0.1f,
+                          (float)y});
+    size_t vertexCount = positions.size() / 3;
+
+    std::vector<std::array<uint32_t, 3>> grid;
+    for (int y = 0; y < size; y++) {
+      for (int x = 0; x < size; x++) {
+        uint32_t v = y * (size + 1) + x;
+        grid.push_back({v, v + size + 1, v + 1});
+        grid.push_back({v + 1, v + size + 1, v + size + 2});
+      }
+    }
+    std::shuffle(grid.begin(), grid.end(), std::mt19937(4001));
+    std::vector<uint32_t> indices;
+    for (auto& t : grid) indices.insert(indices.end(), t.begin(), t.end());
+
+    std::vector<uint32_t> optimized = indices;
+    model::optimizeVertexCache(optimized.data(), optimized.size(),
+                               vertexCount);
+    if (triangleSet(optimized) != triangleSet(indices)) return Failed;
+    if (model::vertexCacheACMR(optimized.data(), optimized.size(),
+                               vertexCount) >
+        model::vertexCacheACMR(indices.data(), indices.size(), vertexCount))
+      return Failed;
+
+    // fetch order renumbers, mapping back has to give the same triangles,
+    // and every vertex is first used in order
+    std::vector<uint32_t> fetched = optimized;
+    std::vector<uint32_t> remap;
+    size_t used = model::optimizeVertexFetch(fetched.data(), fetched.size(),
+                                             vertexCount, remap);
+    if (used != vertexCount) return Failed;
+    std::vector<uint32_t> unmap(used);
+    for (size_t v = 0; v < vertexCount; v++) {
+      if (remap[v] == MESH_NO_VERTEX || remap[v] >= used) return Failed;
+      unmap[remap[v]] = v;
+    }
+    uint32_t next = 0;
+    for (uint32_t& index : fetched) {
+      if (index > next) return Failed;
+      if (index == next) next++;
+      index = unmap[index];
+    }
+    if (fetched != optimized) return Failed;
+
+    // the grid's edge is an open border, none of it may move
+    std::vector<uint32_t> simplified(indices.size());
+    size_t count = model::simplifyMesh(
+        simplified.data(), indices.data(), indices.size(), positions.data(),
+        sizeof(float) * 3, vertexCount, indices.size() / 4, 1.f);
+    simplified.resize(count);
+    if (count == 0 || count % 3 || count >= indices.size()) return Failed;
+    std::vector<bool> present(vertexCount, false);
+    for (size_t i = 0; i < count; i += 3) {
+      uint32_t a = simplified[i], b = simplified[i + 1], c = simplified[i + 2];
+      if (a == b || b == c || a == c) return Failed;
+      present[a] = present[b] = present[c] = true;
+    }
+    for (int y = 0; y <= size; y++)
+      for (int x = 0; x <= size; x++)
+        if ((x == 0 || y == 0 || x == size || y == size) &&
+            !present[y * (size + 1) + x])
+          return Failed;
+
+    return Success;
+  }
+};
+
+TEST_ADD(MeshOptimizeTest);
+};  // namespace test
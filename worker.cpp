@@ -1,7 +1,11 @@
 #include "worker.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <exception>
+#include <memory>
 #include <source_location>
 #include <thread>
 
@@ -106,6 +110,56 @@ WorkerManager* WorkerManager::singleton() {
   return _singleton;
 }
 
+void WorkerManager::parallelFor(
+    size_t count, size_t grain,
+    std::function<void(size_t begin, size_t end)> f) {
+  if (count == 0) return;
+  grain = std::max(grain, (size_t)1);
+  size_t chunks = (count + grain - 1) / grain;
+  if (chunks == 1) {
+    f(0, count);
+    return;
+  }
+
+  // shared with the helpers, which may only get scheduled after we're done
+  struct Batch {
+    std::atomic<size_t> next;
+    std::atomic<int> active;
+    std::mutex m;
+    std::condition_variable done;
+    size_t count;
+    size_t grain;
+    std::function<void(size_t, size_t)> f;
+  };
+  std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+  batch->next = 0;
+  batch->active = 0;
+  batch->count = count;
+  batch->grain = grain;
+  batch->f = std::move(f);
+
+  auto work = [batch] {
+    batch->active++;
+    while (true) {
+      size_t begin = batch->next.fetch_add(batch->grain);
+      if (begin >= batch->count) break;
+      batch->f(begin, std::min(begin + batch->grain, batch->count));
+    }
+    if (--batch->active == 0) {
+      std::scoped_lock l(batch->m);
+      batch->done.notify_all();
+    }
+  };
+
+  int helpers = std::min((int)chunks, Fun::getNumCpus()) - 1;
+  for (int i = 0; i < helpers; i++) run(work);
+  work();
+
+  // every chunk is claimed, wait for the ones still running elsewhere
+  std::unique_lock l(batch->m);
+  batch->done.wait(l, [&] { return batch->active == 0; });
+}
+
 void WorkerManager::shutdown() {
   running = false;
   managerThread.join();
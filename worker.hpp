@@ -57,6 +57,16 @@ class WorkerManager {
     queuedJobs.push_back(job);
   }
 
+  /**
+   * @brief Runs f over [0, count) in chunks of grain, on the workers and the
+   * calling thread, and returns once every chunk is done.
+   *
+   * The caller works through chunks too, so this never waits on a worker that
+   * hasn't been scheduled yet. f must not throw.
+   */
+  void parallelFor(size_t count, size_t grain,
+                   std::function<void(size_t begin, size_t end)> f);
+
   void shutdown();
 };
 };  // namespace rdm
@@ -22,6 +22,8 @@ class WorldJob : public SchedulerJob {
  public:
   WorldJob(World* world) : SchedulerJob("World", false), world(world) {}
 
+  virtual Phase getPhase() { return WorldTickPhase; }
+
   virtual Result step() {
     using namespace std::chrono_literals;
     if (!world->getRunning()) return Cancel;
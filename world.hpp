@@ -58,8 +58,10 @@ class World : public reflection::Object {
   World(WorldConstructorSettings settings = WorldConstructorSettings());
   ~World();
 
-  Signal<> stepping;
-  Signal<> stepped;
+  // fired every tick on the world's thread. listen before the scheduler's
+  // jobs start (Game::initialize) or from a listener, they don't lock
+  SignalST<> stepping;
+  SignalST<> stepped;
   Signal<std::string> changingTitle;
 
   std::mutex worldLock;  // lock when writing to world state